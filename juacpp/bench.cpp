@@ -0,0 +1,158 @@
+#include <iostream>
+#include <chrono>
+#include <format>
+#include "jua-vm.h"
+#include "jua-ic.h"
+#include "jua-syntax.h"
+#include "jua-scan.h"
+#include "workloads.h"
+
+//基准测试：分配速率与垃圾回收停顿；每项负载另用树遍历解释器（tree）和闭包引擎（closure）各运行一次，与字节码对比
+using std::cout;
+
+struct BenchVM: JuaVM{
+    string findModule(const string& name){
+        throw "no module: " + name;
+    }
+    void j_stdout(JuaArgs vals){}
+    void j_stderr(JuaError* err){
+        cout << err->toDebugString() << '\n';
+    }
+};
+
+void runJit(const Workload& w){
+    double secs[2];
+    for(int jit = 0; jit < 2; jit++){
+        BenchVM vm;
+        vm.jit = jit;
+        auto start = std::chrono::steady_clock::now();
+        vm.run(w.script);
+        secs[jit] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    cout << std::format("{:<12} interp {:7.3f}s | jit {:7.3f}s | speedup {:5.2f}x\n", w.name, secs[0], secs[1], secs[0] / secs[1]);
+}
+
+void runEval(){
+    //反复 eval（如 REPL）：每个脚本的语法树在执行完后释放，Function(...) 的语法树随函数值一起回收
+    BenchVM vm;
+    const char* script = R"(
+        fun add(a, b){ return a + b }
+        let double = Function('x', 'return x * 2')
+        let s = "${add(1, 2)}: ${double(3)}"
+    )";
+    const int n = 20000;
+    size_t trees = SyntaxTree::live;
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < n; i++){
+        vm.eval(script);
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    cout << std::format("eval         {} scripts {:7.3f}s | {:6.1f}us/eval | live syntax trees {} | heap {} KB\n",
+        n, secs, secs / n * 1e6, SyntaxTree::live - trees, vm.gc.count() >> 10);
+}
+
+string configModule(size_t bytes){
+    //仿照生成的配置模块：缩进、注释、长字符串和嵌套的对象、数组
+    string script;
+    for(int i = 0; script.size() < bytes; i++){
+        auto n = std::to_string(i);
+        script += "\n// service " + n + ": generated, do not edit\n"
+            "let service_" + n + " = {\n"
+            "    name = 'service-" + n + "',\n"
+            "    description = 'Handles requests for shard " + n + " of the primary storage cluster',\n"
+            "    path = `/var/lib/services/shard_" + n + "/data`,\n"
+            "    greeting = \"hello from ${name} #$index\\t(shard " + n + ")\",\n"
+            "    enabled = true,\n"
+            "    retries = " + n + ",\n"
+            "    ratio = 0." + n + "5,\n"
+            "    tags = ['alpha', 'beta\\tgamma', 'delta_epsilon_" + n + "'],\n"
+            "    /* resource limits are tuned per shard;\n"
+            "       see the capacity planning sheet */\n"
+            "    limits = {cpu = 2, memory = 1024, burst = 1.5e3, window = 0x1f},\n"
+            "}\n";
+    }
+    return script;
+}
+
+void runLex(){
+    //词法分析吞吐量：逐个比较 scan 的各个实现，最后一行为完整解析（含化简和变量解析）
+    const string script = configModule(8 << 20);
+    double mb = script.size() / double(1 << 20);
+    const int rounds = 5;
+    auto detected = scan::active;
+    for(auto isa: {"scalar", "sse2", "avx2"}){
+        if(!scan::use(isa))continue;
+        size_t tokens = 0;
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < rounds; i++)tokens = tokenize(script);
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / rounds;
+        cout << std::format("lex {:<8} {:6.1f} MB {:9} tokens {:7.3f}s | {:7.1f} MB/s\n", isa, mb, tokens, secs, mb / secs);
+    }
+    scan::active = detected; //完整解析使用启动时选择的实现
+    auto start = std::chrono::steady_clock::now();
+    {
+        TreeGuard tree(parse(script)->tree);
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    cout << std::format("parse ({})  {:6.1f} MB {:>16} {:7.3f}s | {:7.1f} MB/s\n", scan::active.name, mb, "", secs, mb / secs);
+}
+
+void report(JuaVM& vm){
+    //内联缓存统计：命中率，以及多态程度过高的访问处
+    size_t hits = 0, misses = 0;
+    for(auto cache: vm.propCaches){
+        hits += cache->hits;
+        misses += cache->misses;
+        if(cache->megamorphic)
+            cout << std::format("    megamorphic {} '{}': {} hits, {} misses\n", cache->kind, cache->key.str(), cache->hits, cache->misses);
+    }
+    cout << std::format("    inline caches: {} sites, {} hits, {} misses\n", vm.propCaches.size(), hits, misses);
+}
+
+void run(const Workload& w, JuaGC::Mode mode, JuaVM::Engine engine = JuaVM::Bytecode){
+    BenchVM vm;
+    vm.engine = engine;
+    auto& gc = vm.gc;
+    gc.setMode(mode);
+    size_t allocations = gc.allocations;
+    auto start = std::chrono::steady_clock::now();
+    vm.run(w.script);
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    allocations = gc.allocations - allocations;
+    size_t heap = gc.count(); //脚本结束时的堆占用，包括尚未回收的垃圾
+    const char* label = engine == JuaVM::Tree ? "tree" : engine == JuaVM::Closure ? "clo" : mode == JuaGC::Incremental ? "inc" : "gen";
+    double avgPause = gc.youngCollections ? gc.youngPauseTotal / gc.youngCollections : 0;
+    cout << std::format(
+        "{:<12} {:<4} {:7.3f}s {:9} allocs {:7.2f} M/s | young: {:5} gcs, avg {:7.1f}us, max {:7.1f}us | full: {:3} gcs, {:6} steps, max pause {:8.1f}us | freed {} KB, heap {} KB\n",
+        w.name, label, secs, allocations, allocations / secs / 1e6,
+        gc.youngCollections, avgPause, gc.youngPauseMax,
+        gc.collections, gc.steps, gc.pauseMax, gc.totalFreed >> 10, heap >> 10
+    );
+    if(mode == JuaGC::Generational && engine == JuaVM::Bytecode)report(vm);
+}
+
+int main(){
+    try{
+        for(auto& w: workloads){
+            run(w, JuaGC::Generational);
+            run(w, JuaGC::Incremental);
+            run(w, JuaGC::Generational, JuaVM::Tree);
+            run(w, JuaGC::Generational, JuaVM::Closure);
+        }
+        runEval();
+        runLex();
+        if(!JitCode::supported)cout << "jit: not supported on this platform\n";
+        else{
+            //机器码不处理调用、返回和下标，这些指令仍由解释器执行，见 JitCode
+            cout << "jit: calls, returns and subscripts run in the interpreter\n";
+            for(auto& w: jitWorkloads){
+                runJit(w);
+            }
+        }
+    }catch(const char* str){
+        cout << str << '\n';
+    }catch(string str){
+        cout << str << '\n';
+    }
+    return 0;
+}
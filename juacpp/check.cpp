@@ -0,0 +1,411 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <chrono>
+#include "jua-vm.h"
+#include "workloads.h"
+
+//对照测试：同一脚本用每种执行方式各运行一次，输出（print 的内容和未捕获的错误）必须与树遍历解释器完全一致
+//脚本包括下面的 scripts、基准测试的负载（workloads.h），以及命令行参数给出的 .jua 文件；另外检查 syntaxErrors 的报错、tailCalls 的结果、深层嵌套的编译时间和多线程中的 vm
+//有差异时返回 1
+using std::cout;
+
+struct CheckVM: JuaVM{
+    string out; //print 的内容和未捕获的错误，按行记录
+    CheckVM(){
+        //stack() 返回当前的栈地址，frames() 返回帧作用域栈的深度，用于检查尾调用不增长栈和内存
+        _G->setProp("stack", makeFunc([](JuaVM*, JuaArgs, void*) -> Jua_Val {
+            char marker;
+            return Jua_Num(double(reinterpret_cast<uintptr_t>(&marker)));
+        }));
+        _G->setProp("frames", makeFunc([](JuaVM* vm, JuaArgs, void*) -> Jua_Val {
+            return Jua_Num(double(vm->frameDepth));
+        }));
+    }
+    string findModule(const string& name){
+        throw "no module: " + name;
+    }
+    void j_stdout(JuaArgs vals){
+        for(size_t i = 0; i < vals.size(); i++){
+            if(i)out.push_back('\t');
+            out.append(vals[i].toString());
+        }
+        out.push_back('\n');
+    }
+    void j_stderr(JuaError* err){
+        out += "error: " + err->toDebugString() + '\n';
+    }
+};
+
+struct Mode{
+    const char* name;
+    JuaVM::Engine engine;
+    bool quicken; //自特化的运算，见 quickOperate
+    bool jit; //热点函数编译为机器码，见 JitCode
+};
+const Mode modes[] = {
+    {"tree", JuaVM::Tree, false, false}, //基准
+    {"tree-quick", JuaVM::Tree, true, false},
+    {"bytecode", JuaVM::Bytecode, false, false},
+    {"quick", JuaVM::Bytecode, true, false},
+    {"jit", JuaVM::Bytecode, true, true}, //不支持的平台上跳过
+    {"closure", JuaVM::Closure, true, false},
+};
+
+//逐项打印结果的脚本；循环超过 JIT_THRESHOLD 次，使 jit 方式确实执行机器码
+const Workload scripts[] = {
+    {"arith", R"(
+        let sum = 0
+        let x = 0.5
+        let i = 0
+        while(i < 3000){
+            if(i >= 10 && i * 2 > x) sum = sum + i / 2 - x
+            if(sum != i) x = x * 0.5 + 1
+            i += 1
+        }
+        print(sum, x)
+        let mixed = Array.of(1, 2.5, 'a', 'b', 3)
+        let acc = 0
+        let str = ''
+        let idx = 0
+        for(k in 0..1500){
+            let v = mixed[idx]
+            idx += 1
+            if(idx == 5) idx = 0
+            if(type(v) == 'number') acc += v
+            else if(k < 20) str = str + v
+        }
+        print(acc, str)
+        print(1 / 0, -1 / 0, 0 / 0 == 0 / 0, 0 / 0 != 0 / 0, 0 / 0 < 1, 0 / 0 >= 1)
+        print(-3 + 2 * 4 - 8 / 2, 'a' + 'b' == 'ab', 1 == '1', null == null)
+        print(true && 0 || 'x', null || false, !0, !'')
+        fun addAll(a, b){ return a + b }
+        let n = 0
+        while(n < 1200){ addAll(n, n); n += 1 }
+        print(addAll(1, 2), addAll('1', '2'))
+        print(1 + 'a')
+    )"},
+    {"objects", R"(
+        let o = {a = 1, b = 'x'}
+        o.c = 3
+        o.a = 4
+        for(k in o) print(k, o[k])
+        let Point = class({
+            init(self, x, y){ self.x = x; self.y = y },
+            len2(self){ return self.x * self.x + self.y * self.y }
+        })
+        let Point3 = class({
+            super = Point,
+            init(self, x, y, z){ self.x = x; self.y = y; self.z = z },
+            len2(self){ return self.x * self.x + self.y * self.y + self.z * self.z }
+        })
+        let total = 0
+        let i = 0
+        while(i < 2000){
+            let p = Point(i, 1)
+            if(i >= 1000) p = Point3(1, i, 2)
+            total += p:len2() + p.x
+            i += 1
+        }
+        print(total)
+        let shapes = Array.of({x = 1}, {a = 1, x = 2}, {b = 1, x = 3}, {c = 1, x = 4}, {d = 1, x = 5})
+        let xs = 0
+        for(j in 0..400) for(s in shapes) xs += s.x
+        print(xs)
+        let d = {}
+        for(j in 0..100) d["k${j}"] = j
+        print(d.k7, d['k99'])
+        print(d.k100)
+    )"},
+    {"closures", R"(
+        fun counter(){
+            let n = 0
+            return fun(){ n += 1; return n }
+        }
+        let c1 = counter()
+        let c2 = counter()
+        c1(); c1()
+        print(c1(), c2())
+        let fns = Array.of()
+        for(i in 0..5) fns:push(fun(){ return i * 10 })
+        let out = ''
+        for(f in fns) out = "${out}${f()},"
+        print(out)
+        let double = Function('x', 'return x * 2')
+        print(double(21))
+        fun fib(n){ if(n < 2) return n; return fib(n - 1) + fib(n - 2) }
+        print(fib(20))
+    )"},
+    {"control", R"(
+        let s = 0
+        for(i in 0..10){
+            if(i == 3) continue
+            if(i == 8) break
+            s += i
+        }
+        print(s)
+        let names = ''
+        for(k in 0..30){
+            switch(k)
+                case(0, 1) names = names + 'a'
+                case(2) names = names + 'b'
+                case(5) names = names + 'c'
+                else names = names + '.'
+        }
+        print(names)
+        let w = 0
+        let j = 0
+        while(true){
+            j += 1
+            if(j > 2500) break
+            if(j > 1000) continue
+            w += j
+        }
+        print(w, j)
+        let words = Array.of('get', 'set', 'put', 'get')
+        let n = 0
+        for(op in words){
+            switch(op)
+                case('get') n += 1
+                case('set') n += 10
+        }
+        print(n)
+    )"},
+    {"errors", R"(
+        let json = require('json')
+        let r = try(fun(){ throw('bad') })
+        print(r.status, r.error.name, r.error.message)
+        let ok = try(fun(a, b){ return a + b }, 1, 2)
+        print(ok.status, ok.value)
+        let bad = try(json.decode, '{x')
+        print(bad.status, bad.error.name)
+        let failed = 0
+        let i = 0
+        while(i < 1500){
+            if(!try(fun(){ throw('x') }).status) failed += 1
+            i += 1
+        }
+        print(failed)
+        print(json.encode({x = 1, y = Array.of(1, 'two', null, true)}))
+        print(json.decode('[1, 2, {"a": 3}]')[2].a)
+        throw('uncaught')
+    )"},
+};
+
+//语法错误：报错的内容和位置必须与 error 一致，解析器不能抛出其他类型的值或导致进程终止
+struct SyntaxCase{
+    const char* script;
+    const char* error;
+};
+const SyntaxCase syntaxErrors[] = {
+    {"let x = (1 +", "Missing ')' at 1:12"},
+    {"let o = {a = 1", "Missing '}' at 1:14"},
+    {"let x = 1 +", "Unfinished input at 1:12"},
+    {"f(1, 2 3)", "Unexpected \"3\"; Expect \",\" at 1:8"},
+    {"let s = '\\u0041'", "unsupported escape '\\u' at 1:11"},
+    {"fun 1(){}", "Invalid function name at 1:5"},
+    {"break", "break outside a loop at 1:1"},
+    {"fun f(){\n    continue\n}", "continue outside a loop at 2:5"},
+    {"while(true){ let g = fun(){ break } }", "break outside a loop at 1:29"},
+    {"f(x?){ break }", "break outside a loop at 1:8"},
+    //闭括号缺失时括号中的尾随函数先被解析，其中的 break 不在循环中
+    {"let i = 0\nwhile(i < 10{ break }", "break outside a loop at 2:15"},
+};
+
+bool checkSyntax(const SyntaxCase& c){
+    CheckVM vm;
+    vm.run(c.script);
+    auto expected = string("error: JuaSyntaxError: ") + c.error + '\n';
+    if(vm.out == expected){
+        cout << "ok   syntax: " << c.error << '\n';
+        return true;
+    }
+    cout << "FAIL syntax: " << c.script << '\n' << "--- expected\n" << expected << "--- got\n" << vm.out;
+    return false;
+}
+
+//尾调用：一百万层尾递归的结果正确，且到达最深处时的栈地址和帧作用域数与只递归几层时相同
+//原生函数和 try(f, ...) 不是尾调用，按普通调用执行
+const char* tailCalls = R"(
+    let math = require('math')
+    fun loop(n, acc){
+        if(n == 0) return acc
+        return loop(n - 1, acc + 1)
+    }
+    fun isEven(n){ if(n == 0) return true; return isOdd(n - 1) }
+    fun isOdd(n){ if(n == 0) return false; return isEven(n - 1) }
+    print(loop(1000000, 0) == 1000000, isEven(1000001))
+    fun probe(n){
+        if(n == 0) return Array.of(stack(), frames())
+        return probe(n - 1)
+    }
+    let shallow = probe(10)
+    let deep = probe(1000000)
+    print(shallow[0] - deep[0] < 16384, deep[1] == shallow[1])
+    fun floor(n){ return math.floor(n) }
+    print(floor(2.5))
+    fun down(n){
+        if(n == 0) throw('bottom')
+        return down(n - 1)
+    }
+    let t = try(down, 1000000)
+    print(t.status, t.error.message)
+    fun guarded(n){
+        if(n == 0) return 'done'
+        return try(guarded, n - 1)
+    }
+    let g = guarded(3)
+    print(g.status, g.value.value.value)
+)";
+const char* tailCallsOutput = "true\tfalse\ntrue\ttrue\n2\nfalse\tbottom\ntrue\tdone\n";
+
+string runMode(const Mode& mode, const string& script){
+    CheckVM vm;
+    vm.engine = mode.engine;
+    vm.quicken = mode.quicken;
+    vm.jit = mode.jit;
+    try{
+        vm.run(script);
+    }catch(const char* str){
+        vm.out += string("thrown: ") + str + '\n';
+    }catch(string str){
+        vm.out += "thrown: " + str + '\n';
+    }
+    return vm.out;
+}
+
+bool check(const string& name, const string& script){
+    //第一种方式（tree）的结果为基准
+    string expected;
+    bool same = true;
+    for(auto& mode: modes){
+        if(mode.jit && !JitCode::supported)continue;
+        auto out = runMode(mode, script);
+        if(&mode == modes){
+            expected = out;
+        }else if(out != expected){
+            cout << "FAIL " << name << ": " << mode.name << " differs from " << modes[0].name << '\n'
+                 << "--- " << modes[0].name << '\n' << expected
+                 << "--- " << mode.name << '\n' << out;
+            same = false;
+        }
+    }
+    if(same)cout << "ok   " << name << '\n';
+    return same;
+}
+
+bool checkTailCalls(){
+    bool passed = true;
+    for(auto& mode: modes){
+        if(mode.jit && !JitCode::supported)continue;
+        auto out = runMode(mode, tailCalls);
+        if(out != tailCallsOutput){
+            cout << "FAIL tail calls (" << mode.name << ")\n" << "--- expected\n" << tailCallsOutput << "--- got\n" << out;
+            passed = false;
+        }
+    }
+    if(passed)cout << "ok   tail calls\n";
+    return passed;
+}
+
+//深层嵌套：长的运算链和多层嵌套的块。每种方式的结果须一致，且编译和执行都不超过 1 秒（子节点的闭包被复制时编译时间与深度成平方关系，见 closure.cpp）
+string nestedScript(){
+    string script = "fun sum(x){ return x";
+    for(int i = 1; i < 8000; i++)script += " + x";
+    script += " }\nprint(sum(1), sum(0.5))\nlet depth = 0\n";
+    for(int i = 0; i < 1000; i++)script += "if(depth >= 0){ let d = depth + 1\ndepth = d\n";
+    for(int i = 0; i < 1000; i++)script += "}\n";
+    return script + "print(depth)\n";
+}
+
+bool checkNesting(){
+    auto script = nestedScript();
+    bool passed = check("nesting", script);
+    for(auto& mode: modes){
+        if(mode.jit && !JitCode::supported)continue;
+        auto start = std::chrono::steady_clock::now();
+        runMode(mode, script);
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        if(ms > 1000){
+            cout << "FAIL nesting (" << mode.name << "): " << ms << " ms\n";
+            passed = false;
+        }
+    }
+    return passed;
+}
+
+//多个线程中的 vm 同时把相同的字符串驻留为动态原子，并在完整回收时释放，见 Atom
+const char* sharedKeys = R"(
+    let json = require('json')
+    let total = 0
+    for(r in 0..40){
+        let o = {}
+        for(i in 0..200){
+            o["key${i}"] = i
+            let d = json.decode("{\"k${i}\": ${i}, \"shared\": 1}")
+            total += d["k${i}"] + d.shared
+        }
+        let f = Function('x', "return x.key${r} + x['key199']")
+        total += f(o)
+    }
+    print(total)
+)";
+
+bool checkThreads(){
+    const int n = 4;
+    string expected = runMode(modes[0], sharedKeys);
+    std::vector<string> outs(n);
+    std::vector<std::thread> threads;
+    for(int t = 0; t < n; t++){
+        threads.emplace_back([&outs, t](){
+            for(int k = 0; k < 3; k++){
+                CheckVM vm;
+                vm.gc.setMode(t % 2 ? JuaGC::Incremental : JuaGC::Generational);
+                vm.run(sharedKeys);
+                outs[t] += vm.out;
+            }
+        });
+    }
+    for(auto& t: threads)t.join();
+    for(auto& out: outs){
+        if(out != expected + expected + expected){
+            cout << "FAIL threads\n" << "--- expected (3 times)\n" << expected << "--- got\n" << out;
+            return false;
+        }
+    }
+    cout << "ok   threads\n";
+    return true;
+}
+
+int main(int argc, char* argv[]){
+    int failures = 0;
+    for(auto& c: syntaxErrors){
+        if(!checkSyntax(c))failures++;
+    }
+    if(!checkTailCalls())failures++;
+    if(!checkThreads())failures++;
+    if(!checkNesting())failures++;
+    for(auto& s: scripts){
+        if(!check(s.name, s.script))failures++;
+    }
+    for(auto& w: workloads){
+        if(!check(w.name, w.script))failures++;
+    }
+    for(auto& w: jitWorkloads){
+        if(!check(w.name, w.script))failures++;
+    }
+    for(int i = 1; i < argc; i++){
+        std::ifstream file(argv[i]);
+        if(!file.is_open()){
+            cout << "FAIL " << argv[i] << ": cannot open\n";
+            failures++;
+            continue;
+        }
+        std::stringstream script;
+        script << file.rdbuf();
+        if(!check(argv[i], script.str()))failures++;
+    }
+    cout << (failures ? std::to_string(failures) + " failed\n" : "all passed\n");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,439 @@
+#include "jua-syntax.h"
+#include "jua-vm.h"
+
+//闭包执行引擎：每个节点编译为一个闭包，子节点的闭包移动到其中（不复制，否则编译时间与嵌套深度成平方关系），执行时直接调用，不经过 calc、exec 的虚函数
+//运算符的种类在编译时确定；语句以返回值 Flow 传递 break、continue、return，不检查 Controller::isPending
+//作用域、值的保护和安全点与树遍历解释器一致，节点中的状态（变量的 depth、slot，内联缓存）在执行时读取
+
+static std::vector<ExprFn> closeAll(const std::vector<Expr*>& exprs){
+    std::vector<ExprFn> fns;
+    for(auto expr: exprs){
+        fns.push_back(expr->close());
+    }
+    return fns;
+}
+
+ExprFn Expr::close(){
+    return [this](Scope* env){ return calc(env); };
+}
+ExprFn LiteralNum::close(){
+    Jua_Val val = Jua_Num(value);
+    return [val](Scope*){ return val; };
+}
+ExprFn LiteralStr::close(){
+    return [this](Scope* env) -> Jua_Val { return get(env->vm); };
+}
+ExprFn Keyword::close(){
+    if(type == 'l')return [](Scope* env) -> Jua_Val { return env; };
+    Jua_Val val = calc(nullptr);
+    return [val](Scope*){ return val; };
+}
+ExprFn Template::close(){
+    return [this, exprs = closeAll(exprList)](Scope* env) -> Jua_Val {
+        string str = strList[0];
+        for(size_t i = 0; i < exprs.size(); i++){
+            str += exprs[i](env).toString();
+            str += strList[i+1];
+        }
+        return new Jua_Str(env->vm, str);
+    };
+}
+ExprFn Varname::close(){
+    //变量在当前作用域中且已声明时直接读取，其他情况同 calc
+    return [this](Scope* env){
+        if(depth == 0 && slot >= 0 && env->shape == env->layout){
+            if(auto val = env->slots[slot])return val;
+        }
+        return Varname::calc(env);
+    };
+}
+ExprFn OptionalPropRef::close(){
+    return [this, obj = expr->close()](Scope* env){
+        auto val = cache.get(env->vm, obj(env));
+        return val ? val : Jua_Null::getInst();
+    };
+}
+ExprFn PropRef::close(){
+    return [this, obj = expr->close()](Scope* env){
+        auto val = cache.get(env->vm, obj(env));
+        if(!val)throw new JuaError(std::format("no property: {}", prop.str()));
+        return val;
+    };
+}
+ExprFn MethWrapper::close(){
+    return [this, obj = expr->close()](Scope* env){
+        return wrap(env->vm, obj(env));
+    };
+}
+ExprFn UnitaryExpr::close(){
+    auto val = pri->close();
+    if(oper == UniOper::not_)
+        return [val = std::move(val)](Scope* env) -> Jua_Val { return Jua_Bool::getInst(!val(env).toBoolean()); };
+    return [val = std::move(val)](Scope* env){
+        auto v = val(env);
+        return v.isNum() ? Jua_Num(-v.num()) : v.unm();
+    };
+}
+
+//二元运算：两个操作数都是数字时直接计算，否则交给 operate；op 为常量，两处的分派都在编译时完成
+template<BinOper op>
+static Jua_Val apply(JuaVM* vm, Jua_Val left, Jua_Val right){
+    if(left.isNum() && right.isNum())return operateNum(op, left.num(), right.num());
+    return operate(vm, op, left, right);
+}
+template<BinOper op>
+static ExprFn binary(ExprFn left, ExprFn right){
+    return [left = std::move(left), right = std::move(right)](Scope* env){
+        auto leftVal = left(env);
+        if(leftVal.isNum())return apply<op>(env->vm, leftVal, right(env)); //数字不需要保护
+        RootGuard guard(env->vm->gc);
+        guard.push(leftVal);
+        return apply<op>(env->vm, leftVal, right(env));
+    };
+}
+typedef Jua_Val (*Apply)(JuaVM*, Jua_Val, Jua_Val);
+static Apply applier(BinOper type){
+    switch(type){
+        case BinOper::add: return apply<BinOper::add>;
+        case BinOper::sub: return apply<BinOper::sub>;
+        case BinOper::mul: return apply<BinOper::mul>;
+        case BinOper::div: return apply<BinOper::div>;
+        case BinOper::lt: return apply<BinOper::lt>;
+        case BinOper::le: return apply<BinOper::le>;
+        case BinOper::gt: return apply<BinOper::gt>;
+        case BinOper::ge: return apply<BinOper::ge>;
+        case BinOper::eq: return apply<BinOper::eq>;
+        case BinOper::ne: return apply<BinOper::ne>;
+        default: return nullptr; //operateNum 不处理的运算
+    }
+}
+__attribute__((noinline)) static ExprFn combine(BinaryExpr* expr, ExprFn l, ExprFn r){
+    //不在递归的 close 中展开：各分支的闭包会使深层嵌套的表达式编译时每层的栈帧都很大
+    switch(expr->oper){
+        case BinOper::and_:
+            return [l = std::move(l), r = std::move(r)](Scope* env){
+                auto val = l(env);
+                return val.toBoolean() ? r(env) : val;
+            };
+        case BinOper::or_:
+            return [l = std::move(l), r = std::move(r)](Scope* env){
+                auto val = l(env);
+                return val.toBoolean() ? val : r(env);
+            };
+        case BinOper::add: return binary<BinOper::add>(std::move(l), std::move(r));
+        case BinOper::sub: return binary<BinOper::sub>(std::move(l), std::move(r));
+        case BinOper::mul: return binary<BinOper::mul>(std::move(l), std::move(r));
+        case BinOper::div: return binary<BinOper::div>(std::move(l), std::move(r));
+        case BinOper::lt: return binary<BinOper::lt>(std::move(l), std::move(r));
+        case BinOper::le: return binary<BinOper::le>(std::move(l), std::move(r));
+        case BinOper::gt: return binary<BinOper::gt>(std::move(l), std::move(r));
+        case BinOper::ge: return binary<BinOper::ge>(std::move(l), std::move(r));
+        case BinOper::eq: return binary<BinOper::eq>(std::move(l), std::move(r));
+        case BinOper::ne: return binary<BinOper::ne>(std::move(l), std::move(r));
+        default:
+            return [oper = expr->oper, l = std::move(l), r = std::move(r)](Scope* env){
+                RootGuard guard(env->vm->gc);
+                auto leftVal = l(env);
+                guard.push(leftVal);
+                return operate(env->vm, oper, leftVal, r(env));
+            };
+    }
+}
+ExprFn BinaryExpr::close(){
+    auto l = left->close();
+    return combine(this, std::move(l), right->close());
+}
+
+//赋值：变量直接调用 Varname 的实现，其他左值调用虚函数
+template<typename Store>
+static ExprFn assignment(ExprFn right, Store store){
+    return [right = std::move(right), store](Scope* env){
+        RootGuard guard(env->vm->gc);
+        auto val = right(env);
+        guard.push(val);
+        store(env, val);
+        return val;
+    };
+}
+ExprFn Assignment::close(){
+    if(auto var = dynamic_cast<Varname*>(left))
+        return assignment(right->close(), [var](Scope* env, Jua_Val val){ var->Varname::assign(env, val); });
+    return assignment(right->close(), [lv = left](Scope* env, Jua_Val val){ lv->assign(env, val); });
+}
+ExprFn OperAssignment::close(){
+    auto l = left->close();
+    auto r = right->close();
+    auto fn = applier(type);
+    return [this, l = std::move(l), r = std::move(r), fn](Scope* env){
+        RootGuard guard(env->vm->gc);
+        auto leftVal = l(env);
+        guard.push(leftVal);
+        auto rightVal = r(env);
+        auto result = fn ? fn(env->vm, leftVal, rightVal) : operate(env->vm, type, leftVal, rightVal);
+        guard.push(result);
+        assignee->assign(env, result);
+        return result;
+    };
+}
+ExprFn Subscription::close(){
+    return [obj = expr->close(), key = keyExpr->close()](Scope* env){
+        RootGuard guard(env->vm->gc);
+        auto val = obj(env);
+        guard.push(val);
+        return val.getItem(key(env));
+    };
+}
+ExprFn TernaryExpr::close(){
+    return [cond = condExpr->close(), t = trueExpr->close(), f = falseExpr->close()](Scope* env){
+        return cond(env).toBoolean() ? t(env) : f(env);
+    };
+}
+//调用：tail 不为空时是 return 中的尾调用，同 Call::invoke
+typedef std::function<Jua_Val(Scope*, Controller* tail)> CallFn;
+static CallFn invocation(Call* call){
+    auto args = closeAll(call->args->exprs);
+    if(auto mc = dynamic_cast<MethodCall*>(call)){
+        return [meth = mc->meth, obj = mc->meth->expr->close(), args = std::move(args)](Scope* env, Controller* tail){
+            RootGuard guard(env->vm->gc);
+            auto self = obj(env);
+            guard.push(self);
+            auto fn = meth->lookup(env->vm, self);
+            guard.push(fn);
+            ArgFrame frame(env->vm->gc, args.size() + 1);
+            frame.args[0] = self;
+            for(size_t i = 0; i < args.size(); i++){
+                frame.args[i + 1] = args[i](env);
+            }
+            return tail ? tail->call(fn, frame.args) : fn.call(frame.args);
+        };
+    }
+    return [fn = call->calee->close(), args = std::move(args)](Scope* env, Controller* tail){
+        RootGuard guard(env->vm->gc);
+        auto f = fn(env);
+        guard.push(f);
+        ArgFrame frame(env->vm->gc, args.size());
+        for(size_t i = 0; i < args.size(); i++){
+            frame.args[i] = args[i](env);
+        }
+        return tail ? tail->call(f, frame.args) : f.call(frame.args);
+    };
+}
+ExprFn Call::close(){
+    return [call = invocation(this)](Scope* env){ return call(env, nullptr); };
+}
+ExprFn ObjExpr::close(){
+    std::vector<std::pair<ExprFn, ExprFn>> fns;
+    for(auto& [key, val]: entries){
+        fns.push_back({key->close(), val->close()});
+    }
+    return [this, fns = std::move(fns)](Scope* env) -> Jua_Val {
+        RootGuard guard(env->vm->gc);
+        auto obj = new Jua_Obj(env->vm);
+        guard.push(obj);
+        for(size_t i = 0; i < fns.size(); i++){
+            if(keys[i]){
+                obj->setProp(keys[i], fns[i].second(env));
+                continue;
+            }
+            auto key = fns[i].first(env);
+            guard.push(key);
+            auto val = fns[i].second(env);
+            if(key.type() != Jua_Val::Str)
+                throw new JuaError("non-string key");
+            obj->setProp(Atom::dynamic(env->vm, key.toString()), val);
+        }
+        return obj;
+    };
+}
+ExprFn ArrayExpr::close(){
+    return [items = list ? closeAll(list->exprs) : std::vector<ExprFn>()](Scope* env) -> Jua_Val {
+        RootGuard guard(env->vm->gc);
+        auto arr = new Jua_Array(env->vm, {});
+        guard.push(arr);
+        for(auto& item: items){
+            arr->items.push_back(item(env));
+        }
+        env->vm->gc.barrier(arr); //求值过程中可能已晋升
+        return arr;
+    };
+}
+ExprFn FunExpr::close(){
+    return [this](Scope* env) -> Jua_Val { return new Jua_PFunc(env, decList, body); };
+}
+
+StmtFn ExprStatement::close(){
+    return [e = expr->close()](Scope* env, Controller&){
+        e(env);
+        return Flow::normal;
+    };
+}
+StmtFn Declaration::close(){
+    //同 DeclarationList::rawDeclare 不带参数的情况，每一项都有初始值
+    struct Item{
+        Varname* var; //为空时是解构，调用 Declarable::declare
+        Declarable* body;
+        ExprFn init;
+    };
+    std::vector<Item> items;
+    for(auto item: list->decItems){
+        items.push_back({dynamic_cast<Varname*>(item->body), item->body, item->initval->close()});
+    }
+    return [items = std::move(items)](Scope* env, Controller&){
+        for(auto& item: items){
+            RootGuard guard(env->vm->gc);
+            auto val = item.init(env);
+            guard.push(val);
+            if(item.var)item.var->Varname::declare(env, val);
+            else item.body->declare(env, val);
+        }
+        return Flow::normal;
+    };
+}
+StmtFn Return::close(){
+    if(!expr)return [](Scope*, Controller& ctrl){
+        ctrl.retval = Jua_Null::getInst();
+        return Flow::returning;
+    };
+    if(tail)return [call = invocation(static_cast<Call*>(expr))](Scope* env, Controller& ctrl){
+        ctrl.retval = call(env, &ctrl); //尾调用时为空值，ctrl.tailFn 由 FunctionBody::run 执行
+        return Flow::returning;
+    };
+    return [e = expr->close()](Scope* env, Controller& ctrl){
+        ctrl.retval = e(env);
+        return Flow::returning;
+    };
+}
+StmtFn Break::close(){
+    return [](Scope*, Controller&){ return Flow::breaking; };
+}
+StmtFn Continue::close(){
+    return [](Scope*, Controller&){ return Flow::continuing; };
+}
+StmtFn IfStmt::close(){
+    auto then = body->close();
+    if(cond == Keyword::t) //见 IfStmt::optimize
+        return [this, then = std::move(then)](Scope* env, Controller& ctrl){ return then(body->enter(env), ctrl); };
+    auto test = cond->close();
+    auto otherwise = elseBody ? elseBody->close() : StmtFn();
+    return [this, test = std::move(test), then = std::move(then), otherwise = std::move(otherwise)](Scope* env, Controller& ctrl){
+        if(test(env).toBoolean())return then(body->enter(env), ctrl);
+        if(otherwise)return otherwise(elseBody->enter(env), ctrl);
+        return Flow::normal;
+    };
+}
+StmtFn SwitchStmt::close(){
+    std::vector<std::vector<ExprFn>> conds;
+    std::vector<StmtFn> bodies;
+    for(auto cb: cases){
+        conds.push_back(closeAll(cb->cond->exprs));
+        bodies.push_back(cb->body->close());
+    }
+    auto otherwise = defaultBody ? defaultBody->close() : StmtFn();
+    return [this, e = expr->close(), conds = std::move(conds), bodies = std::move(bodies), otherwise = std::move(otherwise)](Scope* env, Controller& ctrl){
+        RootGuard guard(env->vm->gc);
+        auto val = e(env);
+        guard.push(val);
+        if(jumpTable){
+            int i = lookup(val);
+            if(i >= 0)return bodies[i](cases[i]->body->enter(env), ctrl);
+        }else for(size_t i = 0; i < conds.size(); i++){
+            for(auto& cond: conds[i]){
+                if(cond(env).equals(val))return bodies[i](cases[i]->body->enter(env), ctrl);
+            }
+        }
+        if(otherwise)return otherwise(defaultBody->enter(env), ctrl);
+        return Flow::normal;
+    };
+}
+StmtFn WhileStmt::close(){
+    return [this, test = cond->close(), loop = body->close()](Scope* env, Controller& ctrl){
+        auto& gc = env->vm->gc;
+        RootGuard guard(gc);
+        size_t root = gc.stack.size();
+        guard.push(nullptr); //上一次迭代的作用域，见 Block::enter
+        Scope* scope = nullptr;
+        while(test(env).toBoolean()){
+            gc.stack[root] = scope = body->enter(env, scope);
+            auto flow = loop(scope, ctrl);
+            if(flow == Flow::breaking)break;
+            if(flow == Flow::returning)return flow;
+        }
+        return Flow::normal;
+    };
+}
+StmtFn ForStmt::close(){
+    auto var = dynamic_cast<Varname*>(declarable);
+    return [this, var, target = iterable->close(), loop = body->close()](Scope* env, Controller& ctrl){
+        auto iter = target(env);
+        auto& gc = env->vm->gc;
+        RootGuard guard(gc);
+        size_t root = gc.stack.size();
+        guard.push(nullptr); //上一次迭代的作用域，见 Block::enter
+        Scope* scope = nullptr;
+        Flow flow = Flow::normal;
+        auto iterate = [&](Jua_Val value){
+            //执行一次循环体，返回是否继续
+            if(var)var->Varname::declare(env, value);
+            else declarable->declare(env, value);
+            gc.stack[root] = scope = body->enter(env, scope);
+            flow = loop(scope, ctrl);
+            return flow == Flow::normal || flow == Flow::continuing;
+        };
+        if(iter.isType(Jua_Range::type_id)){
+            auto range = iter.as<Jua_Range>();
+            double start = range->start, step = range->step;
+            size_t length = range->length();
+            for(size_t i = 0; i < length && iterate(Jua_Num(start + i * step)); i++);
+        }else{
+            std::unique_ptr<JuaIterator> it(iter.getIterator(env->vm->obj_next)); //迭代器持有 iter
+            Jua_Val value;
+            while((value = it->next()) && iterate(value));
+        }
+        return flow == Flow::returning ? flow : Flow::normal;
+    };
+}
+
+void Block::flatten(std::vector<StmtFn>& fns){
+    for(auto stmt: statements){
+        auto branch = dynamic_cast<IfStmt*>(stmt);
+        if(branch && branch->cond == Keyword::t && !branch->body->hasScope){
+            branch->body->flatten(fns);
+            continue;
+        }
+        fns.push_back(stmt->close());
+    }
+}
+StmtFn Block::close(){
+    std::vector<StmtFn> fns;
+    flatten(fns);
+    return [fns = std::move(fns)](Scope* env, Controller& ctrl){
+        auto& gc = env->vm->gc;
+        RootGuard guard(gc);
+        guard.push(env);
+        for(auto& fn: fns){
+            gc.check(); //安全点
+            auto flow = fn(env, ctrl);
+            if(flow != Flow::normal)return flow;
+        }
+        return Flow::normal;
+    };
+}
+Jua_Val FunctionBody::run(Scope* env){
+    auto vm = env->vm;
+    size_t depth = vm->frameDepth;
+    Controller controller;
+    FunctionBody* body = this;
+    auto& gc = vm->gc;
+    RootGuard guard(gc);
+    size_t root = gc.stack.size();
+    guard.push(nullptr); //尾调用的被调函数，同 FunctionBody::exec
+    for(;;){
+        if(!body->closure)body->closure = body->close();
+        body->closure(env, controller);
+        if(!controller.tailFn)break;
+        gc.stack[root] = controller.tailFn;
+        body = controller.tailFn->body;
+        env = controller.tailScope(vm, depth);
+    }
+    return controller.retval ? controller.retval : Jua_Null::getInst();
+}
@@ -0,0 +1,395 @@
+#include "jua-syntax.h"
+#include "jua-jit.h"
+
+Proto::~Proto(){
+    delete jit;
+}
+Proto* Interpreter::compile(FunctionBody* body, DeclarationList* params){
+    if(body->proto)return body->proto;
+    auto proto = new Proto;
+    proto->simpleParams = true;
+    if(params){
+        for(auto item: params->decItems){
+            auto var = dynamic_cast<Varname*>(item->body);
+            if(!var || item->initval){
+                proto->simpleParams = false;
+                break;
+            }
+            proto->params.push_back(var);
+        }
+    }
+    Compiler c(proto);
+    c.statements(body); //函数体的作用域在调用时创建
+    Reg r = c.reg();
+    c.emit(Op::LOADK, r, c.constant(Jua_Null::getInst()));
+    c.emit(Op::RET, r);
+    return body->proto = proto;
+}
+
+Reg Compiler::reg(){
+    Reg r = top++;
+    if(top > proto->nregs)proto->nregs = top;
+    return r;
+}
+size_t Compiler::emit(Op op, uint32_t a, uint32_t b, uint32_t c){
+    proto->code.push_back({.op = op, .a = a, .b = b, .c = c});
+    return proto->code.size() - 1;
+}
+uint32_t Compiler::node(void* n){
+    proto->nodes.push_back(n);
+    return proto->nodes.size() - 1;
+}
+uint32_t Compiler::constant(Jua_Val val){
+    auto& consts = proto->consts;
+    for(size_t i = 0; i < consts.size(); i++){
+        if(consts[i].same(val))return i;
+    }
+    consts.push_back(val);
+    return consts.size() - 1;
+}
+uint32_t Compiler::atom(Atom name){
+    auto& atoms = proto->atoms;
+    for(size_t i = 0; i < atoms.size(); i++){
+        if(atoms[i] == name)return i;
+    }
+    atoms.push_back(name);
+    return atoms.size() - 1;
+}
+void Compiler::patch(size_t jump, size_t target){
+    auto& instr = proto->code[jump];
+    switch(instr.op){
+        case Op::JMP: instr.a = target; break;
+        case Op::JEQ: instr.c = target; break;
+        default: instr.b = target; //JMPF、JMPT、NEXT
+    }
+}
+void Compiler::statements(Block* block){
+    for(auto stmt: block->statements){
+        emit(Op::CHECK); //与 Block::exec 相同，每条语句前都是安全点
+        stmt->compile(*this);
+    }
+}
+void Compiler::block(Block* block, Reg prev){
+    if(!block->hasScope){
+        statements(block);
+        return;
+    }
+    emit(Op::ENTER, node(block), prev);
+    scopes++;
+    statements(block);
+    emit(Op::LEAVE, 1);
+    scopes--;
+}
+void Compiler::exitLoop(bool isBreak){
+    //先离开循环体内的作用域，再跳转
+    auto& loop = loops.back();
+    if(scopes > loop.scopes)emit(Op::LEAVE, scopes - loop.scopes);
+    if(isBreak)loop.breaks.push_back(emit(Op::JMP));
+    else emit(Op::JMP, loop.start);
+}
+
+void Expr::compile(Compiler& c, Reg dst){
+    c.emit(Op::EVAL, dst, c.node(this));
+}
+void LeftValue::compileAssign(Compiler& c, Reg src){
+    c.emit(Op::ASSIGN, src, c.node(this));
+}
+void Declarable::compileDeclare(Compiler& c, Reg src){
+    c.emit(Op::DECLARE, src, c.node(this));
+}
+
+void LiteralNum::compile(Compiler& c, Reg dst){
+    c.emit(Op::LOADK, dst, c.constant(Jua_Num(value)));
+}
+void LiteralStr::compile(Compiler& c, Reg dst){
+    c.emit(Op::LOADSTR, dst, c.node(this));
+}
+void Template::compile(Compiler& c, Reg dst){
+    Reg base = c.top;
+    for(auto expr: exprList){
+        Reg r = c.reg();
+        expr->compile(c, r);
+        c.emit(Op::TOSTR, r);
+    }
+    c.emit(Op::TEMPLATE, dst, base, c.node(this));
+    c.top = base;
+}
+void Keyword::compile(Compiler& c, Reg dst){
+    if(type == 'l')c.emit(Op::LOADENV, dst);
+    else c.emit(Op::LOADK, dst, c.constant(calc(nullptr)));
+}
+void Varname::compile(Compiler& c, Reg dst){
+    c.emit(Op::GETVAR, dst, c.node(this));
+}
+void Varname::compileAssign(Compiler& c, Reg src){
+    c.emit(Op::SETVAR, src, c.node(this));
+}
+void Varname::compileDeclare(Compiler& c, Reg src){
+    c.emit(Op::DECLVAR, src, c.node(this));
+}
+void OptionalPropRef::compile(Compiler& c, Reg dst){
+    expr->compile(c, dst);
+    c.emit(Op::GETOPT, dst, dst, c.node(this));
+}
+void PropRef::compile(Compiler& c, Reg dst){
+    expr->compile(c, dst);
+    c.emit(Op::GETPROP, dst, dst, c.node(this));
+}
+void PropRef::compileAssign(Compiler& c, Reg src){
+    Reg obj = c.reg();
+    expr->compile(c, obj);
+    c.emit(Op::SETPROP, obj, src, c.node(this));
+    c.top = obj;
+}
+void MethWrapper::compile(Compiler& c, Reg dst){
+    expr->compile(c, dst);
+    c.emit(Op::METHOD, dst, dst, c.node(this));
+}
+void UnitaryExpr::compile(Compiler& c, Reg dst){
+    pri->compile(c, dst);
+    c.emit(oper == UniOper::unm ? Op::UNM : Op::NOT, dst, dst);
+}
+static Op binaryOp(BinOper oper){
+    return Op(int(Op::POW) + int(oper));
+}
+void BinaryExpr::compile(Compiler& c, Reg dst){
+    left->compile(c, dst);
+    if(oper == BinOper::and_ || oper == BinOper::or_){
+        auto jump = c.emit(oper == BinOper::and_ ? Op::JMPF : Op::JMPT, dst);
+        right->compile(c, dst);
+        c.patch(jump, c.here());
+        return;
+    }
+    Reg r = c.reg();
+    right->compile(c, r);
+    c.emit(binaryOp(oper), dst, dst, r);
+    c.top = r;
+}
+void Assignment::compile(Compiler& c, Reg dst){
+    right->compile(c, dst);
+    left->compileAssign(c, dst);
+}
+void OperAssignment::compile(Compiler& c, Reg dst){
+    //与 calc 相同，左值的子表达式在读取和赋值时各求值一次
+    left->compile(c, dst);
+    Reg r = c.reg();
+    right->compile(c, r);
+    c.emit(binaryOp(type), dst, dst, r);
+    c.top = r;
+    assignee->compileAssign(c, dst);
+}
+void Subscription::compile(Compiler& c, Reg dst){
+    expr->compile(c, dst);
+    Reg key = c.reg();
+    keyExpr->compile(c, key);
+    c.emit(Op::GETITEM, dst, dst, key);
+    c.top = key;
+}
+void Subscription::compileAssign(Compiler& c, Reg src){
+    Reg obj = c.reg();
+    expr->compile(c, obj);
+    Reg key = c.reg();
+    keyExpr->compile(c, key);
+    c.emit(Op::SETITEM, obj, key, src);
+    c.top = obj;
+}
+void TernaryExpr::compile(Compiler& c, Reg dst){
+    condExpr->compile(c, dst);
+    auto toElse = c.emit(Op::JMPF, dst);
+    trueExpr->compile(c, dst);
+    auto toEnd = c.emit(Op::JMP);
+    c.patch(toElse, c.here());
+    falseExpr->compile(c, dst);
+    c.patch(toEnd, c.here());
+}
+void Call::compile(Compiler& c, Reg dst){
+    //被调函数、备用槽位和参数放在连续的寄存器中
+    Reg fn = c.reg();
+    calee->compile(c, fn);
+    c.reg();
+    uint32_t argc = 0;
+    if(args){
+        for(auto expr: args->exprs){
+            expr->compile(c, c.reg());
+            argc++;
+        }
+    }
+    c.emit(Op::CALL, dst, fn, argc);
+    c.top = fn;
+}
+void MethodCall::compile(Compiler& c, Reg dst){
+    //接收者作为第一个参数，放在备用槽位之后
+    Reg fn = c.reg();
+    c.reg();
+    Reg self = c.reg();
+    meth->expr->compile(c, self);
+    c.emit(Op::GETMETH, fn, self, c.node(meth));
+    uint32_t argc = 1;
+    if(args){
+        for(auto expr: args->exprs){
+            expr->compile(c, c.reg());
+            argc++;
+        }
+    }
+    c.emit(Op::CALL, dst, fn, argc);
+    c.top = fn;
+}
+void ObjExpr::compile(Compiler& c, Reg dst){
+    c.emit(Op::NEWOBJ, dst);
+    for(size_t i = 0; i < entries.size(); i++){
+        auto [keyExpr, valExpr] = entries[i];
+        if(keys[i]){
+            Reg val = c.reg();
+            valExpr->compile(c, val);
+            c.emit(Op::SETATOM, dst, val, c.atom(keys[i]));
+            c.top = val;
+            continue;
+        }
+        Reg key = c.reg();
+        keyExpr->compile(c, key);
+        Reg val = c.reg();
+        valExpr->compile(c, val);
+        c.emit(Op::SETKEY, dst, key, val);
+        c.top = key;
+    }
+}
+void ArrayExpr::compile(Compiler& c, Reg dst){
+    Reg base = c.top;
+    uint32_t count = 0;
+    if(list){
+        for(auto expr: list->exprs){
+            expr->compile(c, c.reg());
+            count++;
+        }
+    }
+    c.emit(Op::NEWARRAY, dst, base, count);
+    c.top = base;
+}
+void FunExpr::compile(Compiler& c, Reg dst){
+    c.emit(Op::CLOSURE, dst, c.node(this));
+}
+
+void ExprStatement::compile(Compiler& c){
+    Reg r = c.reg();
+    expr->compile(c, r);
+    c.top = r;
+}
+void Declaration::compile(Compiler& c){
+    for(auto item: list->decItems){
+        Reg r = c.reg();
+        item->initval->compile(c, r);
+        item->body->compileDeclare(c, r);
+        c.top = r;
+    }
+}
+void Return::compile(Compiler& c){
+    Reg r = c.reg();
+    if(expr)expr->compile(c, r);
+    else c.emit(Op::LOADK, r, c.constant(Jua_Null::getInst()));
+    if(tail)c.proto->code.back().op = Op::TAILCALL; //Call::compile 最后生成的是 CALL
+    c.emit(Op::RET, r);
+    c.top = r;
+}
+void Break::compile(Compiler& c){
+    c.exitLoop(true);
+}
+void Continue::compile(Compiler& c){
+    c.exitLoop(false);
+}
+void IfStmt::compile(Compiler& c){
+    if(cond == Keyword::t){
+        //条件为常量的 if 已由 Optimizer 化简为只剩 body
+        c.block(body);
+        return;
+    }
+    Reg r = c.reg();
+    cond->compile(c, r);
+    c.top = r;
+    auto toElse = c.emit(Op::JMPF, r);
+    c.block(body);
+    if(elseBody){
+        auto toEnd = c.emit(Op::JMP);
+        c.patch(toElse, c.here());
+        c.block(elseBody);
+        c.patch(toEnd, c.here());
+    }else{
+        c.patch(toElse, c.here());
+    }
+}
+void SwitchStmt::compile(Compiler& c){
+    Reg val = c.reg();
+    expr->compile(c, val);
+    std::vector<std::vector<size_t>> hits(cases.size());
+    size_t toDefault = 0;
+    if(jumpTable){
+        //SWITCH 之后依次是跳到 default 和各分支体的 JMP
+        c.emit(Op::SWITCH, val, c.node(this));
+        toDefault = c.emit(Op::JMP);
+        for(size_t i = 0; i < cases.size(); i++){
+            hits[i].push_back(c.emit(Op::JMP));
+        }
+    }else{
+        //依次比较各分支的条件，命中时跳转到分支体
+        for(size_t i = 0; i < cases.size(); i++){
+            for(auto condExpr: cases[i]->cond->exprs){
+                Reg r = c.reg();
+                condExpr->compile(c, r);
+                hits[i].push_back(c.emit(Op::JEQ, r, val));
+                c.top = r;
+            }
+        }
+    }
+    c.top = val;
+    if(jumpTable)c.patch(toDefault, c.here());
+    if(defaultBody)c.block(defaultBody);
+    std::vector<size_t> ends{c.emit(Op::JMP)};
+    for(size_t i = 0; i < cases.size(); i++){
+        for(auto jump: hits[i]){
+            c.patch(jump, c.here());
+        }
+        c.block(cases[i]->body);
+        ends.push_back(c.emit(Op::JMP));
+    }
+    for(auto jump: ends){
+        c.patch(jump, c.here());
+    }
+}
+void WhileStmt::compile(Compiler& c){
+    Reg scope = c.reg(); //上一次迭代的作用域，进入循环时清空
+    c.emit(Op::LOADK, scope, c.constant(nullptr));
+    size_t start = c.here();
+    Reg r = c.reg();
+    cond->compile(c, r);
+    c.top = r;
+    auto toEnd = c.emit(Op::JMPF, r);
+    c.loops.push_back({start, c.scopes});
+    c.block(body, scope);
+    c.emit(Op::JMP, start);
+    c.patch(toEnd, c.here());
+    for(auto jump: c.loops.back().breaks){
+        c.patch(jump, c.here());
+    }
+    c.loops.pop_back();
+    c.top = scope;
+}
+void ForStmt::compile(Compiler& c){
+    //循环变量声明在外层作用域中；迭代器在 break 时由 ITERPOP 结束，正常结束时由 NEXT 结束
+    Reg scope = c.reg(); //上一次迭代的作用域，进入循环时清空
+    c.emit(Op::LOADK, scope, c.constant(nullptr));
+    Reg r = c.reg();
+    for(int k = 0; k < 4; k++)c.reg(); //计数循环的状态，见 Op::ITER
+    iterable->compile(c, r);
+    c.emit(Op::ITER, r);
+    size_t start = c.emit(Op::NEXT, r);
+    declarable->compileDeclare(c, r);
+    c.loops.push_back({start, c.scopes});
+    c.block(body, scope);
+    c.emit(Op::JMP, start);
+    for(auto jump: c.loops.back().breaks){
+        c.patch(jump, c.here());
+    }
+    c.loops.pop_back();
+    c.emit(Op::ITERPOP, r);
+    c.patch(start, c.here());
+    c.top = scope;
+}
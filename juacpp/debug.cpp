@@ -10,13 +10,13 @@ void d_log(const string& msg){
 void d_log(char c){
     d_log(string(1, c));
 }
-void d_log(Jua_Val* val){
-    auto ad = std::format("address: {:p}", (void*)val);
+void d_log(Jua_Val val){
+    auto ad = std::format("address: {:p}", (void*)val.ref());
     d_log(ad);
-    d_log(val->safeToString());
+    d_log(val.safeToString());
 }
-void d_log(string msg, Jua_Val* val){
-    msg.append(val->safeToString());
+void d_log(string msg, Jua_Val val){
+    msg.append(val.safeToString());
     d_log(msg);
 }
 void d_log(string label, int num){
@@ -0,0 +1,380 @@
+#include "jua-vm.h"
+#include <chrono>
+#include <algorithm>
+
+struct JuaPool{
+    //堆值的小对象分配器：按 GRAIN 字节分级，优先复用空闲链表，否则在当前块中顺序分配
+    //operator new 无法得知所属的 vm，因此每个线程一个；jua 虚拟机总是单线程运行，值在分配它的线程中释放
+    //完整回收后归还没有存活值的块（见 trim），线程结束时归还所有没有存活值的块；vm 比线程存在得久时，其值所在的块不归还
+    static constexpr size_t GRAIN = 16;
+    static constexpr size_t MAX_SIZE = 256;
+    static constexpr size_t BLOCK_SIZE = 64 << 10;
+    struct FreeNode{ FreeNode* next; };
+    struct Block{
+        char* begin;
+        size_t used; //已顺序分配的字节数
+    };
+    FreeNode* freeLists[MAX_SIZE / GRAIN] = {};
+    std::vector<Block> blocks; //最后一个是当前块
+    char* cursor = nullptr;
+    char* limit = nullptr;
+    void* alloc(size_t size){
+        if(size > MAX_SIZE)return ::operator new(size);
+        size_t cls = (size - 1) / GRAIN;
+        if(auto node = freeLists[cls]){
+            freeLists[cls] = node->next;
+            return node;
+        }
+        size = (cls + 1) * GRAIN;
+        if(cursor + size > limit){
+            if(!blocks.empty())blocks.back().used = cursor - blocks.back().begin;
+            cursor = static_cast<char*>(::operator new(BLOCK_SIZE));
+            limit = cursor + BLOCK_SIZE;
+            blocks.push_back({cursor, 0});
+        }
+        void* p = cursor;
+        cursor += size;
+        return p;
+    }
+    void free(void* p, size_t size){
+        if(size > MAX_SIZE)return ::operator delete(p);
+        size_t cls = (size - 1) / GRAIN;
+        auto node = static_cast<FreeNode*>(p);
+        node->next = freeLists[cls];
+        freeLists[cls] = node;
+    }
+    void release(size_t n){
+        //归还前 n 个块中没有存活值的块，即空闲链表中位于块内的节点的总大小等于已分配的字节数
+        //块按地址排序后二分查找节点所在的块，不在其中的节点（当前块或其他线程的块）不影响结果
+        std::sort(blocks.begin(), blocks.begin() + n, [](const Block& a, const Block& b){ return a.begin < b.begin; });
+        auto find = [&](void* p) -> Block* {
+            auto it = std::upper_bound(blocks.begin(), blocks.begin() + n, static_cast<char*>(p), [](char* p, const Block& b){ return p < b.begin; });
+            if(it == blocks.begin() || static_cast<char*>(p) >= (it - 1)->begin + BLOCK_SIZE)return nullptr;
+            return &*(it - 1);
+        };
+        std::vector<size_t> freeBytes(n);
+        for(size_t cls = 0; cls < MAX_SIZE / GRAIN; cls++){
+            for(auto node = freeLists[cls]; node; node = node->next){
+                if(auto block = find(node))freeBytes[block - blocks.data()] += (cls + 1) * GRAIN;
+            }
+        }
+        auto idle = [&](Block* block){ return block && freeBytes[block - blocks.data()] == block->used; };
+        if(std::none_of(blocks.begin(), blocks.begin() + n, [&](Block& b){ return idle(&b); }))return;
+        for(auto& list: freeLists){
+            for(auto link = &list; *link;){
+                if(idle(find(*link)))*link = (*link)->next;
+                else link = &(*link)->next;
+            }
+        }
+        size_t kept = 0;
+        for(size_t i = 0; i < blocks.size(); i++){
+            if(i < n && idle(&blocks[i]))::operator delete(blocks[i].begin);
+            else blocks[kept++] = blocks[i];
+        }
+        blocks.resize(kept);
+    }
+    void trim(){
+        //当前块除外
+        if(blocks.size() > 1)release(blocks.size() - 1);
+    }
+    ~JuaPool(){
+        if(blocks.empty())return;
+        blocks.back().used = cursor - blocks.back().begin;
+        release(blocks.size());
+    }
+};
+static thread_local JuaPool pool;
+
+void* Jua_Ref::operator new(size_t size){
+    return pool.alloc(size);
+}
+void Jua_Ref::operator delete(void* p, size_t size){
+    pool.free(p, size);
+}
+
+Jua_Ref::Jua_Ref(JuaVM* vm_, Jua_Val::JuaType t, Jua_Obj* p): vm(vm_), type(t), proto(p){
+    if(vm)vm->gc.link(this);
+}
+void Jua_Ref::trace(JuaGC& gc){
+    gc.mark(proto);
+}
+void Jua_Obj::trace(JuaGC& gc){
+    gc.markShape(shape);
+    gc.mark(proto);
+    for(auto val: slots){
+        gc.mark(val);
+    }
+}
+size_t Jua_Obj::propBytes(){
+    //共享的 Shape 不计入
+    size_t bytes = slots.capacity() * sizeof(Jua_Val);
+    if(shape->dictionary)bytes += sizeof(Shape) + shape->bytes();
+    return bytes;
+}
+void Jua_NativeFunc::trace(JuaGC& gc){
+    gc.mark(proto);
+    for(auto val: bound){
+        gc.mark(val);
+    }
+}
+void Jua_Array::trace(JuaGC& gc){
+    Jua_Obj::trace(gc);
+    for(auto val: items){
+        gc.mark(val);
+    }
+}
+
+JuaIterator::JuaIterator(JuaGC* g): gc(g){
+    if(gc)gc->iterators.push_back(this);
+}
+JuaIterator::~JuaIterator(){
+    if(!gc)return;
+    auto& list = gc->iterators;
+    //迭代器的生命周期基本是嵌套的，从末尾查找
+    for(size_t i = list.size(); i > 0; i--){
+        if(list[i-1] == this){
+            list.erase(list.begin() + (i-1));
+            return;
+        }
+    }
+}
+
+JuaGC::~JuaGC(){
+    for(auto list: {young, old, unswept[0], unswept[1]}){
+        while(list){
+            auto next = list->gcNext;
+            delete list;
+            list = next;
+        }
+    }
+}
+void JuaGC::account(){
+    size_t bytes = 0;
+    for(auto r = young; r != accounted; r = r->gcNext){
+        bytes += r->gcSize();
+    }
+    accounted = young;
+    youngBytes += bytes;
+    stepDebt += bytes;
+}
+void JuaGC::setMode(Mode m){
+    if(m == mode)return;
+    finishCycle();
+    mode = m;
+    collect(); //按新模式设置 old 标志，清空记忆集
+}
+size_t JuaGC::collectYoung(){
+    auto start = std::chrono::steady_clock::now();
+    minor = true;
+    markRoots();
+    for(auto r: remembered){
+        if(r->old)r->trace(*this);
+        else mark(r);
+    }
+    drain();
+    minor = false;
+    forget();
+    size_t promoted = 0;
+    size_t freed = sweep(young, promoted);
+    youngBytes = 0;
+    oldBytes += promoted;
+    accounted = nullptr;
+    double time = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    youngCollections++;
+    youngPauseTotal += time;
+    youngPauseMax = std::max(youngPauseMax, time);
+    lastFreed = freed;
+    totalFreed += freed;
+    if(oldBytes >= threshold)freed += collect();
+    return freed;
+}
+size_t JuaGC::collect(){
+    finishCycle();
+    auto start = std::chrono::steady_clock::now();
+    markRoots();
+    drain();
+    forget();
+    size_t live = 0;
+    size_t freed = sweep(old, live);
+    freed += sweep(young, live);
+    sweepShapes();
+    oldBytes = live;
+    youngBytes = 0;
+    accounted = nullptr;
+    threshold = std::max(live / 100 * pause, minThreshold);
+    double time = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    collections++;
+    pauseMax = std::max(pauseMax, time);
+    lastFreed = freed;
+    totalFreed += freed;
+    return freed;
+}
+void JuaGC::markRoots(){
+    mark(vm->_G);
+    for(auto& [name, val]: vm->modules){
+        mark(val);
+    }
+    for(Jua_Ref* proto: {
+        vm->classProto, vm->StringProto, vm->NumberProto, vm->BooleanProto,
+        vm->FunctionProto, vm->ObjectProto, vm->ArrayProto, vm->BufferProto,
+        vm->RangeProto, vm->ErrorProto, vm->TryResProto
+    }){
+        mark(proto);
+    }
+    mark(vm->obj_new);
+    mark(vm->obj_hasOwn);
+    mark(vm->obj_next);
+    mark(vm->fn_try);
+    mark(vm->fn_throw);
+    for(auto scope: vm->frameScopes){
+        mark(scope);
+    }
+    for(auto str: vm->literals){
+        mark(str);
+    }
+    for(auto val: stack){
+        auto r = val.ref();
+        //求值栈上的值可能正在构造中（如 ArrayExpr），其引用尚未经过写屏障
+        //因此新生代回收时的老值、原子阶段时已标记的值需要重新 trace
+        if(r && (minor ? r->old : r->marked))r->trace(*this);
+        else mark(val);
+    }
+    for(auto it: iterators){
+        it->trace(*this);
+    }
+    for(auto val: registers){
+        mark(val);
+    }
+}
+void JuaGC::drain(){
+    while(!gray.empty()){
+        auto r = gray.back();
+        gray.pop_back();
+        r->trace(*this);
+    }
+}
+void JuaGC::forget(){
+    for(auto r: remembered){
+        r->remembered = false;
+    }
+    remembered.clear();
+}
+void JuaGC::sweepOne(Jua_Ref* r, size_t& live, size_t& freed){
+    //释放未标记的值；存活的值清除标记，转入老年代（增量模式中 old 标志无意义，保持为 false）
+    if(r->marked){
+        r->marked = false;
+        r->old = mode == Generational;
+        live += r->gcSize();
+        r->gcNext = old;
+        old = r;
+    }else{
+        freed += r->gcSize();
+        delete r;
+    }
+}
+size_t JuaGC::sweep(Jua_Ref*& list, size_t& live){
+    size_t freed = 0;
+    auto r = list;
+    list = nullptr;
+    while(r){
+        auto next = r->gcNext;
+        sweepOne(r, live, freed);
+        r = next;
+    }
+    return freed;
+}
+
+void JuaGC::step(){
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = [&start]{
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    };
+    stepDebt = 0;
+    if(phase == Idle){
+        phase = Marking;
+        markRoots(); //根只是变为灰色，原子阶段会重新扫描
+    }
+    size_t work = 0, n = 0;
+    auto more = [&]{
+        //每处理 64 个值检查一次时间
+        return work < sliceBudget && (++n % 64 || elapsed() < maxPause);
+    };
+    if(phase == Marking){
+        while(!gray.empty() && more()){
+            auto r = gray.back();
+            gray.pop_back();
+            r->trace(*this);
+            work += r->gcSize();
+        }
+        if(gray.empty())atomic();
+    }else{
+        for(auto& list: unswept){
+            while(list && more()){
+                auto r = list;
+                list = r->gcNext;
+                work += r->gcSize();
+                sweepOne(r, sweptLive, sweptFreed);
+            }
+        }
+        if(!unswept[0] && !unswept[1]){
+            //回收周期结束
+            phase = Idle;
+            sweepShapes();
+            oldBytes = sweptLive;
+            threshold = std::max(sweptLive / 100 * pause, minThreshold);
+            collections++;
+            lastFreed = sweptFreed;
+            totalFreed += sweptFreed;
+        }
+    }
+    steps++;
+    pauseMax = std::max(pauseMax, elapsed());
+}
+void JuaGC::atomic(){
+    //标记结束：重新扫描根并标记剩余的灰色值，然后开始清除
+    markRoots();
+    drain();
+    unswept[0] = old;
+    unswept[1] = young;
+    old = young = nullptr;
+    accounted = nullptr;
+    youngBytes = 0;
+    sweptLive = sweptFreed = 0;
+    phase = Sweeping;
+}
+void JuaGC::markShape(Shape* shape){
+    //新生代回收不清除 Shape，无需标记
+    //共享 Shape 的键在 sweepShapes 中经由转移树标记，字典模式的 Shape 只属于该对象，在此标记
+    if(minor)return;
+    shape->marked = true;
+    if(shape->dictionary){
+        for(auto key: shape->keys)vm->atoms.mark(key);
+    }
+}
+void JuaGC::atomBarrier(Atom atom){
+    if(phase != Idle)vm->atoms.mark(atom);
+}
+void JuaGC::sweepShapes(){
+    //须在清除完所有值之后：被释放的对象析构时仍会访问它的 Shape
+    //存活对象的 Shape 已在 trace 时标记，增量回收中途才被使用的由 shapeBarrier 标记
+    //内联缓存和机器码中以地址比较 Shape，释放的地址可能被新的 Shape 复用，因此使所有缓存失效
+    if(vm->rootShape.sweep(vm->atoms))vm->cacheEpoch++;
+    //此时存活的 Shape 中的动态原子都已标记，其余的不再被任何属性使用
+    vm->atoms.sweep();
+    pool.trim(); //完整回收结束，归还没有存活值的块
+}
+void JuaGC::finishCycle(){
+    //不分片地完成正在进行的增量回收周期
+    if(phase == Marking)atomic();
+    if(phase == Sweeping){
+        for(auto& list: unswept){
+            sweptFreed += sweep(list, sweptLive);
+        }
+        phase = Idle;
+        sweepShapes();
+        oldBytes = sweptLive;
+        lastFreed = sweptFreed;
+        totalFreed += sweptFreed;
+        collections++;
+    }
+}
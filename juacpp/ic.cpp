@@ -0,0 +1,99 @@
+#include "jua-ic.h"
+#include "jua-vm.h"
+
+PropCache::~PropCache(){
+    if(vm)std::erase(vm->propCaches, this);
+}
+Jua_Val PropCache::get(JuaVM* v, Jua_Val recv){
+    auto r = recv.ref();
+    Shape* shape = nullptr;
+    Jua_Obj* proto;
+    if(r){
+        if(r->type == Jua_Val::Obj)shape = static_cast<Jua_Obj*>(r)->shape;
+        proto = r->proto;
+    }else if(recv.isNum()){
+        proto = v->NumberProto;
+    }else{
+        return recv.getProp(v, key);
+    }
+    if(epoch == v->cacheEpoch){
+        for(size_t i = 0; i < count; i++){
+            auto& e = entries[i];
+            if(e.shape != shape || e.proto != proto)continue;
+            hits++;
+            if(e.slot < 0)return nullptr;
+            if(e.holder)return e.holder->slots[e.slot];
+            return static_cast<Jua_Obj*>(r)->slots[e.slot];
+        }
+    }else{
+        if(!vm){
+            vm = v;
+            v->propCaches.push_back(this);
+        }
+        epoch = v->cacheEpoch;
+        count = 0;
+    }
+    misses++;
+    auto val = recv.getProp(v, key);
+    if(count == MAX_ENTRIES){
+        megamorphic = true;
+        return val;
+    }
+    Entry e{shape, proto, nullptr, -1};
+    if(r ? resolve(r, key, e.holder, e.slot, true) : resolve(proto, key, e.holder, e.slot, false)){
+        entries[count++] = e;
+    }
+    return val;
+}
+Jua_Val PropCache::peek(JuaVM* v, Jua_Val recv){
+    auto r = recv.ref();
+    if(!r || epoch != v->cacheEpoch)return nullptr;
+    Shape* shape = r->type == Jua_Val::Obj ? static_cast<Jua_Obj*>(r)->shape : nullptr;
+    for(size_t i = 0; i < count; i++){
+        auto& e = entries[i];
+        if(e.shape != shape || e.proto != r->proto || e.slot < 0)continue;
+        hits++;
+        return e.holder ? e.holder->slots[e.slot] : static_cast<Jua_Obj*>(r)->slots[e.slot];
+    }
+    return nullptr;
+}
+bool PropCache::resolve(Jua_Ref* r, Atom name, Jua_Obj*& holder, int& slot, bool receiver){
+    //按 Jua_Ref::getProp 的规则查找，返回查找路径能否缓存
+    Jua_Obj* obj = nullptr;
+    if(r->type == Jua_Val::Obj){
+        obj = static_cast<Jua_Obj*>(r);
+        if(obj->isType(Scope::type_id))return false;
+        if(receiver && obj->shape->dictionary)return false;
+        if(!receiver)obj->watched = true;
+        int i = obj->shape->find(name);
+        if(i >= 0){
+            holder = receiver ? nullptr : obj;
+            slot = i;
+            return true;
+        }
+    }
+    auto proto = r->proto;
+    if(!proto){
+        slot = -1;
+        return true;
+    }
+    //原型是类时，从 super 继承（见 Jua_Ref::inheritProp）
+    Jua_Obj* classHolder;
+    int classSlot;
+    if(!resolve(proto, atoms::_class, classHolder, classSlot, false))return false;
+    if(classSlot < 0 || !classHolder->slots[classSlot].same(Jua_Bool::getInst(true))){
+        return resolve(proto, name, holder, slot, false);
+    }
+    int i = obj ? obj->shape->find(atoms::super) : -1;
+    //接收者自身的 super：Shape 相同的接收者可能继承自不同的类，缓存键无法区分
+    if(i >= 0 && receiver)return false;
+    if(i < 0){
+        slot = -1;
+        return true;
+    }
+    auto super = obj->slots[i];
+    if(auto s = super.ref())return resolve(s, name, holder, slot, false);
+    if(super.isNum())return resolve(vm->NumberProto, name, holder, slot, false);
+    slot = -1;
+    return true;
+}
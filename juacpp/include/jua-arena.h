@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+struct Arena{
+    //按块分配的内存池：对象依次放在当前块中，不单独释放
+    //Arena 析构时按构造的逆序调用对象的析构函数，再整块释放内存
+    //块的大小从 MIN_CHUNK 开始倍增到 MAX_CHUNK，短小的脚本（如 REPL 的一行）只占用很少的内存
+    static constexpr size_t MIN_CHUNK = 1 << 10;
+    static constexpr size_t MAX_CHUNK = 64 << 10;
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    ~Arena(){
+        for(auto it = dtors.rbegin(); it != dtors.rend(); it++){
+            it->destroy(it->obj);
+        }
+        for(auto chunk: chunks){
+            ::operator delete(chunk);
+        }
+    }
+    template<class T, class... Args>
+    T* make(Args&&... args){
+        //构造函数抛出时内存留在块中，不登记析构
+        T* obj = new(alloc(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if constexpr(!std::is_trivially_destructible_v<T>)
+            dtors.push_back({obj, [](void* p){ static_cast<T*>(p)->~T(); }});
+        return obj;
+    }
+    void* alloc(size_t size, size_t align){
+        size_t offset = (align - reinterpret_cast<size_t>(cursor) % align) % align;
+        if(cursor && cursor + offset + size <= limit){
+            cursor += offset;
+        }else if(size > MAX_CHUNK / 4){
+            //大对象单独占一块，不影响当前块的剩余空间
+            chunks.push_back(static_cast<char*>(::operator new(size)));
+            return chunks.back();
+        }else{
+            while(chunkSize < size)chunkSize *= 2;
+            chunks.push_back(static_cast<char*>(::operator new(chunkSize)));
+            cursor = chunks.back();
+            limit = cursor + chunkSize;
+            if(chunkSize < MAX_CHUNK)chunkSize *= 2;
+        }
+        void* p = cursor;
+        cursor += size;
+        return p;
+    }
+
+    private:
+    struct Dtor{
+        void* obj;
+        void (*destroy)(void*);
+    };
+    std::vector<char*> chunks;
+    char* cursor = nullptr;
+    char* limit = nullptr;
+    size_t chunkSize = MIN_CHUNK; //下一块的大小
+    std::vector<Dtor> dtors;
+};
@@ -0,0 +1,81 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <functional>
+#include <unordered_map>
+
+struct JuaVM;
+
+struct Atom{
+    //驻留的字符串：内容相同的 Atom 指向原子表中的同一个条目，比较只需比较指针，哈希值在驻留时算好
+    //用于属性名和变量名；语法树中的名字在解析时驻留（见 SyntaxTree::intern），内置的名字见 atoms
+    //条目的生存期：由构造函数驻留的条目是永久的，只用于 C++ 代码中内置和初始化时设置的名字；
+    //其他条目由持有者计数（hold、drop），持有者是语法树和 vm 的 DynamicAtoms，计数减到 0 时释放
+    //运行时由字符串得到的属性名（下标、Object.set、JSON 的键等）用 dynamic 驻留；只读的查找用 find，不驻留
+    //线程：每个 vm 只能由一个线程使用（见 gc.cpp 中的 JuaPool），不同线程中的 vm 可以同时运行
+    //- 原子表为所有线程共享，同一字符串在进程中只有一个条目；每次查找、插入、计数和删除都持有原子表的锁
+    //- 永久的条目不会释放，得到的 Atom 可以在任何线程中使用；其他条目只在持有它的语法树或 vm 中使用
+    //- 语法树和 vm 的 DynamicAtoms 只由所属 vm 的线程访问，先查它们，不加锁
+    struct Entry{
+        std::string str;
+        size_t hash;
+        mutable size_t holders = 0; //只在持有原子表的锁时读写
+        mutable bool permanent = false; //同上
+    };
+    Atom(): entry(nullptr){} //空 Atom，仅用于表示“没有”
+    explicit Atom(std::string_view); //查找或加入原子表，结果是永久的
+    explicit Atom(const std::string& s): Atom(std::string_view(s)){}
+    explicit Atom(const char* s): Atom(std::string_view(s)){}
+    template<size_t N>
+    Atom(const char (&s)[N]): Atom(std::string_view(s, N - 1)){} //字符串字面量，即 C++ 代码中内置的名字
+    static Atom hold(std::string_view); //查找或加入原子表，并持有条目一次
+    static void retain(Atom); //再持有一次
+    static void drop(Atom); //释放一次持有；永久的条目不释放
+    static Atom find(JuaVM*, std::string_view); //只查找；返回空 Atom 时，vm 中没有任何属性或变量以该字符串为名
+    static Atom dynamic(JuaVM*, std::string_view); //查找或驻留，由 vm 持有，用于可能成为属性名的字符串
+    const std::string& str() const { return entry->str; }
+    size_t hash() const { return entry->hash; }
+    explicit operator bool() const { return entry; }
+    bool operator==(const Atom& a) const { return entry == a.entry; }
+
+    private:
+    const Entry* entry;
+    Atom(const Entry* e): entry(e){}
+};
+struct DynamicAtoms{
+    //一个 vm 持有的原子：该 vm 的 Shape 中的键（见 Shape::transition、append）和经 dynamic 驻留的名字，各持有一次
+    //永久的条目也可能在其中（dynamic 的缓存）；标记记在这里而不是条目中，因为同一条目可能被多个 vm 持有
+    //完整回收时标记存活的 Shape 中的键，之后释放未标记的项，见 sweep；vm 析构时释放全部，因此须比所有值和 Shape 更晚析构
+    struct Item{
+        Atom atom;
+        bool marked = false; //本轮完整回收中仍被使用
+    };
+    std::unordered_map<std::string_view, Item> entries; //以条目中字符串的视图为键
+    DynamicAtoms() = default;
+    DynamicAtoms(const DynamicAtoms&) = delete;
+    ~DynamicAtoms();
+    Atom get(std::string_view str) const {
+        auto it = entries.find(str);
+        return it == entries.end() ? Atom() : it->second.atom;
+    }
+    void hold(Atom); //不在其中时加入
+    void mark(Atom atom){
+        auto it = entries.find(atom.str());
+        if(it != entries.end())it->second.marked = true;
+    }
+    size_t sweep(); //释放未标记的项，清除其余的标记；返回释放的数量，见 JuaGC::sweepShapes
+};
+template<>
+struct std::hash<Atom>{
+    size_t operator()(const Atom& a) const noexcept { return a.hash(); }
+};
+
+namespace atoms{
+    //解释器内部使用的名字，预先驻留；以 _ 开头的对应 __ 开头的元方法名
+    inline const Atom super{"super"}, _class{"__class"};
+    inline const Atom init{"init"}, next{"next"}, toString{"toString"};
+    inline const Atom hasItem{"hasItem"}, getItem{"getItem"}, setItem{"setItem"}, range{"range"};
+    inline const Atom _call{"__call"}, _unm{"__unm"}, _add{"__add"}, _sub{"__sub"}, _mul{"__mul"}, _div{"__div"};
+    inline const Atom _lt{"__lt"}, _le{"__le"}, _eq{"__eq"};
+    inline const Atom done{"done"}, key{"key"}, value{"value"};
+}
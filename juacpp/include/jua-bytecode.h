@@ -0,0 +1,120 @@
+#pragma once
+#include "jua-value.h"
+
+struct Scope;
+struct FunctionBody;
+struct DeclarationList;
+struct Varname;
+struct Jua_PFunc;
+struct JitCode;
+
+enum class Op: uint8_t{
+    //寄存器编号相对于当前帧的寄存器窗口，r0 为当前作用域；“节点”指 Proto::nodes 中的语法树节点
+    //跳转目标为指令下标
+    MOVE,       //a = b
+    LOADK,      //a = consts[b]
+    LOADSTR,    //a = 节点 b（LiteralStr）的字符串，每个 vm 只创建一次
+    LOADENV,    //a = 当前作用域
+    GETVAR,     //a = 变量 b（Varname）
+    SETVAR,     //变量 b = a
+    DECLVAR,    //在当前作用域声明变量 b，值为 a
+    DECLARE,    //节点 b（Declarable）->declare(a)
+    ASSIGN,     //节点 b（LeftValue）->assign(a)
+    EVAL,       //a = 节点 b（Expr）->calc，用于没有专门指令的表达式
+    GETPROP,    //a = b.节点 c（PropRef）
+    GETOPT,     //a = b?.节点 c（OptionalPropRef）
+    SETPROP,    //a.节点 c（PropRef） = b
+    METHOD,     //a = b:节点 c（MethWrapper）
+    GETMETH,    //a = b 的方法节点 c（MethWrapper），不绑定 b，用于 MethodCall
+    GETITEM,    //a = b[c]
+    SETITEM,    //a[b] = c
+    NEWOBJ,     //a = {}
+    SETKEY,     //a[b] = c，b 必须是字符串（对象字面量）
+    SETATOM,    //a.atoms[c] = b（对象字面量中的字符串键）
+    NEWARRAY,   //a = [b, b+1, ..., b+c-1]
+    TOSTR,      //对象 a 转为字符串（toString 可能执行脚本，需与求值交替进行）
+    TEMPLATE,   //a = 节点 c（Template）以 b, b+1, ... 填充
+    CLOSURE,    //a = 节点 b（FunExpr）的闭包
+    UNM,        //a = -b
+    NOT,        //a = !b
+    //二元运算 a = b op c，顺序与 BinOper 相同；AND、OR 仅用于 &&=、||=，短路运算编译为跳转
+    POW, ADD, SUB, MUL, DIV, MOD, RANGE, LT, LE, GT, GE, EQ, NE, IN, IS, AND, OR,
+    //自特化的二元运算（见 quickOperate）：ADD 至 NE 首次执行时按操作数类型原地改写为 _NN（数字）或 _SS（字符串）
+    //守卫失败时改回通用指令并标记 Instr::generic，不再特化
+    ADD_NN, SUB_NN, MUL_NN, DIV_NN, LT_NN, LE_NN, GT_NN, GE_NN, EQ_NN, NE_NN, ADD_SS,
+    JMP,        //跳转到 a
+    JMPF,       //a 为假时跳转到 b
+    JMPT,       //a 为真时跳转到 b
+    JEQ,        //a equals b 时跳转到 c（switch）
+    SWITCH,     //按节点 b（SwitchStmt）的跳转表查找 a，命中第 k 个分支时执行其后第 k+2 条指令，否则执行下一条；其后各条均为 JMP
+    ENTER,      //进入节点 a（Block）的作用域；b 不为 0 时，寄存器 b 存放循环上一次迭代的作用域，见 Block::enter
+    LEAVE,      //离开 a 层作用域
+    ITER,       //开始迭代 a；a 为 Range 时计数循环，a+1..a+4 存放起点、步长、长度和序号，否则 a+1 为空值，迭代器压入 iters
+    NEXT,       //a = 下一个值；迭代完成时结束迭代并跳转到 b
+    ITERPOP,    //结束从 a 开始的迭代（for 中的 break）
+    CHECK,      //安全点
+    CALL,       //a = b(b+2, ..., b+c+1)，b+1 为备用槽位，供原生函数在参数前插入 self（见 JuaArgs）
+    TAILCALL,   //同 CALL，用于 return f(...)：b 为脚本函数时在当前帧的位置执行（尾调用），不返回到下一条 RET
+    RET,        //返回 a
+};
+
+typedef uint32_t Reg; //寄存器编号
+
+struct Instr{
+    Op op;
+    bool generic = false; //二元运算已退化为通用指令
+    uint32_t a = 0;
+    uint32_t b = 0;
+    uint32_t c = 0;
+};
+
+struct Proto{
+    //编译后的函数体，与 vm 无关，由 FunctionBody 持有
+    std::vector<Instr> code;
+    std::vector<Jua_Val> consts; //数字、布尔值、null 和空值（用于清空寄存器），不含堆值
+    std::vector<void*> nodes; //指令引用的语法树节点，类型由操作码决定
+    std::vector<Atom> atoms; //指令引用的属性名
+    uint32_t nregs = 1; //寄存器窗口的大小
+    bool simpleParams = false; //参数都是没有默认值的变量名，调用时直接写入槽位
+    std::vector<Varname*> params;
+    uint32_t hotness = 0; //调用次数与循环回跳次数之和，达到 Interpreter::JIT_THRESHOLD 时编译为机器码
+    JitCode* jit = nullptr;
+    Proto() = default;
+    Proto(const Proto&) = delete;
+    ~Proto(); //释放机器码
+};
+
+struct Interpreter{
+    //字节码解释器：同一次 run 中脚本函数之间的调用不递归，而是在 frames 上压入新帧
+    //寄存器存放在值栈 gc.registers 中，作为垃圾回收的根；原生函数的参数直接指向调用者的寄存器
+    //原生函数调用脚本函数时（Jua_PFunc::call）递归进入新的 run
+    //错误仍以 C++ 异常传播，但能被本次 run 中的 try 帧捕获时不再展开 run，见 catchError
+    //vm->jit 为 true 时，热点函数编译为机器码（见 JitCode），解释器只执行机器码不支持的指令
+    static constexpr uint32_t JIT_THRESHOLD = 1000;
+    struct Frame{
+        Proto* proto;
+        const Instr* pc; //调用其他脚本函数时保存的下一条指令
+        size_t base; //寄存器窗口在 gc.registers 中的起点
+        size_t iterBase; //进入该帧时 iters 的大小
+        uint32_t ret; //返回值写入调用者的寄存器
+        size_t frameDepth; //离开时弹出到的帧作用域层数，见 JuaVM::frameScopes
+        bool guarded; //由 try(f) 进入：返回值和帧内未捕获的错误都转为 try 的结果
+    };
+    JuaVM* vm;
+    std::vector<Frame> frames;
+    std::vector<JuaIterator*> iters; //for 循环正在使用的迭代器
+    Interpreter(JuaVM* v): vm(v){}
+    Interpreter(const Interpreter&) = delete;
+    Jua_Val run(FunctionBody*, Scope* env); //在 env 中执行函数体，不会返回空值
+    Jua_Val call(Jua_PFunc*, JuaArgs args);
+    static Proto* compile(FunctionBody*, DeclarationList* params); //首次执行时编译，结果缓存在函数体中
+
+    private:
+    Jua_Val run(Proto*, Scope* env);
+    void enter(Proto*, Scope* env, uint32_t ret, size_t frameDepth, bool guarded = false);
+    void leave();
+    void tailCall(Jua_PFunc*, Proto* callee, JuaArgs args); //TAILCALL：用被调函数替换当前帧
+    Jua_Val execute(size_t entry);
+    Jua_Val dispatch(size_t entry);
+    bool catchError(JuaError*, size_t entry); //交给 entry 之上最近的 try 帧处理，没有时返回 false
+};
@@ -0,0 +1,177 @@
+#pragma once
+#include "jua-value.h"
+
+struct JuaGC{
+    //追踪式（标记-清除）垃圾回收器，有两种模式：
+    //分代模式：新生代回收（collectYoung）只标记新值：根、记忆集中的老值引用的新值；老值视为存活
+    //  值不会被移动（C++ 代码中到处是裸指针），晋升只是从 young 链表移到 old 链表
+    //  老年代增长过多时进行一次完整回收（collect），会暂停较长时间
+    //增量模式：三色标记，标记和清除都分成小片（step），穿插在分配之间进行；没有新生代回收
+    //  标记期间新分配的值直接标记为灰色；标记结束时重新扫描根（原子阶段），之后再分片清除
+    //只在安全点（语句之间，见 Block::exec）或显式调用时回收
+    //根：JuaVM 的全局作用域、模块和内置原型，以及下面的求值栈、迭代器和值栈
+    //在可能执行脚本的地方，C++ 局部变量持有的 jua 值必须通过 RootGuard 保护
+    //修改已有值对其他值的引用时必须调用 barrier
+    enum Mode{ Generational, Incremental };
+    enum Phase{ Idle, Marking, Sweeping }; //增量模式中回收周期的阶段
+    JuaVM* vm;
+    Jua_Ref* young = nullptr; //新生代链表（Jua_Ref::gcNext），新值在表头
+    Jua_Ref* old = nullptr; //老年代链表
+    static constexpr size_t MAX_REGISTERS = 1 << 20;
+    std::vector<Jua_Val> stack; //求值栈：计算过程中的临时值
+    std::vector<JuaIterator*> iterators; //存活的迭代器
+    //值栈：字节码解释器的寄存器（见 Interpreter）和函数的参数（见 ArgFrame）
+    //预留 MAX_REGISTERS 的固定容量，不会重新分配，指向其中的指针在弹出前一直有效
+    std::vector<Jua_Val> registers;
+
+    size_t youngBytes = 0; //新生代占用的字节数（估计值，下同）；增量模式中为上次回收以来新分配的值
+    size_t oldBytes = 0;
+    size_t threshold = 1 << 20; //分代模式中 oldBytes、增量模式中总占用达到该值时开始完整回收
+
+    //配置，宿主可以直接修改；切换模式请使用 setMode
+    size_t minThreshold = 1 << 20;
+    size_t pause = 200; //完整回收后，等堆增长到存活量的 pause% 再开始下一次完整回收
+    size_t nurserySize = 256 << 10; //分代模式：youngBytes 达到该值时进行新生代回收
+    size_t stepSize = 16 << 10; //增量模式：每分配这么多字节进行一次 step
+    size_t sliceBudget = 64 << 10; //增量模式：每次 step 最多标记或清除这么多字节的值
+    double maxPause = 500; //增量模式：每次 step 最多进行的时间（微秒），超出后提前结束；不限制原子阶段
+
+    //统计，时间单位为微秒
+    size_t allocations = 0;
+    size_t collections = 0;
+    size_t youngCollections = 0;
+    size_t steps = 0;
+    size_t lastFreed = 0;
+    size_t totalFreed = 0;
+    double youngPauseTotal = 0;
+    double youngPauseMax = 0;
+    double pauseMax = 0; //完整回收，或增量模式中的一次 step
+
+    JuaGC(JuaVM* v): vm(v){}
+    ~JuaGC(); //释放所有堆值
+    JuaGC(const JuaGC&) = delete;
+    void link(Jua_Ref* r){
+        r->gcNext = young;
+        young = r;
+        allocations++;
+        if(phase == Marking){
+            //标记期间新分配的值可能在构造时直接写入引用，所以是灰色而不是黑色
+            r->marked = true;
+            gray.push_back(r);
+        }
+    }
+    void check(){
+        //安全点：计入新分配的值，必要时回收
+        if(young != accounted)account();
+        if(mode == Generational){
+            if(youngBytes >= nurserySize)collectYoung();
+        }else if(phase != Idle ? stepDebt >= stepSize : youngBytes + oldBytes >= threshold){
+            step();
+        }
+    }
+    bool due() const {
+        //安全点是否有事要做；机器码（见 jit.cpp）只在需要时才回到解释器执行 check
+        if(young != accounted)return true;
+        if(mode == Generational)return youngBytes >= nurserySize;
+        return phase != Idle ? stepDebt >= stepSize : youngBytes + oldBytes >= threshold;
+    }
+    Jua_Val* pushRegisters(size_t n){
+        //在值栈顶部分配 n 个空值，返回起点；由调用者 resize 回原来的大小
+        size_t base = registers.size();
+        if(!registers.capacity())registers.reserve(MAX_REGISTERS);
+        if(base + n > registers.capacity())throw new JuaError("Stack overflow");
+        registers.resize(base + n);
+        return registers.data() + base;
+    }
+    size_t count(){
+        if(young != accounted)account();
+        return youngBytes + oldBytes;
+    }
+    Mode getMode(){ return mode; }
+    void setMode(Mode); //会进行一次完整回收
+    size_t collect(); //完整回收（不分片），返回释放的字节数
+    size_t collectYoung(); //仅用于分代模式；新生代回收，返回释放的字节数；老年代过大时接着进行完整回收
+    void step(); //仅用于增量模式；进行一片标记或清除工作，必要时开始新的回收周期
+    void mark(Jua_Val val){
+        if(auto r = val.ref())mark(r);
+    }
+    void mark(Jua_Ref* r){
+        if(r && !r->marked && !(minor && r->old)){
+            r->marked = true;
+            gray.push_back(r);
+        }
+    }
+    void barrier(Jua_Ref* owner, Jua_Val val){
+        //写屏障：owner 将引用 val
+        //分代模式：老值引用了新值，将新值记入记忆集（而不是 owner，避免重新 trace 大数组）
+        //增量模式：已标记的值引用了白色的值，将其标记为灰色
+        auto r = val.ref();
+        if(r && (owner->old || owner->marked)){
+            if(phase == Marking)mark(r);
+            else if(owner->old && !r->old)remember(r);
+        }
+    }
+    void barrier(Jua_Ref* owner){
+        //owner 的引用被直接修改（如批量写入 Jua_Array::items）
+        if(phase == Marking){
+            if(owner->marked)gray.push_back(owner); //重新 trace
+        }else if(owner->old){
+            remember(owner);
+        }
+    }
+    //共享 Shape 的标记，见 sweepShapes
+    void markShape(Shape* shape); //trace 存活的对象时
+    void shapeBarrier(Shape* shape){
+        //对象改用 shape 时：回收周期中途才被使用的 Shape 不会再被 trace 标记
+        if(phase != Idle)shape->marked = true;
+    }
+    void atomBarrier(Atom atom); //同上，回收周期中途驻留的动态原子可能加入已 trace 的对象的字典模式 Shape
+
+    private:
+    Mode mode = Generational;
+    Phase phase = Idle;
+    bool minor = false; //正在进行新生代回收
+    size_t stepDebt = 0; //上次 step 以来分配的字节数
+    Jua_Ref* unswept[2] = {}; //清除阶段尚未处理的值（原先的 old 和 young 链表）
+    size_t sweptLive = 0; //清除阶段已处理的存活值的字节数
+    size_t sweptFreed = 0;
+    Jua_Ref* accounted = nullptr; //young 中此值之后的值已计入 youngBytes
+    std::vector<Jua_Ref*> gray; //已标记、尚未 trace 的值
+    std::vector<Jua_Ref*> remembered; //记忆集：被老值引用的新值，以及需要重新 trace 的老值
+    void remember(Jua_Ref* r){
+        if(r->remembered)return;
+        r->remembered = true;
+        remembered.push_back(r);
+    }
+    void forget();
+    void account();
+    void markRoots();
+    void drain();
+    void atomic();
+    void finishCycle();
+    void sweepShapes(); //完整回收结束时释放没有存活对象使用的共享 Shape
+    void sweepOne(Jua_Ref*, size_t& live, size_t& freed);
+    size_t sweep(Jua_Ref*& list, size_t& live);
+};
+
+struct RootGuard{
+    //保护 C++ 作用域内的临时值，离开作用域（包括抛出异常）时自动弹出
+    JuaGC& gc;
+    size_t top;
+    RootGuard(JuaGC& g): gc(g), top(g.stack.size()){}
+    ~RootGuard(){
+        gc.stack.resize(top);
+    }
+    void push(Jua_Val val){ gc.stack.push_back(val); }
+};
+struct ArgFrame{
+    //在值栈顶部为 n 个参数分配槽位（初始为空值），前面预留 SPARE 个备用槽位，离开作用域时弹出
+    static constexpr size_t SPARE = 1;
+    JuaGC& gc;
+    size_t base;
+    JuaArgs args;
+    ArgFrame(JuaGC& g, size_t n): gc(g), base(g.registers.size()), args(g.pushRegisters(n + SPARE) + SPARE, n, SPARE){}
+    ~ArgFrame(){
+        gc.registers.resize(base);
+    }
+};
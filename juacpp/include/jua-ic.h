@@ -0,0 +1,33 @@
+#pragma once
+#include "jua-value.h"
+
+struct PropCache{
+    //属性访问处（PropRef、OptionalPropRef、MethWrapper）的内联缓存
+    //以接收者的 Shape（非对象为 nullptr）和原型为键，记录属性所在的对象和槽位，最多记录 MAX_ENTRIES 种
+    //查找路径上除接收者外的对象会被标记为 watched，它们的属性集合或原型改变时 JuaVM::cacheEpoch 增加，所有缓存失效
+    //写入 "__class"、"super" 属性，以及修改任何对象的原型时也会使缓存失效
+    //以下情况不缓存：接收者为字典模式，路径上有 Scope，经过接收者自身的 super（接收者是类）；布尔值和 null 总是走普通查找
+    static constexpr size_t MAX_ENTRIES = 4;
+    struct Entry{
+        Shape* shape;
+        Jua_Obj* proto;
+        Jua_Obj* holder; //nullptr 表示接收者自身的属性
+        int slot; //-1 表示属性不存在
+    };
+    const char* kind; //用于统计输出
+    Atom key;
+    Entry entries[MAX_ENTRIES];
+    size_t count = 0;
+    size_t epoch = 0;
+    bool megamorphic = false; //出现过多于 MAX_ENTRIES 种接收者
+    size_t hits = 0;
+    size_t misses = 0;
+    PropCache(const char* k, Atom name): kind(k), key(name){}
+    ~PropCache(); //从 vm->propCaches 中移除
+    Jua_Val get(JuaVM*, Jua_Val recv); //同 Jua_Val::getProp，可返回空值
+    Jua_Val peek(JuaVM*, Jua_Val recv); //只查已有的记录（堆值接收者），未命中时返回空值；不查找，不抛出
+
+    private:
+    JuaVM* vm = nullptr; //首次使用时登记到 vm->propCaches
+    bool resolve(Jua_Ref*, Atom, Jua_Obj*& holder, int& slot, bool receiver);
+};
@@ -0,0 +1,31 @@
+#pragma once
+#include "jua-bytecode.h"
+
+struct JuaVM;
+
+struct JitCode{
+    //基线 JIT：把热点 Proto 逐条指令翻译为 x86-64 机器码（模板式，不做寄存器分配），见 jit.cpp
+    //机器码与字节码共用寄存器窗口 R，可以从任意一条指令开始执行；数字运算、比较、跳转、计数循环内联，
+    //变量和自身属性的读写在守卫（作用域未被动态修改、接收者的 Shape）成立时内联，否则调用运行时的快速路径；
+    //写入堆值需要写屏障，也交给快速路径；遇到其他指令（调用、返回、下标等）或快速路径不适用时返回该指令的下标，
+    //由 Interpreter 执行这一条指令后再回到机器码，因此机器码不分配堆值、不抛出异常，也不改变帧
+    //仅支持 x86-64 Linux，其他平台上 compile 返回 nullptr，总是解释执行
+    typedef size_t (*Entry)(Jua_Val* R, JuaVM* vm, size_t index);
+    struct SlotCache{
+        //GETPROP、SETPROP 处的单态缓存，由快速路径填写：接收者的 Shape 为 shape 时，属性是自身的第 offset / 8 个槽位
+        //只记录非字典模式的 Shape，它们的属性不会再改变；Shape 可能被回收，因此同 PropCache 一样检查 epoch
+        Shape* shape = nullptr;
+        size_t offset = 0;
+        size_t epoch = 0; //记录时的 JuaVM::cacheEpoch
+        void* node; //PropRef
+    };
+    static const bool supported;
+    Entry entry;
+    std::vector<void*> labels; //各条指令对应的机器码地址，entry 按 index 跳转
+    std::vector<SlotCache> slotCaches; //按属性访问指令的数量预先分配，机器码直接使用其中元素的地址
+    void* memory = nullptr; //可执行内存
+    size_t size = 0;
+    ~JitCode(); //释放可执行内存
+    size_t run(Jua_Val* R, JuaVM* vm, size_t index){ return entry(R, vm, index); } //返回需要解释执行的指令下标
+    static JitCode* compile(Proto*);
+};
@@ -1,6 +1,8 @@
 #pragma once
 #include "jua-value.h"
-#include <unordered_map>
+#include <array>
+#include <string_view>
+#include <utility>
 enum class UniOper{
     unm,
     not_
@@ -24,11 +26,12 @@ enum class BinOper{
     and_,
     or_,
 };
-inline std::unordered_map<string, UniOper> uniOpers{
+//运算符的写法：编译期常量表，词法分析据此在编译期生成查找表，见 parser.cpp 中的 symbols 和 keywords
+inline constexpr std::pair<std::string_view, UniOper> uniOpers[]{
     {"-", UniOper::unm},
     {"!", UniOper::not_}
 };
-inline std::unordered_map<string, BinOper> binOpers{
+inline constexpr std::pair<std::string_view, BinOper> binOpers[]{
     {"^", BinOper::pow},
     {"*", BinOper::mul},
     {"/", BinOper::div},
@@ -47,49 +50,114 @@ inline std::unordered_map<string, BinOper> binOpers{
     {"&&", BinOper::and_},
     {"||", BinOper::or_}
 };
-inline std::unordered_map<BinOper, int> binOperPriority{
-    {BinOper::pow, 12},
-    {BinOper::mul, 10},
-    {BinOper::div, 10},
-    {BinOper::mod, 9},
-    {BinOper::add, 8},
-    {BinOper::sub, 8},
-    {BinOper::range, 7},
-    {BinOper::lt, 6},
-    {BinOper::le, 6},
-    {BinOper::gt, 6},
-    {BinOper::ge, 6},
-    {BinOper::in, 6},
-    {BinOper::is, 6},
-    {BinOper::eq, 5},
-    {BinOper::ne, 5},
-    {BinOper::and_, 4},
-    {BinOper::or_, 3}
-};
+inline constexpr auto binOperPriority = [](){
+    //以 size_t(BinOper) 为下标
+    constexpr std::pair<BinOper, int> list[]{
+        {BinOper::pow, 12},
+        {BinOper::mul, 10},
+        {BinOper::div, 10},
+        {BinOper::mod, 9},
+        {BinOper::add, 8},
+        {BinOper::sub, 8},
+        {BinOper::range, 7},
+        {BinOper::lt, 6},
+        {BinOper::le, 6},
+        {BinOper::gt, 6},
+        {BinOper::ge, 6},
+        {BinOper::in, 6},
+        {BinOper::is, 6},
+        {BinOper::eq, 5},
+        {BinOper::ne, 5},
+        {BinOper::and_, 4},
+        {BinOper::or_, 3}
+    };
+    std::array<int, std::size(list)> table{};
+    for(auto [oper, priority]: list)table[size_t(oper)] = priority;
+    return table;
+}();
 
-inline Jua_Val* operate(UniOper type, Jua_Val* val){
+inline Jua_Val operate(UniOper type, Jua_Val val){
     switch (type){
-        case UniOper::unm: return val->unm();
-        case UniOper::not_: return Jua_Bool::getInst(!val->toBoolean());
+        case UniOper::unm: return val.unm();
+        case UniOper::not_: return Jua_Bool::getInst(!val.toBoolean());
         default: throw "todo: UniOper";
     }
 }
-inline Jua_Val* operate(BinOper type, Jua_Val* left, Jua_Val* right){
+inline Jua_Val operate(JuaVM* vm, BinOper type, Jua_Val left, Jua_Val right){
     //短路不在此处理
     switch(type){
-        case BinOper::add: return left->add(right);
-        case BinOper::sub: return left->sub(right);
-        case BinOper::mul: return left->mul(right);
-        case BinOper::div: return left->div(right);
-        case BinOper::range: return left->range(right);
-        case BinOper::lt: return left->lt(right);
-        case BinOper::le: return left->le(right);
-        case BinOper::gt: return Jua_Bool::getInst(!left->le(right)->toBoolean());
-        case BinOper::ge: return Jua_Bool::getInst(!left->lt(right)->toBoolean());
-        case BinOper::eq: return left->eq(right);
-        case BinOper::ne: return Jua_Bool::getInst(!(*left == right));
-        case BinOper::in: return right->hasItem(left);
+        case BinOper::add: return left.add(right);
+        case BinOper::sub: return left.sub(right);
+        case BinOper::mul: return left.mul(right);
+        case BinOper::div: return left.div(right);
+        case BinOper::range: return left.range(vm, right);
+        case BinOper::lt: return left.lt(right);
+        case BinOper::le: return left.le(right);
+        case BinOper::gt: return Jua_Bool::getInst(!left.le(right).toBoolean());
+        case BinOper::ge: return Jua_Bool::getInst(!left.lt(right).toBoolean());
+        case BinOper::eq: return left.eq(right);
+        case BinOper::ne: return Jua_Bool::getInst(!left.equals(right));
+        case BinOper::in: return right.hasItem(left);
+        default: break;
+    }
+    for(auto& [str, op]: binOpers)
+        if(op == type)throw new JuaError("unsupported operator: " + string(str));
+    throw new JuaError("unsupported operator");
+}
+//自特化（quickening）：二元运算处记录首次执行时观察到的操作数类型，之后只需检查类型（守卫）即可直接计算，
+//不经过 operate 的分派、虚函数和元方法查找；守卫失败时退化为 generic，此后总是走 operate
+//树遍历解释器的状态存放在节点中（BinaryExpr、OperAssignment），字节码解释器则原地改写指令，见 Op::ADD_NN
+enum class Quick: uint8_t{
+    none,    //尚未执行
+    num,     //数字与数字：算术和比较
+    str,     //字符串与字符串：仅用于 +
+    generic,
+};
+inline Quick observe(BinOper type, Jua_Val left, Jua_Val right){
+    switch(type){
+        case BinOper::add:
+            if(left.type() == Jua_Val::Str && right.type() == Jua_Val::Str)return Quick::str;
+            [[fallthrough]];
+        case BinOper::sub: case BinOper::mul: case BinOper::div:
+        case BinOper::lt: case BinOper::le: case BinOper::gt: case BinOper::ge:
+        case BinOper::eq: case BinOper::ne:
+            return left.isNum() && right.isNum() ? Quick::num : Quick::generic;
+        default:
+            return Quick::generic;
+    }
+}
+inline Jua_Val operateNum(BinOper type, double l, double r){
+    //与 operate 的结果一致：> 和 >= 由 <= 和 < 取反得到（操作数为 NaN 时结果为 true）
+    switch(type){
+        case BinOper::add: return Jua_Num(l + r);
+        case BinOper::sub: return Jua_Num(l - r);
+        case BinOper::mul: return Jua_Num(l * r);
+        case BinOper::div: return Jua_Num(l / r);
+        case BinOper::lt: return Jua_Bool::getInst(l < r);
+        case BinOper::le: return Jua_Bool::getInst(l <= r);
+        case BinOper::gt: return Jua_Bool::getInst(!(l <= r));
+        case BinOper::ge: return Jua_Bool::getInst(!(l < r));
+        case BinOper::eq: return Jua_Bool::getInst(l == r);
+        case BinOper::ne: return Jua_Bool::getInst(l != r);
+        default: break;
+    }
+    //只有 observe 判为 Quick::num 的运算会到达此处，其余运算由调用方交给 operate
+    throw new JuaError("operateNum: not a numeric operator");
+}
+bool quickens(JuaVM*); //JuaVM::quicken，只在首次执行时查询
+inline Jua_Val quickOperate(JuaVM* vm, Quick& site, BinOper type, Jua_Val left, Jua_Val right){
+    if(site == Quick::none)site = quickens(vm) ? observe(type, left, right) : Quick::generic;
+    switch(site){
+        case Quick::num:
+            if(left.isNum() && right.isNum())return operateNum(type, left.num(), right.num());
+            break;
+        case Quick::str:
+            if(left.type() == Jua_Val::Str && right.type() == Jua_Val::Str)
+                return new Jua_Str(vm, left.as<Jua_Str>()->value + right.as<Jua_Str>()->value);
+            break;
+        default:
+            return operate(vm, type, left, right);
     }
-    d_log(int(type));
-    throw "todo: BinOper";
+    site = Quick::generic;
+    return operate(vm, type, left, right);
 }
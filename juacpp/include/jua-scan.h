@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+
+namespace scan{
+    //词法分析中逐字节扫描的热点：跳过空白符和标识符，查找字符串的引号、转义和注释的结尾
+    //启动时按 CPU 选择实现：x86-64 上为 SSE2 或 AVX2，一次比较 16 或 32 字节；其他平台逐字节扫描，见 scan.cpp
+    //各函数扫描 [p, end)，返回第一个不满足条件的位置，没有则返回 end
+    //大多数的一段很短（词法单元之间的一个空格、短标识符），前 SHORT 个字节在内联的循环中扫描，更长的才调用 active
+    struct Kernels{
+        const char* name;
+        const char* (*white)(const char* p, const char* end); //空白符，与 parser.cpp 原先的 whiteChars 一致（含 '\0'）
+        const char* (*word)(const char* p, const char* end); //标识符中的字符 [A-Za-z0-9_]
+        const char* (*find)(const char* p, const char* end, char a, char b, char c); //直到 a、b 或 c
+    };
+    extern Kernels active;
+    constexpr ptrdiff_t SHORT = 16;
+    inline bool isWhite(unsigned char c){
+        return c==' ' || unsigned(c-'\t') <= 4 || c==0;
+    }
+    inline bool isWord(unsigned char c){
+        return unsigned((c|0x20)-'a') < 26 || unsigned(c-'0') < 10 || c=='_';
+    }
+    inline const char* white(const char* p, const char* end){
+        auto stop = end - p > SHORT ? p + SHORT : end;
+        while(p < stop && isWhite(*p))p++;
+        return p < stop || p == end ? p : active.white(p, end);
+    }
+    inline const char* word(const char* p, const char* end){
+        auto stop = end - p > SHORT ? p + SHORT : end;
+        while(p < stop && isWord(*p))p++;
+        return p < stop || p == end ? p : active.word(p, end);
+    }
+    inline const char* find(const char* p, const char* end, char a, char b, char c){
+        auto stop = end - p > SHORT ? p + SHORT : end;
+        while(p < stop && *p!=a && *p!=b && *p!=c)p++;
+        return p < stop || p == end ? p : active.find(p, end, a, b, c);
+    }
+    inline const char* find(const char* p, const char* end, char a){
+        return find(p, end, a, a, a);
+    }
+    bool use(const char* name); //改用指定的实现（"sse2"、"avx2"、"scalar"），CPU 不支持时返回 false；用于基准测试
+}
@@ -1,129 +1,260 @@
 #include "jua-value.h"
+#include "jua-gc.h"
+#include "jua-ic.h"
+#include "jua-bytecode.h"
 #include "jua-operators.h"
+#include "jua-arena.h"
+#include <atomic>
 #include <format>
+#include <functional>
+#include <typeinfo>
+
+struct Resolver;
+struct Compiler;
+struct Optimizer;
+typedef std::vector<Atom> Names;
+
+//闭包执行引擎（JuaVM::Closure，见 closure.cpp）：语法树在首次执行前编译为预先绑定了子节点的闭包
+//表达式的闭包返回值；语句的闭包返回控制流，return 的值和尾调用写入 Controller（不使用其中的 breaking、continuing）
+struct Controller;
+typedef std::function<Jua_Val(Scope*)> ExprFn;
+enum class Flow: uint8_t{ normal, breaking, continuing, returning };
+typedef std::function<Flow(Scope*, Controller&)> StmtFn;
+
+struct SyntaxTree{
+    //编译单元：一次 parse 得到的语法树，所有节点（以及字节码等附属数据）分配在 nodes 中，随语法树一起释放
+    //引用计数：由其中的函数体创建的每个 Jua_PFunc 和正在执行它的 JuaVM::eval 各持有一次，减到 0 时释放
+    //正在执行的函数总能从根到达（调用者的寄存器或求值栈，尾调用见 Interpreter::tailCall 和 FunctionBody::exec）
+    //树中的名字（变量名、属性名等）由 intern 驻留，语法树各持有一次，释放时归还（见 Atom::hold）
+    Arena nodes;
+    std::unordered_map<std::string_view, Atom> names; //以条目中字符串的视图为键；重复的名字不再对原子表加锁
+    size_t refs = 0;
+    inline static std::atomic<size_t> live = 0; //尚未释放的语法树数量，用于统计；不同线程中的 vm 同时解析
+    inline static thread_local SyntaxTree* building = nullptr; //正在解析的语法树，newNode 在其中分配
+    SyntaxTree(){ live++; }
+    ~SyntaxTree();
+    Atom intern(std::string_view);
+    SyntaxTree(const SyntaxTree&) = delete;
+    void retain(){ refs++; }
+    void release(){ if(--refs == 0)delete this; }
+};
+template<class T, class... Args>
+T* newNode(Args&&... args){
+    //在正在解析的语法树中创建节点，只能在 parse 期间调用
+    return SyntaxTree::building->nodes.make<T>(std::forward<Args>(args)...);
+}
+struct TreeGuard{
+    //在 C++ 作用域内持有语法树
+    SyntaxTree* tree;
+    TreeGuard(SyntaxTree* t): tree(t){ t->retain(); }
+    ~TreeGuard(){ tree->release(); }
+};
 
 struct Expr{
-    virtual Jua_Val* calc(Scope* env) = 0;
+    virtual Jua_Val calc(Scope* env) = 0;
+    virtual Expr* optimize(Optimizer&){ return this; } //见 optimizer.cpp；返回替换该节点的表达式，没有子表达式的节点无需重写
+    virtual void resolve(Resolver&){} //见 resolver.cpp；没有子表达式的节点无需重写
+    virtual void compile(Compiler&, Reg dst); //见 compiler.cpp；默认编译为 EVAL，由树遍历解释器求值
+    virtual ExprFn close(); //见 closure.cpp；默认调用 calc
 };
 struct LeftValue{
-    virtual void assign(Scope*, Jua_Val*) = 0;
+    virtual void assign(Scope*, Jua_Val) = 0;
+    virtual void resolve(Resolver&) = 0;
+    virtual void compileAssign(Compiler&, Reg src); //默认编译为 ASSIGN
 };
 struct Declarable: LeftValue{
-    virtual void declare(Scope* env, Jua_Val* val) = 0;
+    virtual void declare(Scope* env, Jua_Val val) = 0;
+    virtual void compileDeclare(Compiler&, Reg src); //默认编译为 DECLARE
     virtual void addDefault(){}
+    virtual void collect(Names&) = 0; //收集声明的变量名
 };
 struct DeclarationItem{
     Declarable* body;
     Expr* initval;
     DeclarationItem(Declarable* d, Expr* e=nullptr): body(d), initval(e){}
     void addDefault();
-    void assign(Scope* env, Jua_Val* val);
-    void declare(Scope* env, Jua_Val* val);
+    void assign(Scope* env, Jua_Val val);
+    void declare(Scope* env, Jua_Val val);
+    void optimize(Optimizer&);
+    void resolve(Resolver&);
 };
 struct DeclarationList: Declarable{
     //static DeclarationList* fromNames()
     std::deque<DeclarationItem*> decItems;
     DeclarationList(std::deque<DeclarationItem*> items): decItems(items){}
-    void assign(Scope* env, Jua_Val* val); //仅用于左值数组
-    void declare(Scope* env, Jua_Val* val); //仅用于左值数组
-    void rawDeclare(Scope* env, const jualist&);
+    void assign(Scope* env, Jua_Val val); //仅用于左值数组
+    void declare(Scope* env, Jua_Val val); //仅用于左值数组
+    void rawDeclare(Scope* env, JuaArgs);
+    void optimize(Optimizer&);
+    void resolve(Resolver&);
+    void collect(Names&);
 };
 struct LiteralNum: Expr{
     double value;
     LiteralNum(double v): value(v){}
     static LiteralNum* eval(const string& str);
-    Jua_Val* calc(Scope*);
+    Jua_Val calc(Scope*);
+    void compile(Compiler&, Reg);
+    ExprFn close();
 };
 struct LiteralStr: Expr{
     string value;
     LiteralStr(string v): value(v){}
-    Jua_Val* calc(Scope*);
+    ~LiteralStr(); //从 JuaVM::literals 中移除
+    Jua_Str* get(JuaVM*); //字符串不可变，每个 vm 只创建一次，见 JuaVM::literals
+    Jua_Val calc(Scope*);
+    void compile(Compiler&, Reg);
+    ExprFn close();
+    private:
+    JuaVM* cacheVM = nullptr;
+    Jua_Str* cached = nullptr;
 };
 struct Template: Expr{
     std::vector<string> strList;
     std::vector<Expr*> exprList;
     Template(std::vector<string>& sl, std::vector<Expr*> el): strList(sl), exprList(el){}
-	Jua_Val* calc(Scope*);
+	Jua_Val calc(Scope*);
+    Expr* optimize(Optimizer&);
+    void resolve(Resolver&);
+    void compile(Compiler&, Reg);
+    ExprFn close();
 };
 struct Keyword: Expr{
     char type;
     Keyword(char t): type(t){};
-    Jua_Val* calc(Scope*);
+    Jua_Val calc(Scope*);
+    void resolve(Resolver&);
+    void compile(Compiler&, Reg);
+    ExprFn close();
     static Keyword* null;
     static Keyword* t;
     static Keyword* f;
     static Keyword* local;
 };
 struct Varname: Expr, Declarable{
-    string str;
-    //size_t hash; todo
-    Varname(string name): str(name){};
-    Jua_Val* calc(Scope*);
-    void assign(Scope* env, Jua_Val* val);
-    void declare(Scope* env, Jua_Val* val);
+    Atom name;
+    //由 Resolver 确定：变量所在的作用域在 depth 层外，值在其 slots[slot] 中
+    //slot 为 -1 表示不在任何词法作用域中（全局变量），在该层按名称查找；depth 为 -1 表示未解析
+    int depth = -1;
+    int slot = -1;
+    Varname(Atom n): name(n){};
+    Jua_Val calc(Scope*);
+    void assign(Scope* env, Jua_Val val);
+    void declare(Scope* env, Jua_Val val);
+    void resolve(Resolver&);
+    void collect(Names& names){ names.push_back(name); }
+    void compile(Compiler&, Reg);
+    void compileAssign(Compiler&, Reg);
+    void compileDeclare(Compiler&, Reg);
+    ExprFn close();
+    private:
+    Scope* target(Scope* env);
 };
 struct OptionalPropRef: Expr{
     Expr* expr;
-    string prop;
-	OptionalPropRef(Expr* e, string p): expr(e), prop(p){}
-	Jua_Val* _calc(Scope* env);
-	Jua_Val* calc(Scope* env);
+    Atom prop;
+    PropCache cache;
+	OptionalPropRef(Expr* e, Atom p): expr(e), prop(p), cache("prop", p){}
+	Jua_Val _calc(Scope* env);
+	Jua_Val calc(Scope* env);
+    Expr* optimize(Optimizer&);
+    void resolve(Resolver&);
+    void compile(Compiler&, Reg);
+    ExprFn close();
 };
 struct PropRef: OptionalPropRef, LeftValue{
     using OptionalPropRef::OptionalPropRef;
-    Jua_Val* calc(Scope* env);
-	void assign(Scope* env, Jua_Val* val);
+    Jua_Val calc(Scope* env);
+	void assign(Scope* env, Jua_Val val);
+    void resolve(Resolver& r){ OptionalPropRef::resolve(r); }
+    void compile(Compiler&, Reg);
+    void compileAssign(Compiler&, Reg);
+    ExprFn close();
 };
 struct MethWrapper: Expr{
     Expr* expr;
-    string key;
-    MethWrapper(Expr* e, string n): expr(e), key(n){}
-    Jua_Val* calc(Scope* env);
+    Atom key;
+    PropCache cache;
+    MethWrapper(Expr* e, Atom n): expr(e), key(n), cache("method", n){}
+    Jua_Val calc(Scope* env);
+    Jua_Val lookup(JuaVM*, Jua_Val obj); //查找方法，找不到时抛出错误
+    Jua_Val wrap(JuaVM*, Jua_Val obj); //查找方法，返回绑定了 obj 的函数
+    Expr* optimize(Optimizer&);
+    void resolve(Resolver&);
+    void compile(Compiler&, Reg);
+    ExprFn close();
 };
 struct UnitaryExpr: Expr{
     UniOper oper;
     Expr* pri;
     UnitaryExpr(UniOper type, Expr* expr): oper(type), pri(expr){}
-    Jua_Val* calc(Scope* env);
+    Jua_Val calc(Scope* env);
+    Expr* optimize(Optimizer&);
+    void resolve(Resolver&);
+    void compile(Compiler&, Reg);
+    ExprFn close();
 };
 struct BinaryExpr: Expr{
     BinOper oper;
     Expr* left;
     Expr* right;
+    Quick quick = Quick::none; //观察到的操作数类型，见 quickOperate
     BinaryExpr(BinOper type, Expr* l, Expr* r): oper(type), left(l), right(r) {}
-	Jua_Val* calc(Scope* env);
+	Jua_Val calc(Scope* env);
+    Expr* optimize(Optimizer&);
+    void resolve(Resolver&);
+    void compile(Compiler&, Reg);
+    ExprFn close();
 };
 struct Assignment: Expr{
     LeftValue* left;
     Expr* right;
     Assignment(LeftValue* l, Expr* r): left(l), right(r){}
-    Jua_Val* calc(Scope* env);
+    Jua_Val calc(Scope* env);
+    Expr* optimize(Optimizer&);
+    void resolve(Resolver&);
+    void compile(Compiler&, Reg);
+    ExprFn close();
 };
 struct OperAssignment: Expr{
     BinOper type;
     LeftValue* assignee;
     Expr* left;
     Expr* right;
+    Quick quick = Quick::none;
     OperAssignment(BinOper t, Expr* l, Expr* r): type(t), left(l), right(r){
         assignee = dynamic_cast<LeftValue*>(l);
         if(!assignee)
             throw "Cannot assign to non-leftvalue";
     }
-    Jua_Val* calc(Scope* env);
+    Jua_Val calc(Scope* env);
+    Expr* optimize(Optimizer&);
+    void resolve(Resolver&);
+    void compile(Compiler&, Reg);
+    ExprFn close();
 };
 struct Subscription: Expr, LeftValue{
     Expr* expr;
     Expr* keyExpr;
 	Subscription(Expr* e, Expr* k): expr(e), keyExpr(k){}
-	Jua_Val* calc(Scope* env);
-	void assign(Scope* env, Jua_Val* val);
+	Jua_Val calc(Scope* env);
+	void assign(Scope* env, Jua_Val val);
+    Expr* optimize(Optimizer&);
+    void resolve(Resolver&);
+    void compile(Compiler&, Reg);
+    void compileAssign(Compiler&, Reg);
+    ExprFn close();
 };
 struct TernaryExpr: Expr{
     Expr* condExpr;
     Expr* trueExpr;
     Expr* falseExpr;
     TernaryExpr(Expr* c, Expr* t, Expr* f): condExpr(c), trueExpr(t), falseExpr(f){}
-    Jua_Val* calc(Scope*);
+    Jua_Val calc(Scope*);
+    Expr* optimize(Optimizer&);
+    void resolve(Resolver&);
+    void compile(Compiler&, Reg);
+    ExprFn close();
 };
 struct FlexibleList{
     std::vector<Expr*> exprs;
@@ -131,57 +262,93 @@ struct FlexibleList{
     FlexibleList(initializer_list<Expr*> list): exprs(list){};
     jualist calc(Scope*);
     void appendTo(Scope*, jualist&);
-    bool contains(Scope* env, Jua_Val* val){
+    bool contains(Scope* env, Jua_Val val){
         for(auto expr: exprs){
-            if(*expr->calc(env) == val) return true;
+            if(expr->calc(env).equals(val)) return true;
         }
         return false;
     }
+    void optimize(Optimizer&);
+    void resolve(Resolver&);
 };
 struct Call: Expr{
     Expr* calee;
     FlexibleList* args;
     Call(Expr* e, FlexibleList* l): calee(e), args(l){}
-    Jua_Val* calc(Scope*);
+    Jua_Val calc(Scope* env){ return invoke(env, nullptr); }
+    virtual Jua_Val invoke(Scope*, Controller* tail); //tail 不为空时是 return 中的尾调用，见 Controller::call
+    Expr* optimize(Optimizer&);
+    void resolve(Resolver&);
+    void compile(Compiler&, Reg);
+    ExprFn close();
+};
+struct MethodCall: Call{
+    //obj:method(args)：查找方法后以 obj 为第一个参数直接调用，不创建绑定函数
+    MethWrapper* meth; //即 calee
+    MethodCall(MethWrapper* m, FlexibleList* l): Call(m, l), meth(m){}
+    Jua_Val invoke(Scope*, Controller* tail);
+    void compile(Compiler&, Reg);
 };
 
 struct ObjExpr: Expr{
     typedef std::vector<std::pair<Expr*, Expr*>> Props;
     Props entries;
-	ObjExpr(Props p): entries(p){}
-	Jua_Val* calc(Scope*);
+    std::vector<Atom> keys; //字符串字面量键在解析时驻留，其他键为空 Atom
+	ObjExpr(Props p);
+	Jua_Val calc(Scope*);
+    Expr* optimize(Optimizer&);
+    void resolve(Resolver&);
+    void compile(Compiler&, Reg);
+    ExprFn close();
 };
 struct ArrayExpr: Expr{
     FlexibleList* list;
     ArrayExpr(FlexibleList* exprs): list(exprs){}
-	Jua_Val* calc(Scope*);
+	Jua_Val calc(Scope*);
+    Expr* optimize(Optimizer&);
+    void resolve(Resolver&);
+    void compile(Compiler&, Reg);
+    ExprFn close();
 };
 struct LeftObj: Declarable{
     bool auto_nulled = false;
     typedef std::vector<std::pair<Expr*, DeclarationItem*>> Entries;
     Entries entries;
     LeftObj(Entries e): entries(e){}
-    void assign(Scope*, Jua_Val*);
-    void declare(Scope* env, Jua_Val* val);
+    void assign(Scope*, Jua_Val);
+    void declare(Scope* env, Jua_Val val);
     void addDefault();
+    void resolve(Resolver&);
+    void collect(Names&);
     private:
-    typedef void (DeclarationItem::*Callback)(Scope*, Jua_Val*);
-    void forEach(Scope* env, Jua_Val* obj, Callback);
+    typedef void (DeclarationItem::*Callback)(Scope*, Jua_Val);
+    void forEach(Scope* env, Jua_Val obj, Callback);
 };
 
 struct Controller{
     bool breaking = false;
     bool continuing = false;
-    Jua_Val* retval = nullptr;
+    Jua_Val retval = nullptr;
+    //尾调用：return f(...) 中的 f 是脚本函数时不在 Return 中调用，而是在当前函数体结束后由 FunctionBody 执行
+    //被调函数的作用域替换当前的，C++ 栈和帧作用域栈都不增长
+    Jua_PFunc* tailFn = nullptr;
+    std::vector<Jua_Val> tailArgs; //由 Return 填写，期间没有安全点；tailScope 将其压入值栈
     bool isPending() {
-        return breaking || continuing || retval;
+        return breaking || continuing || bool(retval) || tailFn;
     }
+    Jua_Val call(Jua_Val fn, JuaArgs args); //脚本函数记为尾调用，返回空值；其他值直接调用
+    Scope* tailScope(JuaVM*, size_t depth); //弹出 depth 之上的帧作用域，创建 tailFn 的作用域并声明参数
 };
 
 struct Statement{
     Statement* pending_continue = nullptr;
     Statement* pending_break = nullptr;
     virtual void exec(Scope*, Controller*) = 0;
+    virtual Statement* optimize(Optimizer&){ return this; } //见 optimizer.cpp；返回空指针表示删除该语句
+    virtual void resolve(Resolver&){}
+    virtual void collect(Names&){} //收集在所在 Block 的作用域中声明的变量名
+    virtual void compile(Compiler&) = 0;
+    virtual StmtFn close() = 0; //见 closure.cpp
 };
 struct ExprStatement: Statement{
     Expr* expr;
@@ -189,6 +356,10 @@ struct ExprStatement: Statement{
     void exec(Scope* env, Controller*){
         expr->calc(env);
     }
+    Statement* optimize(Optimizer&);
+    void resolve(Resolver&);
+    void compile(Compiler&);
+    StmtFn close();
 };
 struct Declaration: Statement{
     DeclarationList* list;
@@ -199,29 +370,45 @@ struct Declaration: Statement{
         list = l;
     }
     void exec(Scope* env, Controller*){
-        list->rawDeclare(env, {});
+        list->rawDeclare(env, JuaArgs(nullptr, 0));
     }
+    Statement* optimize(Optimizer&);
+    void resolve(Resolver&);
+    void compile(Compiler&);
+    StmtFn close();
+    void collect(Names& names){ list->collect(names); }
 };
 struct Return: Statement{
     Expr* expr;
-    Return(Expr* e=nullptr): expr(e){}
+    bool tail; //return f(...)：解析时确定，调用脚本函数时复用当前帧，见 Controller::tailFn
+    Return(Expr* e=nullptr): expr(e), tail(dynamic_cast<Call*>(e)){}
     void exec(Scope*, Controller*);
+    Statement* optimize(Optimizer&);
+    void resolve(Resolver&);
+    void compile(Compiler&);
+    StmtFn close();
 };
 struct Break: Statement{
-    Break(){
+    size_t pos; //在源码中的偏移，在循环外时用于报错
+    Break(size_t p): pos(p){
         pending_break = this;
     }
     void exec(Scope*, Controller* controller){
         controller->breaking = true;
     }
+    void compile(Compiler&);
+    StmtFn close();
 };
 struct Continue: Statement{
-    Continue(){
+    size_t pos;
+    Continue(size_t p): pos(p){
         pending_continue = this;
     }
     void exec(Scope*, Controller* controller){
         controller->continuing = true;
     }
+    void compile(Compiler&);
+    StmtFn close();
 };
 
 struct Block;
@@ -231,6 +418,10 @@ struct IfStmt: Statement{
     Block* elseBody;
     IfStmt(Expr* c, Block* b, Block* e);
     void exec(Scope*, Controller*);
+    Statement* optimize(Optimizer&);
+    void resolve(Resolver&);
+    void compile(Compiler&);
+    StmtFn close();
 };
 struct CaseBlock{
     FlexibleList* cond;
@@ -242,13 +433,31 @@ struct SwitchStmt: Statement{
     std::vector<CaseBlock*> cases;
     Block* defaultBody = nullptr;
     SwitchStmt(Expr* e, std::vector<CaseBlock*>& cs, Block* d);
+    //分支条件都是数字或字符串字面量时，解析时建立跳转表（buildTable），执行时查表而不逐个比较
+    //整数条件较密集时用数组 dense，否则用哈希表；值相同的条件以先出现的分支为准
+    bool jumpTable = false;
+    double denseBase = 0;
+    std::vector<int32_t> dense; //下标为 值 - denseBase，-1 表示没有对应的分支
+    std::unordered_map<double, uint32_t> numCases;
+    std::unordered_map<string, uint32_t> strCases;
+    void buildTable();
+    int lookup(Jua_Val val); //命中的分支下标，没有时为 -1；仅用于 jumpTable
+    int match(Scope*, Jua_Val val); //命中的分支下标，没有时为 -1
     void exec(Scope*, Controller*);
+    Statement* optimize(Optimizer&);
+    void resolve(Resolver&);
+    void compile(Compiler&);
+    StmtFn close();
 };
 struct WhileStmt: Statement{
     Expr* cond;
     Block* body;
     WhileStmt(Expr* c, Block* b): cond(c), body(b){}
     void exec(Scope*, Controller*);
+    Statement* optimize(Optimizer&);
+    void resolve(Resolver&);
+    void compile(Compiler&);
+    StmtFn close();
 };
 struct ForStmt: Statement{
     Declarable*  declarable;
@@ -257,6 +466,11 @@ struct ForStmt: Statement{
     ForStmt(Declarable* d, Expr* i, Block* b):
         declarable(d), iterable(i), body(b){}
     void exec(Scope*, Controller*);
+    Statement* optimize(Optimizer&);
+    void resolve(Resolver&);
+    void compile(Compiler&);
+    StmtFn close();
+    void collect(Names& names){ declarable->collect(names); } //循环变量声明在外层作用域中
 };
 
 typedef std::vector<Statement*> Stmts;
@@ -265,17 +479,33 @@ struct Block{
     Statement* pending_continue = nullptr;
     Statement* pending_break = nullptr;
     Stmts statements;
+    Names names; //在该 Block 的作用域中声明的变量，由 Resolver 填写，按首次出现的顺序排列
+    //以下由 Resolver 填写
+    bool hasScope = true; //为 false 时（不声明变量，也不使用 local）直接在外层作用域中执行，不创建作用域
+    bool captured = true; //其中有函数表达式或 local，作用域在执行结束后可能仍被引用
     Block(Stmts stmts);
+    ~Block(); //解除对 layout 的固定
     void exec(Scope* env, Controller* controller);
+    Scope* newScope(Scope* parent); //创建该 Block 的作用域，按 names 预留槽位
+    Shape* getLayout(JuaVM*);
+    Scope* enter(Scope* parent, Scope* prev = nullptr); //返回执行该 Block 的作用域；prev 为循环上一次迭代的作用域，未被捕获时清空后复用
+    StmtFn close(); //闭包以 enter 返回的作用域执行，同 exec
+    private:
+    JuaVM* layoutVM = nullptr;
+    Shape* layout = nullptr; //names 对应的 Shape，每个 vm 各有一个；固定在 layoutVM 的转移树中，语法树在 vm 析构前释放
+    void flatten(std::vector<StmtFn>&); //各语句的闭包，没有作用域的 if(true) 分支就地展开
+    friend Resolver;
 };
 struct FunctionBody: Block{
-    FunctionBody(Stmts stmts): Block(stmts){
-        if(pending_continue)
-            throw pending_continue;
-        if(pending_break)
-            throw pending_break;
-    }
-    Jua_Val* exec(Scope*); //不会返回 nullptr
+    FunctionBody(Stmts stmts); //循环外的 break、continue 抛出只有偏移的 JuaSyntaxError，由解析器补上行列
+    ~FunctionBody(){ delete proto; }
+    SyntaxTree* tree = SyntaxTree::building; //所属的语法树
+    Proto* proto = nullptr; //字节码，由 Interpreter 首次执行时编译
+    StmtFn closure; //闭包，由 run 首次执行时编译
+    Jua_Val exec(Scope*); //不会返回空值
+    Jua_Val run(Scope*); //以闭包执行，同 exec
+    //调用时的作用域：未被捕获时压入 vm 的帧作用域栈，调用者负责弹出（见 FrameScopeGuard）；否则在堆上创建
+    Scope* callScope(Scope* upenv);
 };
 
 struct Jua_PFunc: Jua_Func{
@@ -283,34 +513,102 @@ struct Jua_PFunc: Jua_Func{
     DeclarationList* decList;
     FunctionBody* body;
     Jua_PFunc(Scope* env, DeclarationList* list, FunctionBody* b):
-        Jua_Func(env->vm), upenv(env), decList(list), body(b){}
-	Jua_Val* call(jualist& args){
-		auto env = new Scope(upenv);
-		decList->rawDeclare(env, args);
-		return body->exec(env);
-	}
+        Jua_Func(env->vm), upenv(env), decList(list), body(b){
+        body->tree->retain();
+    }
+    ~Jua_PFunc(){ body->tree->release(); }
+	Jua_Val call(JuaArgs args);
+    void trace(JuaGC& gc) override {
+        Jua_Func::trace(gc);
+        gc.mark(upenv);
+    }
+    size_t gcSize() override { return sizeof(Jua_PFunc); }
 };
+inline bool isScriptFunc(Jua_Ref* r){
+    return r->type == Jua_Val::Func && typeid(*r) == typeid(Jua_PFunc);
+}
 
 struct FunExpr: Expr{
     DeclarationList* decList;
     FunctionBody* body;
 	FunExpr(DeclarationList* dl, Stmts stmts):
-        decList(dl), body(new FunctionBody(stmts)){}
-	Jua_Val* calc(Scope* env){
+        decList(dl), body(newNode<FunctionBody>(stmts)){}
+	Jua_Val calc(Scope* env){
 		return new Jua_PFunc(env, decList, body);
 	}
+    Expr* optimize(Optimizer&);
+    void resolve(Resolver&);
+    void compile(Compiler&, Reg);
+    ExprFn close();
+};
+
+struct Optimizer{
+    //解析后、变量解析前化简语法树：折叠只由字面量构成的表达式，删除条件为常量的 if 中不会执行的分支
+    //折叠的结果仍是字面量节点（LiteralNum、LiteralStr、Keyword）；dump 为 true 时逐条打印折叠和删除的内容
+    bool dump = false;
+    size_t folded = 0;
+    size_t pruned = 0;
+    void block(Block*);
+    Expr* fold(const char* kind, Expr* to); //记录一次对 kind 节点的折叠，返回 to
+    bool truth(Expr*, bool& result); //expr 为字面量时得到其布尔值
+};
+
+struct Resolver{
+    //将变量名解析为 (depth, slot)，见 Varname
+    //作用域与运行时一一对应：函数体（含参数）、if/while/for/switch 的每个分支中 hasScope 的各一个作用域
+    struct Entry{
+        Block* block;
+        bool usesLocal; //直接（不在内层 Block 中）使用了 local
+    };
+    std::vector<Entry> blocks; //由外到内正在解析的 Block，包括没有作用域的
+    void block(Block*, DeclarationList* params = nullptr, bool function = false);
+    void name(Varname*);
+    void capture(); //当前位置的函数表达式或 local 可能在执行结束后引用所有外层作用域
+    void local();
+};
+
+struct Compiler{
+    //将函数体编译为字节码，见 Interpreter
+    //表达式的结果写入调用者指定的寄存器 dst，求值过程中的临时值使用 top 及以上的寄存器
+    //作用域与树遍历解释器一一对应（ENTER/LEAVE，省略没有作用域的 Block），break、continue、return 编译为跳转
+    struct Loop{
+        size_t start; //continue 跳转的目标
+        size_t scopes; //循环所在的作用域层数
+        std::vector<size_t> breaks; //待回填的 break 跳转
+    };
+    Proto* proto;
+    Reg top = 1; //r0 为当前作用域
+    size_t scopes = 0; //当前函数体内已进入的作用域层数
+    std::vector<Loop> loops;
+    Compiler(Proto* p): proto(p){}
+    Reg reg(); //分配临时寄存器，用完后将 top 恢复原值即释放
+    size_t emit(Op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0); //返回指令下标
+    uint32_t node(void*);
+    uint32_t constant(Jua_Val);
+    uint32_t atom(Atom);
+    size_t here(){ return proto->code.size(); }
+    void patch(size_t jump, size_t target); //回填跳转指令的目标
+    void statements(Block*);
+    void block(Block*, Reg prev = 0); //prev 为存放上一次迭代的作用域的寄存器，0 表示不复用
+    void exitLoop(bool isBreak);
 };
 
 struct JuaSyntaxError: JuaError{
-    size_t pos = -1;
-    size_t line = -1;
-    size_t col = -1;
+    static constexpr size_t npos = size_t(-1); //尚未定位
+    size_t pos = npos;
+    size_t line = npos;
+    size_t col = npos;
+    JuaSyntaxError(const string& msg): JuaError(msg){} //由解析器定位，见 Lexer::locate
     JuaSyntaxError(const string& msg, size_t p, size_t l, size_t c):
         JuaError(msg), pos(p), line(l), col(c){}
-    string toDebugString() override {
-        if(pos == -1) return std::format("JuaSyntaxError: {}", message);
-        return std::format("JuaSyntaxError: {} at {}:{}", message, line, col);
+    const char* name() override { return "JuaSyntaxError"; }
+    string detail() override {
+        if(pos == npos) return message;
+        return std::format("{} at {}:{}", message, line, col);
     }
 };
 
-FunctionBody* parse(const string&);
\ No newline at end of file
+FunctionBody* parse(const string&, bool dump = false); //返回已化简、已解析变量的函数体，调用者须持有其 tree；dump 见 Optimizer
+size_t tokenize(const string&); //只做词法分析，返回词法单元数；用于基准测试
+void optimize(FunctionBody*, bool dump = false);
+void resolve(FunctionBody*, DeclarationList* params = nullptr); //以 params 为参数重新解析
\ No newline at end of file
@@ -6,12 +6,17 @@
 #include <unordered_map>
 #include <cstdint>
 #include <cstddef>
+#include <cstring>
 #include <cmath>
+#include <bit>
 #include <functional>
+#include <memory>
+#include "jua-atom.h"
 static_assert(
     sizeof(char)==1 &&
     sizeof(float)==4 &&
-    sizeof(double)==8,
+    sizeof(double)==8 &&
+    sizeof(void*)==8,
     "Incapable platform"
 );
 using std::string;
@@ -19,28 +24,139 @@ using std::initializer_list;
 
 struct JuaVM;
 struct Jua_Val;
+struct Jua_Ref;
 struct Jua_Obj;
 struct Jua_Bool;
 struct Jua_Func;
-typedef std::deque<Jua_Val*> jualist;
+typedef std::deque<Jua_Val> jualist;
+struct JuaArgs;
 struct JuaIterator;
+struct JuaGC;
 
 void d_log(const string&);
 void d_log(char c);
-void d_log(Jua_Val*);
-void d_log(string, Jua_Val*);
+void d_log(Jua_Val);
+void d_log(string, Jua_Val);
 void d_log(string, int);
 
 struct Jua_Val{
-    JuaVM* vm = nullptr; //指向JuaVM实例
+    //jua 值，按值传递（NaN-boxing）
+    //非 NaN 的 double 直接存储；null、布尔值、堆指针（Jua_Ref*）编码在 NaN 的空间中
+    //默认构造的空值相当于原先的 nullptr，表示“不存在”，不是合法的 jua 值
     enum JuaType{Obj, Null, Str, Num, Bool, Func};
-    JuaType type;
+    static constexpr uint64_t NAN_BITS  = 0x7FF8000000000000; //规范化的 NaN
+    static constexpr uint64_t TAG_NULL  = 0xFFF9000000000000;
+    static constexpr uint64_t TAG_BOOL  = 0xFFFA000000000000;
+    static constexpr uint64_t TAG_EMPTY = 0xFFFB000000000000;
+    static constexpr uint64_t TAG_REF   = 0xFFFC000000000000;
+    static constexpr uint64_t TAG_MASK  = 0xFFFF000000000000;
+    uint64_t bits;
+    Jua_Val(): bits(TAG_EMPTY){}
+    Jua_Val(std::nullptr_t): bits(TAG_EMPTY){}
+    Jua_Val(Jua_Ref* p): bits(p ? TAG_REF | reinterpret_cast<uint64_t>(p) : TAG_EMPTY){}
+    explicit operator bool() const { return bits != TAG_EMPTY; }
+    bool operator==(std::nullptr_t) const { return bits == TAG_EMPTY; }
+    bool isNum() const { return bits < TAG_NULL; }
+    bool isRef() const { return (bits & TAG_MASK) == TAG_REF; }
+    double num() const { return std::bit_cast<double>(bits); } //仅用于数字
+    Jua_Ref* ref() const { //非堆值返回 nullptr
+        return isRef() ? reinterpret_cast<Jua_Ref*>(bits & ~TAG_MASK) : nullptr;
+    }
+    template<typename T>
+    T* as() const { return static_cast<T*>(ref()); }
+    bool same(Jua_Val v) const { return bits == v.bits; } //同一性，不调用元方法
+    JuaType type() const;
+
+    //以下方法就地处理数字、布尔值和 null，堆值则转发给 Jua_Ref 的虚函数
+    bool isType(int type_id) const;
+    Jua_Obj* getProto(JuaVM*) const;
+    Jua_Val getOwn(Atom key) const;
+    Jua_Val getProp(JuaVM*, Atom) const; //数字需要 vm 来找到 NumberProto
+    Jua_Bool hasItem(Jua_Val) const;
+    Jua_Val getItem(Jua_Val) const;
+    void setItem(Jua_Val, Jua_Val) const;
+    Jua_Val call(JuaArgs) const;
+    Jua_Val call(initializer_list<Jua_Val>) const;
+    Jua_Val invoke(Jua_Val self, JuaArgs) const;
+    Jua_Val unm() const;
+    Jua_Val add(Jua_Val) const;
+    Jua_Val sub(Jua_Val) const;
+    Jua_Val mul(Jua_Val) const;
+    Jua_Val div(Jua_Val) const;
+    Jua_Bool eq(Jua_Val) const;
+    Jua_Bool lt(Jua_Val) const;
+    Jua_Bool le(Jua_Val) const;
+    Jua_Val range(JuaVM*, Jua_Val) const;
+    JuaIterator* getIterator(Jua_Func* next=nullptr) const;
+    void collectItems(jualist&) const;
+    bool equals(Jua_Val) const; //相当于原先的 operator==
+    string toString() const;
+    string safeToString() const;
+    bool toBoolean() const;
+    Jua_Bool toJuaBool() const;
+    int64_t toInt() const; //仅用于数字
+    double toNumber() const; //仅用于数字
+    string getTypeName() const;
+
+    private:
+    typedef Jua_Val (Jua_Ref::*RefOper)(Jua_Val);
+    Jua_Val binarySlow(RefOper, const char* numErr, const char* err, Jua_Val) const;
+};
+
+struct JuaArgs{
+    //函数的参数：值栈（JuaGC::registers）中连续的 count 个值，调用期间由值栈保护，不需要 RootGuard
+    //data 之前的 spare 个槽位也由调用者预留，push_front 只需移动指针；没有备用槽位时见 Jua_Ref::invoke
+    Jua_Val* data;
+    uint32_t count;
+    uint32_t spare;
+    JuaArgs(Jua_Val* d, size_t n, size_t s = 0): data(d), count(n), spare(s){}
+    size_t size() const { return count; }
+    bool empty() const { return !count; }
+    Jua_Val& operator[](size_t i) const { return data[i]; }
+    Jua_Val& back() const { return data[count - 1]; }
+    Jua_Val* begin() const { return data; }
+    Jua_Val* end() const { return data + count; }
+    void pop_front(){ data++; count--; spare++; }
+    void push_front(Jua_Val val){ //要求 spare 不为 0
+        data--; count++; spare--;
+        data[0] = val;
+    }
+};
+
+struct Jua_Null: Jua_Val{
+    static Jua_Null getInst(){ return Jua_Null(); }
+    private:
+    Jua_Null(){ bits = TAG_NULL; }
+};
+struct Jua_Bool: Jua_Val{
+    bool value() const { return bits & 1; }
+    static Jua_Bool getInst(bool v){ return Jua_Bool(v); }
+    private:
+    Jua_Bool(bool v){ bits = TAG_BOOL | v; }
+};
+struct Jua_Num: Jua_Val{
+    Jua_Num(double v){
+        //其它 NaN 的位模式可能与标签冲突
+        bits = v == v ? std::bit_cast<uint64_t>(v) : NAN_BITS;
+    }
+    double value() const { return num(); }
+};
+
+struct Jua_Ref{
+    //堆上的 jua 值（对象、字符串、函数），由 JuaGC 管理，不要手动 delete
+    JuaVM* vm = nullptr; //指向JuaVM实例
+    Jua_Val::JuaType type;
     size_t id = -1;
     Jua_Obj* proto;
-    size_t ref = 0;
-    Jua_Val(JuaVM* vm_, JuaType t, Jua_Obj* p = nullptr): vm(vm_), type(t), proto(p){}
-    void addRef(){ ref++; }
-    void release();
+    Jua_Ref* gcNext = nullptr; //见 JuaGC
+    bool marked = false;
+    bool old = false; //已晋升到老年代
+    bool remembered = false; //已在记忆集中
+    bool watched = false; //有内联缓存依赖该对象的属性集合和原型，见 PropCache
+    Jua_Ref(JuaVM* vm_, Jua_Val::JuaType t, Jua_Obj* p = nullptr); //登记到 vm 的垃圾回收器
+    virtual ~Jua_Ref(){}
+    static void* operator new(size_t); //见 gc.cpp 中的 JuaPool
+    static void operator delete(void*, size_t);
     virtual bool isType(int type_id){
         //用于自定义类型判断（自定义类型应当是 Jua_Obj 的子类）
         //保留的 type_id:
@@ -48,178 +164,157 @@ struct Jua_Val{
         // 1: Scope
         // 2: Jua_Array
         // 3: Jua_Buffer
-        // 4-15: 未使用
+        // 4: Jua_Range
+        // 5-15: 未使用
         return false;
     }
-    virtual Jua_Val* getOwn(const string& key){
+    virtual Jua_Val getOwn(Atom key){
         return nullptr;
     }
-    Jua_Val* getOwn(const char* key){
-        string str(key);
-        return getOwn(str);
-    }
-    virtual Jua_Val* inheritProp(const string&); //返回jua值或nullptr
-    Jua_Val* getProp(const string&);
-    Jua_Val* getProp(const char* key){
-        string str(key);
-        return getProp(str);
-    }
-    Jua_Func* getMetaMethod(const string&);
-    Jua_Func* getMetaMethod(const char* key){
-        string str(key);
-        return getMetaMethod(str);
-    }
-    //以下均不会返回 nullptr
-    virtual Jua_Bool* hasItem(Jua_Val*);
-    virtual Jua_Val* getItem(Jua_Val*);
-    virtual void setItem(Jua_Val*, Jua_Val*);
-    virtual Jua_Val* call(jualist&);
-    Jua_Val* call(initializer_list<Jua_Val*> args){
-        jualist list = args;
-        return call(list);
-    }
-    virtual Jua_Val* unm();
-    virtual Jua_Val* add(Jua_Val*);
-    virtual Jua_Val* sub(Jua_Val*);
-    virtual Jua_Val* mul(Jua_Val*);
-    virtual Jua_Val* div(Jua_Val*);
-    Jua_Bool* eq(Jua_Val*); //子类应当重写 operator==
-    virtual Jua_Bool* lt(Jua_Val*);
-    virtual Jua_Bool* le(Jua_Val*);
-    virtual Jua_Val* range(Jua_Val*);
+    virtual Jua_Val inheritProp(Atom); //返回jua值或空值
+    Jua_Val getProp(Atom);
+    Jua_Func* getMetaMethod(Atom);
+    //以下均不会返回空值
+    virtual Jua_Bool hasItem(Jua_Val);
+    virtual Jua_Val getItem(Jua_Val);
+    virtual void setItem(Jua_Val, Jua_Val);
+    virtual Jua_Val call(JuaArgs);
+    Jua_Val call(initializer_list<Jua_Val>); //复制到值栈上再调用
+    Jua_Val invoke(Jua_Val self, JuaArgs); //以 self 为第一个参数调用，用于 __call 和方法
+    virtual Jua_Val unm();
+    virtual Jua_Val add(Jua_Val);
+    virtual Jua_Val sub(Jua_Val);
+    virtual Jua_Val mul(Jua_Val);
+    virtual Jua_Val div(Jua_Val);
+    virtual Jua_Bool lt(Jua_Val);
+    virtual Jua_Bool le(Jua_Val);
+    virtual Jua_Val range(Jua_Val);
 
     virtual JuaIterator* getIterator(Jua_Func* next=nullptr); //优先使用元方法 "next"
     virtual void collectItems(jualist&); //仅用于可迭代对象
-    virtual bool operator==(Jua_Val* val);
+    virtual bool operator==(Jua_Val val);
     virtual string toString() = 0; //const string& str = toString()
     virtual string safeToString(){ return toString(); }
     virtual bool toBoolean(){ return true; }
-    virtual Jua_Bool* toJuaBool();
-    virtual int64_t toInt(); //仅用于数字
-    virtual double toNumber(); //仅用于数字
     virtual string getTypeName() = 0;
-    virtual void gc();
+    //垃圾回收：标记直接引用的 jua 值；估计占用的字节数
+    //持有 jua 值的子类必须重写 trace
+    virtual void trace(JuaGC&);
+    virtual size_t gcSize(){ return sizeof(Jua_Ref); }
 };
 
-struct Jua_Null: Jua_Val{
-    string toString(){ return "null"; }
-    bool toBoolean(){ return false; }
-    string getTypeName(){ return "null"; }
-    void gc(){}
-    static Jua_Null* getInst(){
-        static Jua_Null* inst = new Jua_Null;
-        return inst;
+struct Shape{
+    //隐藏类：对象的属性名列表，下标即属性值在 Jua_Obj::slots 中的位置，按添加顺序排列
+    //以相同顺序添加相同属性的对象共享同一个 Shape（转移树），Shape 由 JuaVM::rootShape 持有；
+    //完整回收后，没有存活对象使用的 Shape 从树中释放，见 JuaGC::sweepShapes
+    //删除属性、属性过多或转移过多时，对象改用自己独有的字典模式 Shape，之后就地修改
+    static constexpr size_t MAX_SHARED = 64; //超过该数量的属性时改用字典模式
+    static constexpr size_t MAX_TRANSITIONS = 32; //每个 Shape 的转移数量上限，避免以大量不同的键为属性名时转移树无限增长
+    static constexpr size_t LINEAR_MAX = 8; //属性不多于该数量时线性查找，否则使用 index
+    std::vector<Atom> keys;
+    bool dictionary = false;
+    bool marked = false; //本轮完整回收中有存活的对象使用
+    uint32_t pins = 0; //以该 Shape 为作用域 layout 的 Block 的数量（见 Block::getLayout），不为 0 时不释放
+    Shape() = default;
+    Shape(const Shape&) = delete;
+    int find(Atom key) const {
+        //返回槽位下标，不存在时返回 -1
+        if(keys.size() <= LINEAR_MAX){
+            for(size_t i = 0; i < keys.size(); i++){
+                if(keys[i] == key)return i;
+            }
+            return -1;
+        }
+        auto it = index.find(key);
+        return it == index.end() ? -1 : it->second;
     }
+    Shape* transition(DynamicAtoms&, Atom key, bool capped = true); //共享模式：添加 key 后的 Shape，新建时由 vm 持有 key；capped 时转移已达上限则返回 nullptr
+    size_t sweep(DynamicAtoms&); //释放子树中未标记、未固定且没有子节点的 Shape，清除其余的标记并标记其余 Shape 的键；返回释放的数量
+    Shape* toDictionary() const; //创建内容相同的字典模式 Shape
+    void append(DynamicAtoms&, Atom key); //仅用于字典模式；由 vm 持有 key
+    void remove(size_t slot); //仅用于字典模式
+    size_t bytes() const; //字典模式 Shape 占用的字节数（估计值）
+
     private:
-    Jua_Null(): Jua_Val(nullptr, Null){}
+    std::unordered_map<Atom, uint32_t> index; //属性名到槽位的映射，keys.size() > LINEAR_MAX 时有效
+    std::unordered_map<Atom, std::unique_ptr<Shape>> transitions;
+    void addKey(Atom key);
 };
-struct Jua_Obj: Jua_Val{
-    std::unordered_map<string, Jua_Val*> dict;
+
+struct Jua_Obj: Jua_Ref{
+    //属性值按 shape 中的顺序存放在 slots 中；空值表示属性不存在（仅用于 Scope 预留的槽位）
+    Shape* shape;
+    std::vector<Jua_Val> slots;
     Jua_Obj(JuaVM* vm_, Jua_Obj* p = nullptr);
     ~Jua_Obj();
-    bool hasOwn(Jua_Val* key);
-    Jua_Val* getOwn(size_t hash, const string& key); //todo
-    Jua_Val* getOwn(const string& key){
-        if(dict.contains(key))return dict[key];
-        return nullptr;
-    }
-    Jua_Val* getOwn(const char* key){
-        string str(key);
-        return getOwn(str);
+    bool hasOwn(Jua_Val key);
+    Jua_Val getOwn(Atom key){
+        int i = shape->find(key);
+        if(i < 0)return nullptr;
+        return slots[i];
     }
-    void setProp(const string& key, Jua_Val* val);
-    void delProp(const string& key);
-    Jua_Bool* hasItem(Jua_Val* key);
-    Jua_Val* getItem(Jua_Val* key);
-    void setItem(Jua_Val* key, Jua_Val* val);
-    bool isPropTrue(const char* key);
+    void setProp(Atom key, Jua_Val val);
+    void delProp(Atom key);
+    Jua_Bool hasItem(Jua_Val key);
+    Jua_Val getItem(Jua_Val key);
+    void setItem(Jua_Val key, Jua_Val val);
+    bool isPropTrue(Atom key);
     void assignProps(Jua_Obj* obj);
     string toString();
     string safeToString(); //不调用元方法
     string getTypeName(){ return "object"; }
+    void trace(JuaGC&) override;
+    size_t gcSize() override { return sizeof(Jua_Obj) + propBytes(); }
+    protected:
+    size_t propBytes();
 };
-struct Jua_Bool: Jua_Val{
-    bool value;
-    string toString(){
-        return value ? "true" : "false";
-    }
-    bool toBoolean(){ return value; }
-    string getTypeName(){ return "boolean"; }
-    void gc(){}
-    static Jua_Bool* getInst(bool v){
-        static Jua_Bool* t = new Jua_Bool(true);
-        static Jua_Bool* f = new Jua_Bool(false);
-        return v ? t : f;
-    }
-    private:
-    Jua_Bool(bool v): Jua_Val(nullptr, Bool), value(v){}
-};
-struct Jua_Num: Jua_Val{
-    double value;
-    Jua_Num(JuaVM* vm, double v);
-    Jua_Val* unm();
-    Jua_Val* add(Jua_Val*);
-    Jua_Val* sub(Jua_Val*);
-    Jua_Val* mul(Jua_Val*);
-    Jua_Val* div(Jua_Val*);
-    Jua_Bool* lt(Jua_Val*);
-    Jua_Bool* le(Jua_Val*);
-    Jua_Val* range(Jua_Val*);
-    bool operator==(Jua_Val* val);
-    string toString();
-    bool toBoolean(){ return value; }
-    int64_t toInt(){ return std::round(value); }
-    double toNumber(){ return value; }
-    string getTypeName(){ return "number"; }
-};
-struct Jua_Str: Jua_Val{
+struct Jua_Str: Jua_Ref{
     string value;
     Jua_Str(JuaVM* vm_, const string& v = "");
-    Jua_Bool* hasItem(Jua_Val*);
-    Jua_Val* getItem(Jua_Val*);
-    Jua_Val* add(Jua_Val* val);
-    bool operator==(Jua_Val *);
+    Jua_Bool hasItem(Jua_Val);
+    Jua_Val getItem(Jua_Val);
+    Jua_Val add(Jua_Val val);
+    bool operator==(Jua_Val);
     string toString(){ return value; }
     bool toBoolean(){ return value.size(); }
     string getTypeName(){ return "string"; }
+    size_t gcSize() override { return sizeof(Jua_Str) + value.capacity(); }
 };
-struct Jua_Func: Jua_Val{
-    Jua_Func(JuaVM* vm_): Jua_Val(vm_, Func){}
+struct Jua_Func: Jua_Ref{
+    Jua_Func(JuaVM* vm_): Jua_Ref(vm_, Jua_Val::Func){}
     string toString(){ return "<function>"; }
     string getTypeName(){ return "function"; }
+    size_t gcSize() override { return sizeof(Jua_Func); }
 };
 
 struct Scope: Jua_Obj{
+    //变量存放在 slots 中；由 Block 创建的作用域按 layout 预留了所有变量的槽位，空值表示尚未声明
+    //shape 仍为 layout 时（没有通过 local 等动态增删变量），变量可以按解析得到的槽位直接访问，见 Varname
     static const int type_id = 1;
     Scope* parent;
-    Scope(JuaVM* vm_, Scope* p=nullptr): Jua_Obj(vm_, p), parent(p){ if(p)p->addRef(); }
+    Shape* layout = nullptr;
+    Scope(JuaVM* vm_, Scope* p=nullptr): Jua_Obj(vm_, p), parent(p){}
     Scope(Scope* p): Scope(p->vm, p){} //从父作用域创建新作用域
-    ~Scope(){
-        if(parent)parent->release();
+    Scope(Scope* p, Shape* l): Scope(p->vm, p){
+        layout = shape = l;
+        slots.resize(l->keys.size());
     }
     bool isType(int type_id) override {
         return type_id == Scope::type_id;
     }
-    Jua_Val* inheritProp(const string&) override;
-    void assign(const string& key, Jua_Val* val){
-        for(auto scope = this; scope; scope = scope->parent){
-            if(scope->dict.contains(key)){
-                scope->setProp(key, val);
-                return;
-            }
-        }
-        throw string("Variable not found: ") + key;
-    }
+    Jua_Val inheritProp(Atom) override;
+    void assign(Atom key, Jua_Val val);
+    size_t gcSize() override { return sizeof(Scope) + propBytes(); }
 };
 struct Jua_NativeFunc: Jua_Func{
-    typedef std::function<Jua_Val*(jualist&)> Native; //可返回 nullptr
+    typedef Jua_Val (*Native)(JuaVM*, JuaArgs, void* data); //可返回空值
     Native native;
-    Jua_NativeFunc(JuaVM* vm_, Native fn): Jua_Func(vm_), native(fn){}
-    Jua_Val* call(jualist& args){
-        auto res = native(args);
-        if(res)return res;
-        return Jua_Null::getInst();
-    }
+    void* data; //原样传给 native
+    std::vector<Jua_Val> bound; //native 用到的 jua 值须放在这里，否则会被回收
+    Jua_NativeFunc(JuaVM* vm_, Native fn, void* d = nullptr): Jua_Func(vm_), native(fn), data(d){}
+    Jua_Val call(JuaArgs args);
+    void trace(JuaGC&) override;
+    size_t gcSize() override { return sizeof(Jua_NativeFunc) + bound.size() * sizeof(Jua_Val); }
 };
 struct Jua_Array: Jua_Obj{
     static const int type_id = 2;
@@ -228,50 +323,107 @@ struct Jua_Array: Jua_Obj{
     bool isType(int type_id) override {
         return type_id == Jua_Array::type_id;
     }
-    Jua_Val* getItem(Jua_Val*);
-    void setItem(Jua_Val*, Jua_Val*);
+    Jua_Val getItem(Jua_Val);
+    void setItem(Jua_Val, Jua_Val);
     JuaIterator* getIterator(Jua_Func* next=nullptr) override;
     void collectItems(jualist& list) override {
         for(auto& item : items){
             list.push_back(item);
         }
     }
+    void trace(JuaGC&) override;
+    size_t gcSize() override { return sizeof(Jua_Array) + propBytes() + items.size() * sizeof(Jua_Val); }
 };
 struct Jua_Buffer: Jua_Obj{
     static const int type_id = 3;
     uint8_t* bytes;
     size_t length;
     Jua_Buffer(JuaVM*, size_t);
-    ~Jua_Buffer(){ delete bytes; }
+    ~Jua_Buffer(){ delete[] bytes; }
     bool isType(int type_id) override {
         return type_id == Jua_Buffer::type_id;
     }
-    Jua_Val* getItem(Jua_Val*);
-    void setItem(Jua_Val*, Jua_Val*);
-    Jua_Val* read(Jua_Val* start, Jua_Val* end);
-    void write(Jua_Val* str, Jua_Val* pos=nullptr);
+    Jua_Val getItem(Jua_Val);
+    void setItem(Jua_Val, Jua_Val);
+    Jua_Val read(Jua_Val start, Jua_Val end);
+    void write(Jua_Val str, Jua_Val pos=nullptr);
+    size_t gcSize() override { return sizeof(Jua_Buffer) + propBytes() + length; }
+};
+struct Jua_Range: Jua_Obj{
+    //数值区间 start, start+step, ...，不含 end；步长可以是负数或小数，第 i 个元素按 start + i * step 计算
+    static const int type_id = 4;
+    double start;
+    double end;
+    double step;
+    Jua_Range(JuaVM*, double start, double end, double step = 1); //不检查参数，见 init
+    bool isType(int type_id) override {
+        return type_id == Jua_Range::type_id;
+    }
+    void init(double start, double end, double step); //步长为 0 时抛出错误
+    size_t length() const;
+    double at(size_t i) const { return start + i * step; }
+    Jua_Bool hasItem(Jua_Val);
+    JuaIterator* getIterator(Jua_Func* next=nullptr) override;
+    string safeToString();
+    size_t gcSize() override { return sizeof(Jua_Range) + propBytes(); }
 };
 
 struct JuaIterator{
-    virtual Jua_Val* next() = 0; //迭代完成时返回 nullptr
+    //存活期间登记在垃圾回收器中，持有的 jua 值通过 trace 标记
+    JuaGC* gc;
+    JuaIterator(JuaGC*);
+    virtual ~JuaIterator();
+    virtual Jua_Val next() = 0; //迭代完成时返回空值
+    virtual void trace(JuaGC&){}
 };
 struct JuaError{
+    //以 throw new 抛出；捕获者负责 delete，try() 捕获时转为 Error 对象，见 JuaVM::tryError
     string message;
     JuaError(string msg): message(msg){}
     JuaError(): JuaError("Unknown JuaError"){}
+    virtual ~JuaError(){}
+    virtual const char* name(){ return "JuaError"; }
+    virtual string detail(){ return message; } //Error 对象的 message
     virtual string toDebugString();
 };
 struct JuaErrorWithVal: JuaError{
-    Jua_Val* val;
-    JuaErrorWithVal(string msg, Jua_Val* v): JuaError(msg), val(v){}
-    string toDebugString(){
-        string str = message;
-        str.append("\n\twith value: ");
-        str.append(val ? val->safeToString() : "nullptr");
-        return str;
-    }
+    //抛出时即格式化 val：捕获时 val 可能已被回收，或是已弹出的帧作用域
+    JuaErrorWithVal(string msg, Jua_Val v): JuaError(msg + "\n\twith value: " + (v ? v.safeToString() : "nullptr")){}
+    string toDebugString(){ return message; }
 };
 struct JuaTypeError: JuaError{
     JuaTypeError(string msg): JuaError(msg){}
-    string toDebugString(){ return "JuaTypeError: " + message; }
-};
\ No newline at end of file
+    const char* name(){ return "JuaTypeError"; }
+};
+
+//数字的快速路径，其余情况见 value.cpp
+inline Jua_Val::JuaType Jua_Val::type() const {
+    if(isNum())return Num;
+    switch(bits & TAG_MASK){
+        case TAG_NULL: return Null;
+        case TAG_BOOL: return Bool;
+        case TAG_REF: return ref()->type;
+    }
+    throw "Jua_Val::type() called on an empty value";
+}
+inline Jua_Val Jua_Val::add(Jua_Val v) const {
+    if(isNum() && v.isNum())return Jua_Num(num() + v.num());
+    return binarySlow(&Jua_Ref::add, "try to add non-number", "Object is not addable", v);
+}
+inline Jua_Val Jua_Val::sub(Jua_Val v) const {
+    if(isNum() && v.isNum())return Jua_Num(num() - v.num());
+    return binarySlow(&Jua_Ref::sub, "try to sub non-number", "Object is not subtractable", v);
+}
+inline Jua_Val Jua_Val::mul(Jua_Val v) const {
+    if(isNum() && v.isNum())return Jua_Num(num() * v.num());
+    return binarySlow(&Jua_Ref::mul, "try to mul non-number", "Object is not multiplicable", v);
+}
+inline Jua_Val Jua_Val::div(Jua_Val v) const {
+    if(isNum() && v.isNum())return Jua_Num(num() / v.num());
+    return binarySlow(&Jua_Ref::div, "try to div non-number", "Object is not dividable", v);
+}
+inline bool Jua_Val::toBoolean() const {
+    if(isNum())return num() != 0;
+    if(auto r = ref())return r->toBoolean();
+    return bits == (TAG_BOOL | 1);
+}
@@ -1,7 +1,34 @@
 #include "jua-value.h"
+#include "jua-gc.h"
+#include "jua-bytecode.h"
+#include "jua-jit.h"
+
+struct PropCache;
+struct FrameScopeGuard;
 
 struct JuaVM{
-    std::unordered_map<string, Jua_Val*> modules;
+    DynamicAtoms atoms; //该 vm 持有的原子，Shape 中的键是其中的条目，因此最后析构
+    Shape rootShape; //空对象的 Shape，转移树的根；对象析构时会访问 Shape，因此必须比 gc 更晚析构
+    size_t cacheEpoch = 1; //增加时所有内联缓存失效，见 PropCache
+    std::vector<PropCache*> propCaches; //用过的内联缓存，用于统计
+    std::vector<Jua_Str*> literals; //字符串字面量的值，见 LiteralStr::get；始终是垃圾回收的根
+    //gc 释放函数值时可能释放语法树，其中的内联缓存和字面量会从以上两个列表中移除，因此它们须比 gc 更晚析构
+    JuaGC gc{this}; //堆值由 gc 释放，因此 gc 必须比其它成员更早析构
+    Interpreter interp{this};
+    //帧作用域栈：未被闭包捕获的函数体的作用域在调用结束后不会再被访问，按调用深度复用，见 FunctionBody::callScope
+    //栈中的作用域始终是垃圾回收的根，弹出时清空
+    std::vector<Scope*> frameScopes;
+    size_t frameDepth = 0;
+    enum Engine{
+        Bytecode, //字节码解释器，见 Interpreter
+        Tree, //树遍历解释器（Expr::calc、Statement::exec），用于对照测试
+        Closure, //语法树编译为闭包后执行，见 closure.cpp
+    };
+    Engine engine = Bytecode;
+    bool jit = JitCode::supported; //为 false 时不把热点函数编译为机器码，已编译的也不再使用
+    bool quicken = true; //为 false 时二元运算不做自特化（见 quickOperate），用于对照测试
+    bool dumpFolds = false; //为 true 时解析脚本后打印 Optimizer 折叠的常量和删除的分支
+    std::unordered_map<string, Jua_Val> modules;
 
     Scope* _G;
     Jua_Obj* classProto;
@@ -17,28 +44,29 @@ struct JuaVM{
     Jua_Obj* TryResProto;
 
     Jua_NativeFunc* obj_new;
-    Jua_NativeFunc* obj_hasOwn;
+    Jua_NativeFunc* obj_hasOwn = nullptr;
     Jua_NativeFunc* obj_next;
+    Jua_NativeFunc* fn_try; //全局的 try 和 throw，字节码解释器直接处理对它们的调用
+    Jua_NativeFunc* fn_throw;
 
     JuaVM();
-    ~JuaVM(){
-        _G->release();
-        for(auto& [name, val]: modules){
-            val->release();
-        }
-        //todo: 释放所有值
-    }
+    virtual ~JuaVM(){} //堆值由 gc 释放
     void run(const string&);
-    Jua_Val* eval(const string&); //不捕获错误
+    Jua_Val eval(const string&); //不捕获错误
+    Scope* pushFrameScope(Shape* layout, Scope* parent);
+    void popFrameScopes(size_t depth); //弹出到 depth 层
+    static JuaError* scriptError(JuaArgs args); //throw(args) 抛出的错误
+    Jua_Obj* tryResult(Jua_Val value); //try() 的结果
+    Jua_Obj* tryError(JuaError*); //try() 捕获错误的结果，释放 JuaError
 
     protected:
     void initBuiltins();
     void makeGlobal(); //在构造函数中调用，重写没有意义；要添加内置值请在子类构造函数中进行
     virtual string findModule(const string& name) = 0;
-    virtual void j_stdout(const jualist&){};
+    virtual void j_stdout(JuaArgs){};
     virtual void j_stderr(JuaError*){};
-    Jua_NativeFunc* makeFunc(Jua_NativeFunc::Native fn){
-        return new Jua_NativeFunc(this, fn);
+    Jua_NativeFunc* makeFunc(Jua_NativeFunc::Native fn, void* data = nullptr){
+        return new Jua_NativeFunc(this, fn, data);
     }
     Jua_Obj* buildClass(Jua_NativeFunc::Native constructor);
     Jua_Obj* makeRangeProto();
@@ -54,12 +82,20 @@ struct JuaVM{
 
     Jua_Obj* makeMath();
     Jua_Obj* makeJSON();
+    Jua_Obj* makeGC();
 
     private:
     size_t idcounter = 0;
-    Jua_Val* require(const string& name);
+    Jua_Val require(const string& name);
     typedef string Encoder(double);
     typedef double Decoder(const string&);
     Jua_NativeFunc* makeEncodeFunc(Encoder);
     Jua_NativeFunc* makeDecodeFunc(Decoder);
-};
\ No newline at end of file
+};
+struct FrameScopeGuard{
+    //离开 C++ 作用域（包括抛出错误）时弹出期间压入的帧作用域
+    JuaVM* vm;
+    size_t depth;
+    FrameScopeGuard(JuaVM* v): vm(v), depth(v->frameDepth){}
+    ~FrameScopeGuard(){ vm->popFrameScopes(depth); }
+};
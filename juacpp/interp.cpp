@@ -0,0 +1,493 @@
+#include "jua-syntax.h"
+#include "jua-vm.h"
+
+Jua_Val Interpreter::call(Jua_PFunc* fn, JuaArgs args){
+    //同 Jua_PFunc::call 的树遍历版本
+    RootGuard guard(vm->gc);
+    guard.push(fn);
+    FrameScopeGuard frame(vm);
+    auto env = fn->body->callScope(fn->upenv);
+    guard.push(env); //参数的默认值可能执行脚本
+    fn->decList->rawDeclare(env, args);
+    return run(compile(fn->body, fn->decList), env);
+}
+Jua_Val Interpreter::run(FunctionBody* body, Scope* env){
+    return run(compile(body, nullptr), env);
+}
+Jua_Val Interpreter::run(Proto* proto, Scope* env){
+    auto& regs = vm->gc.registers;
+    size_t entry = frames.size();
+    size_t base = regs.size();
+    size_t iterBase = iters.size();
+    size_t frameDepth = vm->frameDepth;
+    try{
+        enter(proto, env, 0, frameDepth);
+        return execute(entry);
+    }catch(...){
+        //抛出错误时丢弃本次 run 的所有帧
+        frames.resize(entry);
+        regs.resize(base);
+        vm->popFrameScopes(frameDepth);
+        while(iters.size() > iterBase){
+            delete iters.back();
+            iters.pop_back();
+        }
+        throw;
+    }
+}
+void Interpreter::enter(Proto* proto, Scope* env, uint32_t ret, size_t frameDepth, bool guarded){
+    auto& gc = vm->gc;
+    size_t base = gc.registers.size();
+    gc.pushRegisters(proto->nregs)[0] = env;
+    frames.push_back({proto, proto->code.data(), base, iters.size(), ret, frameDepth, guarded});
+}
+void Interpreter::tailCall(Jua_PFunc* fn, Proto* callee, JuaArgs args){
+    //当前帧已经结束：释放它的迭代器和帧作用域，在原位置进入被调函数，返回值仍写入调用者的 ret
+    //参数还在当前帧的寄存器中，声明之后才重置寄存器窗口；声明参数可能执行脚本，期间 frames 可能重新分配
+    auto& gc = vm->gc;
+    size_t base = frames.back().base;
+    size_t frameDepth = frames.back().frameDepth;
+    while(iters.size() > frames.back().iterBase){
+        delete iters.back();
+        iters.pop_back();
+    }
+    vm->popFrameScopes(frameDepth);
+    auto env = fn->body->callScope(fn->upenv);
+    gc.registers[base] = env;
+    if(callee->simpleParams){
+        auto& params = callee->params;
+        for(size_t k = 0; k < params.size(); k++){
+            if(k >= args.size())throw new JuaError("Missing argument");
+            params[k]->Varname::declare(env, args[k]);
+        }
+    }else{
+        fn->decList->rawDeclare(env, args);
+    }
+    gc.registers.resize(base);
+    //多出的最后一个寄存器存放被调函数：它可能已不被其他值引用，须保持其语法树存活（见 SyntaxTree）
+    auto R = gc.pushRegisters(callee->nregs + 1);
+    R[0] = env;
+    R[callee->nregs] = fn;
+    auto& frame = frames.back();
+    frame.proto = callee;
+    frame.pc = callee->code.data();
+}
+void Interpreter::leave(){
+    auto& frame = frames.back();
+    while(iters.size() > frame.iterBase){
+        delete iters.back();
+        iters.pop_back();
+    }
+    vm->gc.registers.resize(frame.base);
+    vm->popFrameScopes(frame.frameDepth);
+    frames.pop_back();
+}
+
+//自特化：按首次观察到的操作数类型原地改写二元运算指令（Proto::code 可写，pc 为 const 只是防止误改）
+static void quicken(const Instr& i, BinOper oper, Quick site){
+    auto& instr = const_cast<Instr&>(i);
+    if(site == Quick::str){
+        instr.op = Op::ADD_SS;
+        return;
+    }
+    if(site == Quick::num){
+        switch(oper){
+            case BinOper::add: instr.op = Op::ADD_NN; return;
+            case BinOper::sub: instr.op = Op::SUB_NN; return;
+            case BinOper::mul: instr.op = Op::MUL_NN; return;
+            case BinOper::div: instr.op = Op::DIV_NN; return;
+            case BinOper::lt: instr.op = Op::LT_NN; return;
+            case BinOper::le: instr.op = Op::LE_NN; return;
+            case BinOper::gt: instr.op = Op::GT_NN; return;
+            case BinOper::ge: instr.op = Op::GE_NN; return;
+            case BinOper::eq: instr.op = Op::EQ_NN; return;
+            case BinOper::ne: instr.op = Op::NE_NN; return;
+            default: break;
+        }
+    }
+    instr.generic = true;
+}
+//守卫失败：改回通用指令，不再特化
+static Jua_Val deopt(JuaVM* vm, const Instr& i, BinOper oper, Jua_Val left, Jua_Val right){
+    auto& instr = const_cast<Instr&>(i);
+    instr.op = Op(int(Op::POW) + int(oper));
+    instr.generic = true;
+    return operate(vm, oper, left, right);
+}
+
+bool Interpreter::catchError(JuaError* e, size_t entry){
+    //frames[entry] 由 run 进入，不会是 try 帧
+    for(size_t k = frames.size(); k > entry + 1; k--){
+        if(!frames[k - 1].guarded)continue;
+        auto ret = frames[k - 1].ret;
+        while(frames.size() >= k)leave();
+        auto res = vm->tryError(e);
+        vm->gc.registers[frames.back().base + ret] = res;
+        return true;
+    }
+    return false;
+}
+Jua_Val Interpreter::execute(size_t entry){
+    //被本次 run 中的 try 帧捕获的错误回到分派循环，不再向外展开
+    for(;;){
+        try{
+            return dispatch(entry);
+        }catch(JuaError* e){
+            if(!catchError(e, entry))throw;
+        }
+    }
+}
+Jua_Val Interpreter::dispatch(size_t entry){
+    auto& gc = vm->gc;
+    Proto* proto;
+    const Instr* pc;
+    Jua_Val* R; //当前帧的寄存器窗口；gc.registers 不会重新分配，指针在调用期间保持有效
+    Scope* env;
+    JitCode* native; //当前帧的机器码
+    auto load = [&](){
+        auto& frame = frames.back();
+        proto = frame.proto;
+        pc = frame.pc;
+        R = gc.registers.data() + frame.base;
+        env = static_cast<Scope*>(R[0].ref());
+        native = vm->jit ? proto->jit : nullptr;
+    };
+    auto heat = [&](Proto* p){
+        //调用和循环回跳时计数，达到阈值时编译；不支持的平台上 compile 返回 nullptr
+        if(!p->jit && ++p->hotness == JIT_THRESHOLD && vm->jit)p->jit = JitCode::compile(p);
+    };
+    load();
+    for(;;){
+        //机器码执行到不支持的指令时返回，由下面的 switch 执行这一条指令
+        if(native)pc = proto->code.data() + native->run(R, vm, pc - proto->code.data());
+        const Instr& i = *pc++;
+        switch(i.op){
+            case Op::MOVE:
+                R[i.a] = R[i.b];
+                break;
+            case Op::LOADK:
+                R[i.a] = proto->consts[i.b];
+                break;
+            case Op::LOADSTR:
+                R[i.a] = static_cast<LiteralStr*>(proto->nodes[i.b])->get(vm);
+                break;
+            case Op::LOADENV:
+                R[i.a] = env;
+                break;
+            case Op::GETVAR:{
+                //Varname::calc 的快速路径：途中的作用域都未被动态修改，且变量已声明
+                auto var = static_cast<Varname*>(proto->nodes[i.b]);
+                auto scope = env;
+                int depth = var->depth;
+                while(depth > 0 && scope->shape == scope->layout && scope->parent){
+                    scope = scope->parent;
+                    depth--;
+                }
+                Jua_Val val;
+                if(depth == 0 && var->slot >= 0 && scope->shape == scope->layout)val = scope->slots[var->slot];
+                R[i.a] = val ? val : var->calc(env);
+                break;
+            }
+            case Op::SETVAR:
+                static_cast<Varname*>(proto->nodes[i.b])->Varname::assign(env, R[i.a]);
+                break;
+            case Op::DECLVAR:
+                static_cast<Varname*>(proto->nodes[i.b])->Varname::declare(env, R[i.a]);
+                break;
+            case Op::DECLARE:
+                static_cast<Declarable*>(proto->nodes[i.b])->declare(env, R[i.a]);
+                break;
+            case Op::ASSIGN:
+                static_cast<LeftValue*>(proto->nodes[i.b])->assign(env, R[i.a]);
+                break;
+            case Op::EVAL:
+                R[i.a] = static_cast<Expr*>(proto->nodes[i.b])->calc(env);
+                break;
+            case Op::GETPROP:{
+                auto ref = static_cast<PropRef*>(proto->nodes[i.c]);
+                auto val = ref->cache.get(vm, R[i.b]);
+                if(!val)throw new JuaError(std::format("no property: {}", ref->prop.str()));
+                R[i.a] = val;
+                break;
+            }
+            case Op::GETOPT:{
+                auto ref = static_cast<OptionalPropRef*>(proto->nodes[i.c]);
+                auto val = ref->cache.get(vm, R[i.b]);
+                R[i.a] = val ? val : Jua_Null::getInst();
+                break;
+            }
+            case Op::SETPROP:{
+                auto tar = R[i.a];
+                if(tar.type() != Jua_Val::Obj)throw new JuaError("not an object");
+                tar.as<Jua_Obj>()->setProp(static_cast<PropRef*>(proto->nodes[i.c])->prop, R[i.b]);
+                break;
+            }
+            case Op::METHOD:
+                R[i.a] = static_cast<MethWrapper*>(proto->nodes[i.c])->wrap(vm, R[i.b]);
+                break;
+            case Op::GETMETH:
+                R[i.a] = static_cast<MethWrapper*>(proto->nodes[i.c])->lookup(vm, R[i.b]);
+                break;
+            case Op::GETITEM:
+                R[i.a] = R[i.b].getItem(R[i.c]);
+                break;
+            case Op::SETITEM:
+                R[i.a].setItem(R[i.b], R[i.c]);
+                break;
+            case Op::NEWOBJ:
+                R[i.a] = new Jua_Obj(vm);
+                break;
+            case Op::SETKEY:{
+                auto key = R[i.b];
+                if(key.type() != Jua_Val::Str)throw new JuaError("non-string key");
+                R[i.a].as<Jua_Obj>()->setProp(Atom::dynamic(vm, key.toString()), R[i.c]);
+                break;
+            }
+            case Op::SETATOM:
+                R[i.a].as<Jua_Obj>()->setProp(proto->atoms[i.c], R[i.b]);
+                break;
+            case Op::NEWARRAY:
+                R[i.a] = new Jua_Array(vm, jualist(R + i.b, R + i.b + i.c));
+                break;
+            case Op::TOSTR:
+                if(R[i.a].type() == Jua_Val::Obj)R[i.a] = new Jua_Str(vm, R[i.a].toString());
+                break;
+            case Op::TEMPLATE:{
+                auto& strList = static_cast<Template*>(proto->nodes[i.c])->strList;
+                string str = strList[0];
+                for(size_t k = 1; k < strList.size(); k++){
+                    str += R[i.b + k - 1].toString();
+                    str += strList[k];
+                }
+                R[i.a] = new Jua_Str(vm, str);
+                break;
+            }
+            case Op::CLOSURE:{
+                auto fe = static_cast<FunExpr*>(proto->nodes[i.b]);
+                R[i.a] = new Jua_PFunc(env, fe->decList, fe->body);
+                break;
+            }
+            case Op::UNM:
+                R[i.a] = operate(UniOper::unm, R[i.b]);
+                break;
+            case Op::NOT:
+                R[i.a] = Jua_Bool::getInst(!R[i.b].toBoolean());
+                break;
+            case Op::ADD: case Op::SUB: case Op::MUL: case Op::DIV:
+            case Op::LT: case Op::LE: case Op::GT: case Op::GE: case Op::EQ: case Op::NE:{
+                auto oper = BinOper(int(i.op) - int(Op::POW));
+                auto l = R[i.b], r = R[i.c];
+                if(!i.generic)quicken(i, oper, vm->quicken ? observe(oper, l, r) : Quick::generic);
+                R[i.a] = operate(vm, oper, l, r);
+                break;
+            }
+            case Op::POW: case Op::MOD: case Op::RANGE:
+            case Op::IN: case Op::IS: case Op::AND: case Op::OR:
+                R[i.a] = operate(vm, BinOper(int(i.op) - int(Op::POW)), R[i.b], R[i.c]);
+                break;
+            //以下各指令的守卫都只检查操作数类型，结果与 operateNum 一致
+            case Op::ADD_NN:{
+                auto l = R[i.b], r = R[i.c];
+                if(l.isNum() && r.isNum())R[i.a] = Jua_Num(l.num() + r.num());
+                else R[i.a] = deopt(vm, i, BinOper::add, l, r);
+                break;
+            }
+            case Op::SUB_NN:{
+                auto l = R[i.b], r = R[i.c];
+                if(l.isNum() && r.isNum())R[i.a] = Jua_Num(l.num() - r.num());
+                else R[i.a] = deopt(vm, i, BinOper::sub, l, r);
+                break;
+            }
+            case Op::MUL_NN:{
+                auto l = R[i.b], r = R[i.c];
+                if(l.isNum() && r.isNum())R[i.a] = Jua_Num(l.num() * r.num());
+                else R[i.a] = deopt(vm, i, BinOper::mul, l, r);
+                break;
+            }
+            case Op::DIV_NN:{
+                auto l = R[i.b], r = R[i.c];
+                if(l.isNum() && r.isNum())R[i.a] = Jua_Num(l.num() / r.num());
+                else R[i.a] = deopt(vm, i, BinOper::div, l, r);
+                break;
+            }
+            case Op::LT_NN:{
+                auto l = R[i.b], r = R[i.c];
+                if(l.isNum() && r.isNum())R[i.a] = Jua_Bool::getInst(l.num() < r.num());
+                else R[i.a] = deopt(vm, i, BinOper::lt, l, r);
+                break;
+            }
+            case Op::LE_NN:{
+                auto l = R[i.b], r = R[i.c];
+                if(l.isNum() && r.isNum())R[i.a] = Jua_Bool::getInst(l.num() <= r.num());
+                else R[i.a] = deopt(vm, i, BinOper::le, l, r);
+                break;
+            }
+            case Op::GT_NN:{
+                auto l = R[i.b], r = R[i.c];
+                if(l.isNum() && r.isNum())R[i.a] = Jua_Bool::getInst(!(l.num() <= r.num()));
+                else R[i.a] = deopt(vm, i, BinOper::gt, l, r);
+                break;
+            }
+            case Op::GE_NN:{
+                auto l = R[i.b], r = R[i.c];
+                if(l.isNum() && r.isNum())R[i.a] = Jua_Bool::getInst(!(l.num() < r.num()));
+                else R[i.a] = deopt(vm, i, BinOper::ge, l, r);
+                break;
+            }
+            case Op::EQ_NN:{
+                auto l = R[i.b], r = R[i.c];
+                if(l.isNum() && r.isNum())R[i.a] = Jua_Bool::getInst(l.num() == r.num());
+                else R[i.a] = deopt(vm, i, BinOper::eq, l, r);
+                break;
+            }
+            case Op::NE_NN:{
+                auto l = R[i.b], r = R[i.c];
+                if(l.isNum() && r.isNum())R[i.a] = Jua_Bool::getInst(l.num() != r.num());
+                else R[i.a] = deopt(vm, i, BinOper::ne, l, r);
+                break;
+            }
+            case Op::ADD_SS:{
+                auto l = R[i.b], r = R[i.c];
+                if(l.type() == Jua_Val::Str && r.type() == Jua_Val::Str)
+                    R[i.a] = new Jua_Str(vm, l.as<Jua_Str>()->value + r.as<Jua_Str>()->value);
+                else R[i.a] = deopt(vm, i, BinOper::add, l, r);
+                break;
+            }
+            case Op::JMP:
+                pc = proto->code.data() + i.a;
+                if(pc <= &i){
+                    //循环回跳：编译后下一次迭代即进入机器码
+                    heat(proto);
+                    native = vm->jit ? proto->jit : nullptr;
+                }
+                break;
+            case Op::JMPF:
+                if(!R[i.a].toBoolean())pc = proto->code.data() + i.b;
+                break;
+            case Op::JMPT:
+                if(R[i.a].toBoolean())pc = proto->code.data() + i.b;
+                break;
+            case Op::JEQ:
+                if(R[i.a].equals(R[i.b]))pc = proto->code.data() + i.c;
+                break;
+            case Op::SWITCH:
+                pc += static_cast<SwitchStmt*>(proto->nodes[i.b])->lookup(R[i.a]) + 1;
+                break;
+            case Op::ENTER:{
+                auto block = static_cast<Block*>(proto->nodes[i.a]);
+                if(i.b){
+                    R[0] = env = block->enter(env, static_cast<Scope*>(R[i.b].ref()));
+                    R[i.b] = env;
+                }else{
+                    R[0] = env = block->newScope(env);
+                }
+                break;
+            }
+            case Op::LEAVE:
+                for(uint32_t k = 0; k < i.a; k++){
+                    env = env->parent;
+                }
+                R[0] = env;
+                break;
+            case Op::ITER:
+                if(R[i.a].isType(Jua_Range::type_id)){
+                    //计数循环：状态都是数字，存放在寄存器中
+                    auto range = R[i.a].as<Jua_Range>();
+                    R[i.a + 1] = Jua_Num(range->start);
+                    R[i.a + 2] = Jua_Num(range->step);
+                    R[i.a + 3] = Jua_Num(range->length());
+                    R[i.a + 4] = Jua_Num(0);
+                    break;
+                }
+                R[i.a + 1] = nullptr;
+                iters.push_back(R[i.a].getIterator(vm->obj_next)); //迭代器持有被迭代的值
+                break;
+            case Op::NEXT:{
+                if(R[i.a + 1]){
+                    double k = R[i.a + 4].num();
+                    if(k >= R[i.a + 3].num()){
+                        pc = proto->code.data() + i.b;
+                    }else{
+                        R[i.a] = Jua_Num(R[i.a + 1].num() + size_t(k) * R[i.a + 2].num());
+                        R[i.a + 4] = Jua_Num(k + 1);
+                    }
+                    break;
+                }
+                auto val = iters.back()->next();
+                if(val){
+                    R[i.a] = val;
+                }else{
+                    delete iters.back();
+                    iters.pop_back();
+                    pc = proto->code.data() + i.b;
+                }
+                break;
+            }
+            case Op::ITERPOP:
+                if(R[i.a + 1])break;
+                delete iters.back();
+                iters.pop_back();
+                break;
+            case Op::CHECK:
+                gc.check();
+                break;
+            case Op::CALL: case Op::TAILCALL:{
+                auto fn = R[i.b];
+                auto r = fn.ref();
+                Jua_Val* argv = R + i.b + 2;
+                uint32_t argc = i.c;
+                bool guarded = false;
+                if(r == vm->fn_try && argc && argv[0].ref() && isScriptFunc(argv[0].ref())){
+                    //try(f, ...)：f 在 try 帧中执行，不经过原生的 try
+                    r = argv[0].ref();
+                    argv++;
+                    argc--;
+                    guarded = true;
+                }else if(r == vm->fn_throw){
+                    //throw(msg)：能在本次 run 中捕获时不抛出 C++ 异常
+                    auto e = JuaVM::scriptError(JuaArgs(argv, argc));
+                    if(!catchError(e, entry))throw e;
+                    load();
+                    break;
+                }
+                if(!r || !isScriptFunc(r)){
+                    R[i.a] = fn.call(JuaArgs(argv, argc, 1));
+                    break;
+                }
+                //脚本函数：压入新帧，不递归
+                auto pfn = static_cast<Jua_PFunc*>(r);
+                auto callee = compile(pfn->body, pfn->decList);
+                heat(callee);
+                if(i.op == Op::TAILCALL && !guarded){
+                    tailCall(pfn, callee, JuaArgs(argv, argc));
+                    load();
+                    break;
+                }
+                frames.back().pc = pc;
+                size_t frameDepth = vm->frameDepth;
+                enter(callee, pfn->body->callScope(pfn->upenv), i.a, frameDepth, guarded);
+                load();
+                if(callee->simpleParams){
+                    auto& params = callee->params;
+                    for(size_t k = 0; k < params.size(); k++){
+                        if(k >= argc)throw new JuaError("Missing argument");
+                        params[k]->Varname::declare(env, argv[k]);
+                    }
+                }else{
+                    pfn->decList->rawDeclare(env, JuaArgs(argv, argc));
+                }
+                break;
+            }
+            case Op::RET:{
+                auto val = R[i.a];
+                auto ret = frames.back().ret;
+                bool guarded = frames.back().guarded;
+                leave();
+                if(frames.size() == entry)return val;
+                load();
+                R[ret] = guarded ? vm->tryResult(val) : val;
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,546 @@
+#include "jua-syntax.h"
+#include "jua-vm.h"
+#include "jua-jit.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <cstring>
+#include <algorithm>
+
+const bool JitCode::supported = true;
+
+//运行时的快速路径，由机器码调用；返回 false 时机器码返回，由解释器执行该指令
+//与 Interpreter 中对应指令的快速路径一致，都不分配堆值、不抛出异常
+typedef bool (*Helper)(Jua_Val* R, JuaVM* vm, const Instr& i, void* node);
+
+static Scope* target(Scope* env, int depth){
+    //同 Varname::target：途中的作用域被动态修改过时返回 nullptr
+    if(depth < 0)return nullptr;
+    for(; depth > 0; depth--){
+        if(env->shape != env->layout || !env->parent)return nullptr;
+        env = env->parent;
+    }
+    return env;
+}
+static bool getVar(Jua_Val* R, JuaVM*, const Instr& i, void* node) noexcept {
+    auto var = static_cast<Varname*>(node);
+    auto scope = target(static_cast<Scope*>(R[0].ref()), var->depth);
+    if(!scope || var->slot < 0 || scope->shape != scope->layout)return false;
+    auto val = scope->slots[var->slot];
+    if(!val)return false;
+    R[i.a] = val;
+    return true;
+}
+static bool setVar(Jua_Val* R, JuaVM* vm, const Instr& i, void* node) noexcept {
+    auto var = static_cast<Varname*>(node);
+    auto scope = target(static_cast<Scope*>(R[0].ref()), var->depth);
+    if(!scope || var->slot < 0 || scope->shape != scope->layout || !scope->slots[var->slot])return false;
+    vm->gc.barrier(scope, R[i.a]);
+    scope->slots[var->slot] = R[i.a];
+    return true;
+}
+static bool declVar(Jua_Val* R, JuaVM* vm, const Instr& i, void* node) noexcept {
+    auto var = static_cast<Varname*>(node);
+    auto env = static_cast<Scope*>(R[0].ref());
+    if(var->depth != 0 || var->slot < 0 || env->shape != env->layout)return false;
+    vm->gc.barrier(env, R[i.a]);
+    env->slots[var->slot] = R[i.a];
+    return true;
+}
+static void record(JitCode::SlotCache* site, JuaVM* vm, Jua_Obj* obj, int slot){
+    //机器码中的守卫只比较 Shape，字典模式的 Shape 会就地增删属性，不能记录
+    if(obj->shape->dictionary)return;
+    site->shape = obj->shape;
+    site->offset = slot * sizeof(Jua_Val);
+    site->epoch = vm->cacheEpoch;
+}
+static bool getProp(Jua_Val* R, JuaVM* vm, const Instr& i, void* node) noexcept {
+    auto site = static_cast<JitCode::SlotCache*>(node);
+    auto ref = static_cast<PropRef*>(site->node);
+    auto r = R[i.b].ref();
+    if(r && r->type == Jua_Val::Obj){
+        //自身的属性总是优先（见 Jua_Ref::getProp）；Scope 中的空槽位表示变量尚未声明，需按名称继续查找
+        auto obj = static_cast<Jua_Obj*>(r);
+        int slot = obj->shape->find(ref->prop);
+        if(slot >= 0 && obj->slots[slot]){
+            record(site, vm, obj, slot);
+            R[i.a] = obj->slots[slot];
+            return true;
+        }
+    }
+    auto val = ref->cache.peek(vm, R[i.b]);
+    if(!val)return false;
+    R[i.a] = val;
+    return true;
+}
+static bool setProp(Jua_Val* R, JuaVM* vm, const Instr& i, void* node) noexcept {
+    //只处理已有的属性；添加属性会改变 Shape，交给 Jua_Obj::setProp
+    auto site = static_cast<JitCode::SlotCache*>(node);
+    auto r = R[i.a].ref();
+    if(!r || r->type != Jua_Val::Obj)return false;
+    auto key = static_cast<PropRef*>(site->node)->prop;
+    if(key == atoms::super || key == atoms::_class)return false;
+    auto obj = static_cast<Jua_Obj*>(r);
+    int slot = obj->shape->find(key);
+    if(slot < 0)return false;
+    vm->gc.barrier(obj, R[i.b]);
+    obj->slots[slot] = R[i.b];
+    record(site, vm, obj, slot);
+    return true;
+}
+static bool safepoint(Jua_Val*, JuaVM* vm, const Instr&, void*) noexcept {
+    return !vm->gc.due();
+}
+
+//机器码直接读写的字段；Jua_Obj 有虚函数，不是标准布局，offsetof 依赖 GCC 的实现
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winvalid-offsetof"
+static const int32_t TYPE = offsetof(Jua_Ref, type);
+static const int32_t SHAPE = offsetof(Jua_Obj, shape);
+static const int32_t SLOTS = offsetof(Jua_Obj, slots); //std::vector 的首个成员是指向元素的指针，见 inlineSlots
+static const int32_t PARENT = offsetof(Scope, parent);
+static const int32_t LAYOUT = offsetof(Scope, layout);
+static const int32_t EPOCH = offsetof(JuaVM, cacheEpoch);
+#pragma GCC diagnostic pop
+static_assert(sizeof(Jua_Val::JuaType) == 4 && Jua_Val::Obj == 0);
+static bool vectorDataFirst(){
+    std::vector<Jua_Val> v(1);
+    return *reinterpret_cast<Jua_Val**>(&v) == v.data();
+}
+static const bool inlineSlots = vectorDataFirst(); //否则变量和属性访问总是调用快速路径
+
+namespace{
+
+enum Gpr: uint8_t{ RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+enum Cond: uint8_t{ B = 0x2, AE = 0x3, E = 0x4, NE = 0x5, BE = 0x6, A = 0x7, P = 0xA, NP = 0xB };
+
+struct Assembler{
+    //只包含模板用到的指令；内存操作数总是 [rbx + disp32]，即寄存器窗口 R 中的槽位
+    std::vector<uint8_t> buf;
+    size_t here(){ return buf.size(); }
+    void byte(uint8_t b){ buf.push_back(b); }
+    void bytes(std::initializer_list<uint8_t> bs){ buf.insert(buf.end(), bs); }
+    void u32(uint32_t v){ for(int k = 0; k < 4; k++)byte(v >> (k * 8)); }
+    void u64(uint64_t v){ for(int k = 0; k < 8; k++)byte(v >> (k * 8)); }
+    void slot(uint8_t reg, uint32_t r){ byte(0x80 | (reg & 7) << 3 | RBX); u32(r * sizeof(Jua_Val)); }
+    //字段访问 [base + disp32]，base 不能是 rsp 和 r12（需要 SIB 字节）
+    void field(uint8_t reg, Gpr base, int32_t disp){ byte(0x80 | (reg & 7) << 3 | (base & 7)); u32(disp); }
+    void rex(uint8_t reg, Gpr base){ byte(0x48 | (reg >> 3) << 2 | base >> 3); }
+
+    void movImm(Gpr r, uint64_t imm){ byte(0x48 | (r >> 3)); byte(0xB8 | (r & 7)); u64(imm); }
+    void load(Gpr r, uint32_t reg){ byte(0x48 | (r >> 3) << 2); byte(0x8B); slot(r, reg); }
+    void store(uint32_t reg, Gpr r){ byte(0x48 | (r >> 3) << 2); byte(0x89); slot(r, reg); }
+    void movRR(Gpr dst, Gpr src){ byte(0x48 | (src >> 3) << 2 | dst >> 3); byte(0x89); byte(0xC0 | (src & 7) << 3 | (dst & 7)); }
+    void loadField(Gpr r, Gpr base, int32_t disp){ rex(r, base); byte(0x8B); field(r, base, disp); }
+    void storeField(Gpr base, int32_t disp, Gpr r){ rex(r, base); byte(0x89); field(r, base, disp); }
+    void addField(Gpr r, Gpr base, int32_t disp){ rex(r, base); byte(0x03); field(r, base, disp); } //r += [base + disp]
+    void cmpField(Gpr r, Gpr base, int32_t disp){ rex(r, base); byte(0x3B); field(r, base, disp); } //r - [base + disp]
+    void cmpField32(Gpr base, int32_t disp, uint32_t imm){ if(base >> 3)byte(0x41); byte(0x81); field(7, base, disp); u32(imm); }
+    void cmp32(Gpr r, uint32_t imm){ if(r >> 3)byte(0x41); byte(0x81); byte(0xF8 | (r & 7)); u32(imm); }
+    void shl(Gpr r, uint8_t n){ byte(0x48 | r >> 3); byte(0xC1); byte(0xE0 | (r & 7)); byte(n); }
+    void shr(Gpr r, uint8_t n){ byte(0x48 | r >> 3); byte(0xC1); byte(0xE8 | (r & 7)); byte(n); }
+    void cmp(Gpr a, Gpr b){ byte(0x48 | (b >> 3) << 2 | a >> 3); byte(0x39); byte(0xC0 | (b & 7) << 3 | (a & 7)); } //a - b
+    void loadsd(uint8_t x, uint32_t reg){ bytes({0xF2, 0x0F, 0x10}); slot(x, reg); }
+    void storesd(uint32_t reg, uint8_t x){ bytes({0xF2, 0x0F, 0x11}); slot(x, reg); }
+    void sse(uint8_t op, uint8_t x, uint8_t y){ bytes({0xF2, 0x0F, op, uint8_t(0xC0 | x << 3 | y)}); } //addsd 等
+    void ucomisd(uint8_t x, uint8_t y){ bytes({0x66, 0x0F, 0x2E, uint8_t(0xC0 | x << 3 | y)}); }
+    void xorpd(uint8_t x, uint8_t y){ bytes({0x66, 0x0F, 0x57, uint8_t(0xC0 | x << 3 | y)}); }
+    void movqToX(uint8_t x, Gpr r){ bytes({0x66, 0x48, 0x0F, 0x6E, uint8_t(0xC0 | x << 3 | r)}); } //仅 r < 8
+    void movqFromX(Gpr r, uint8_t x){ bytes({0x66, 0x48, 0x0F, 0x7E, uint8_t(0xC0 | x << 3 | r)}); }
+    void setcc(Cond c, Gpr r8){ bytes({0x0F, uint8_t(0x90 | c), uint8_t(0xC0 | r8)}); } //al 或 cl
+    void callRax(){ bytes({0xFF, 0xD0}); }
+    size_t jcc(Cond c){ bytes({0x0F, uint8_t(0x80 | c)}); u32(0); return here() - 4; } //返回待回填的位移
+    size_t jmp(){ byte(0xE9); u32(0); return here() - 4; }
+    void bind(size_t patch, size_t target){
+        uint32_t rel = target - (patch + 4);
+        memcpy(&buf[patch], &rel, 4);
+    }
+    void bind(size_t patch){ bind(patch, here()); }
+};
+
+struct Translator{
+    //逐条翻译 Proto::code；labels 为各条指令的机器码偏移，exits 为跳到“返回指令 k”的回填位置
+    //寄存器约定：rbx = R，r12 = vm，r13 = TAG_NULL（小于它的是数字）
+    Proto* proto;
+    JitCode* code;
+    Assembler as;
+    std::vector<size_t> labels;
+    std::vector<std::pair<size_t, size_t>> jumps; //(回填位置, 目标指令)
+    std::vector<std::pair<size_t, size_t>> exits; //(回填位置, 指令)
+    size_t epilogue;
+    size_t k; //正在翻译的指令
+    size_t sites = 0; //已使用的 code->slotCaches
+    std::vector<size_t> slow; //当前指令的内联路径中守卫失败时的回填位置，跳到调用快速路径处
+
+    void exit(Cond c){ exits.push_back({as.jcc(c), k}); }
+    void exit(){ exits.push_back({as.jmp(), k}); }
+    void jumpTo(size_t target){ jumps.push_back({as.jmp(), target}); }
+    void jumpTo(Cond c, size_t target){ jumps.push_back({as.jcc(c), target}); }
+    void guardNum(Gpr r){
+        as.cmp(r, R13);
+        exit(AE);
+    }
+    void storeNum(uint32_t dst){
+        //xmm0 写入 dst，NaN 规范化（同 Jua_Num）
+        as.ucomisd(0, 0);
+        size_t ok = as.jcc(NP);
+        as.movImm(RAX, Jua_Val::NAN_BITS);
+        as.movqToX(0, RAX);
+        as.bind(ok);
+        as.storesd(dst, 0);
+    }
+    void storeBool(uint32_t dst){
+        //al 为 0 或 1
+        as.bytes({0x0F, 0xB6, 0xC0}); //movzx eax, al
+        as.movImm(RCX, Jua_Val::TAG_BOOL);
+        as.bytes({0x48, 0x09, 0xC8}); //or rax, rcx
+        as.store(dst, RAX);
+    }
+    void truth(uint32_t reg){
+        //al = reg 的布尔值（同 Jua_Val::toBoolean）；堆值的 toBoolean 是虚函数，交给解释器
+        as.load(RAX, reg);
+        as.movImm(RCX, Jua_Val::TAG_BOOL | 1);
+        as.cmp(RAX, RCX);
+        size_t isTrue = as.jcc(E);
+        as.movImm(RCX, Jua_Val::TAG_BOOL);
+        as.cmp(RAX, RCX);
+        size_t isFalse = as.jcc(E);
+        as.movImm(RCX, Jua_Val::TAG_NULL);
+        as.cmp(RAX, RCX);
+        size_t isNull = as.jcc(E);
+        guardNum(RAX);
+        as.movqToX(0, RAX);
+        as.xorpd(1, 1);
+        as.ucomisd(0, 1);
+        as.setcc(NE, RAX);
+        as.setcc(P, RCX);
+        as.bytes({0x08, 0xC8}); //or al, cl：num() != 0，NaN 为真
+        size_t done = as.jmp();
+        as.bind(isTrue);
+        as.bytes({0xB8, 1, 0, 0, 0}); //mov eax, 1
+        size_t done2 = as.jmp();
+        as.bind(isFalse);
+        as.bind(isNull);
+        as.bytes({0x31, 0xC0}); //xor eax, eax
+        as.bind(done);
+        as.bind(done2);
+    }
+    void call(Helper fn, const Instr& i, void* node){
+        as.movRR(RDI, RBX);
+        as.movRR(RSI, R12);
+        as.movImm(RDX, reinterpret_cast<uint64_t>(&i));
+        as.movImm(RCX, reinterpret_cast<uint64_t>(node));
+        as.movImm(RAX, reinterpret_cast<uint64_t>(fn));
+        as.callRax();
+        as.bytes({0x84, 0xC0}); //test al, al
+        exit(E);
+    }
+    void guardRef(Gpr r){
+        //r 为堆值时去掉标记，得到 Jua_Ref*
+        as.movRR(RCX, r);
+        as.shr(RCX, 48);
+        as.cmp32(RCX, Jua_Val::TAG_REF >> 48);
+        slow.push_back(as.jcc(NE));
+        as.shl(r, 16);
+        as.shr(r, 16);
+    }
+    void guardNotRef(Gpr r){
+        //写入堆值需要写屏障
+        as.movRR(RCX, r);
+        as.shr(RCX, 48);
+        as.cmp32(RCX, Jua_Val::TAG_REF >> 48);
+        slow.push_back(as.jcc(E));
+    }
+    void guardNotEmpty(Gpr r){
+        as.movImm(RSI, Jua_Val::TAG_EMPTY);
+        as.cmp(r, RSI);
+        slow.push_back(as.jcc(E));
+    }
+    void guardLayout(){
+        //rax 为 Scope*，未被动态修改（shape 仍为 layout）
+        as.loadField(RCX, RAX, SHAPE);
+        as.cmpField(RCX, RAX, LAYOUT);
+        slow.push_back(as.jcc(NE));
+    }
+    void scope(int depth){
+        //rax = depth 层外的作用域，同 target
+        as.load(RAX, 0);
+        as.shl(RAX, 16);
+        as.shr(RAX, 16);
+        for(; depth > 0; depth--){
+            guardLayout();
+            as.loadField(RAX, RAX, PARENT);
+            as.bytes({0x48, 0x85, 0xC0}); //test rax, rax
+            slow.push_back(as.jcc(E));
+        }
+        guardLayout();
+    }
+    void guardShape(JitCode::SlotCache* site){
+        //rax 为 Jua_Ref*；site 未失效，且对象的 Shape 与其中记录的相同时，rcx = 属性槽位的地址
+        as.cmpField32(RAX, TYPE, Jua_Val::Obj);
+        slow.push_back(as.jcc(NE));
+        as.movImm(RSI, reinterpret_cast<uint64_t>(site));
+        as.movRR(RCX, R12);
+        as.loadField(RCX, RCX, EPOCH);
+        as.cmpField(RCX, RSI, offsetof(JitCode::SlotCache, epoch));
+        slow.push_back(as.jcc(NE));
+        as.loadField(RCX, RAX, SHAPE);
+        as.cmpField(RCX, RSI, offsetof(JitCode::SlotCache, shape));
+        slow.push_back(as.jcc(NE));
+        as.loadField(RCX, RAX, SLOTS);
+        as.addField(RCX, RSI, offsetof(JitCode::SlotCache, offset));
+    }
+    void fallback(Helper fn, const Instr& i, void* node){
+        //内联路径之后：守卫失败时调用快速路径；没有内联路径（slow 为空）时总是调用
+        if(slow.empty())return call(fn, i, node);
+        size_t done = as.jmp();
+        for(auto patch: slow)as.bind(patch);
+        slow.clear();
+        call(fn, i, node);
+        as.bind(done);
+    }
+    void loadVar(const Instr& i){
+        auto var = static_cast<Varname*>(proto->nodes[i.b]);
+        if(inlineSlots && var->depth >= 0 && var->slot >= 0){
+            scope(var->depth);
+            as.loadField(RCX, RAX, SLOTS);
+            as.loadField(RAX, RCX, var->slot * sizeof(Jua_Val));
+            guardNotEmpty(RAX);
+            as.store(i.a, RAX);
+        }
+        fallback(getVar, i, var);
+    }
+    void storeVar(const Instr& i, bool declare){
+        auto var = static_cast<Varname*>(proto->nodes[i.b]);
+        auto helper = declare ? declVar : setVar;
+        if(inlineSlots && var->slot >= 0 && (declare ? var->depth == 0 : var->depth >= 0)){
+            as.load(RDX, i.a);
+            guardNotRef(RDX);
+            scope(var->depth);
+            as.loadField(RCX, RAX, SLOTS);
+            if(!declare){
+                //赋值前变量须已声明
+                as.loadField(RAX, RCX, var->slot * sizeof(Jua_Val));
+                guardNotEmpty(RAX);
+            }
+            as.storeField(RCX, var->slot * sizeof(Jua_Val), RDX);
+        }
+        fallback(helper, i, var);
+    }
+    void loadProp(const Instr& i){
+        auto site = &code->slotCaches[sites++];
+        site->node = proto->nodes[i.c];
+        if(inlineSlots){
+            as.load(RAX, i.b);
+            guardRef(RAX);
+            guardShape(site);
+            as.loadField(RAX, RCX, 0);
+            guardNotEmpty(RAX);
+            as.store(i.a, RAX);
+        }
+        fallback(getProp, i, site);
+    }
+    void storeProp(const Instr& i){
+        auto site = &code->slotCaches[sites++];
+        site->node = proto->nodes[i.c];
+        if(inlineSlots){
+            as.load(RDX, i.b);
+            guardNotRef(RDX);
+            as.load(RAX, i.a);
+            guardRef(RAX);
+            guardShape(site);
+            as.storeField(RCX, 0, RDX);
+        }
+        fallback(setProp, i, site);
+    }
+    void binary(BinOper oper, const Instr& i){
+        //两个操作数都是数字时内联计算，否则交给解释器（可能是字符串、元方法或类型错误）
+        as.load(RAX, i.b);
+        guardNum(RAX);
+        as.load(RCX, i.c);
+        guardNum(RCX);
+        as.movqToX(0, RAX);
+        as.movqToX(1, RCX);
+        switch(oper){
+            case BinOper::add: as.sse(0x58, 0, 1); storeNum(i.a); return;
+            case BinOper::mul: as.sse(0x59, 0, 1); storeNum(i.a); return;
+            case BinOper::sub: as.sse(0x5C, 0, 1); storeNum(i.a); return;
+            case BinOper::div: as.sse(0x5E, 0, 1); storeNum(i.a); return;
+            //与 operateNum 一致：比较 r 与 l，无序（NaN）时 CF = ZF = PF = 1
+            case BinOper::lt: as.ucomisd(1, 0); as.setcc(A, RAX); break;
+            case BinOper::le: as.ucomisd(1, 0); as.setcc(AE, RAX); break;
+            case BinOper::gt: as.ucomisd(1, 0); as.setcc(B, RAX); break; //!(l <= r)
+            case BinOper::ge: as.ucomisd(1, 0); as.setcc(BE, RAX); break; //!(l < r)
+            case BinOper::eq:
+                as.ucomisd(0, 1);
+                as.setcc(E, RAX);
+                as.setcc(NP, RCX);
+                as.bytes({0x20, 0xC8}); //and al, cl
+                break;
+            case BinOper::ne:
+                as.ucomisd(0, 1);
+                as.setcc(NE, RAX);
+                as.setcc(P, RCX);
+                as.bytes({0x08, 0xC8}); //or al, cl
+                break;
+            default: break;
+        }
+        storeBool(i.a);
+    }
+    void next(const Instr& i){
+        //计数循环（见 Op::ITER）：a+1..a+4 为起点、步长、长度和序号；迭代器交给解释器
+        as.load(RAX, i.a + 1);
+        as.movImm(RCX, Jua_Val::TAG_EMPTY);
+        as.cmp(RAX, RCX);
+        exit(E);
+        as.loadsd(0, i.a + 4);
+        as.loadsd(1, i.a + 3);
+        as.ucomisd(0, 1);
+        jumpTo(AE, i.b);
+        as.loadsd(2, i.a + 2);
+        as.sse(0x59, 2, 0); //步长 * 序号
+        as.loadsd(1, i.a + 1);
+        as.sse(0x58, 2, 1);
+        as.movImm(RAX, std::bit_cast<uint64_t>(1.0));
+        as.movqToX(1, RAX);
+        as.sse(0x58, 0, 1);
+        as.storesd(i.a + 4, 0);
+        as.bytes({0xF2, 0x0F, 0x10, 0xC2}); //movsd xmm0, xmm2
+        storeNum(i.a);
+    }
+    bool instr(const Instr& i){
+        //返回 false 表示不支持，直接返回解释器
+        switch(i.op){
+            case Op::MOVE:
+                as.load(RAX, i.b);
+                as.store(i.a, RAX);
+                return true;
+            case Op::LOADK:
+                as.movImm(RAX, proto->consts[i.b].bits);
+                as.store(i.a, RAX);
+                return true;
+            case Op::LOADENV:
+                as.load(RAX, 0);
+                as.store(i.a, RAX);
+                return true;
+            case Op::GETVAR: loadVar(i); return true;
+            case Op::SETVAR: storeVar(i, false); return true;
+            case Op::DECLVAR: storeVar(i, true); return true;
+            case Op::GETPROP: loadProp(i); return true;
+            case Op::SETPROP: storeProp(i); return true;
+            case Op::CHECK: call(safepoint, i, nullptr); return true;
+            case Op::UNM:
+                as.load(RAX, i.b);
+                guardNum(RAX);
+                as.movImm(RCX, 1ull << 63);
+                as.bytes({0x48, 0x31, 0xC8}); //xor rax, rcx
+                as.movqToX(0, RAX);
+                storeNum(i.a);
+                return true;
+            case Op::NOT:
+                truth(i.b);
+                as.bytes({0x34, 0x01}); //xor al, 1
+                storeBool(i.a);
+                return true;
+            case Op::ADD: case Op::ADD_NN: case Op::ADD_SS: binary(BinOper::add, i); return true;
+            case Op::SUB: case Op::SUB_NN: binary(BinOper::sub, i); return true;
+            case Op::MUL: case Op::MUL_NN: binary(BinOper::mul, i); return true;
+            case Op::DIV: case Op::DIV_NN: binary(BinOper::div, i); return true;
+            case Op::LT: case Op::LT_NN: binary(BinOper::lt, i); return true;
+            case Op::LE: case Op::LE_NN: binary(BinOper::le, i); return true;
+            case Op::GT: case Op::GT_NN: binary(BinOper::gt, i); return true;
+            case Op::GE: case Op::GE_NN: binary(BinOper::ge, i); return true;
+            case Op::EQ: case Op::EQ_NN: binary(BinOper::eq, i); return true;
+            case Op::NE: case Op::NE_NN: binary(BinOper::ne, i); return true;
+            case Op::JMP:
+                jumpTo(i.a);
+                return true;
+            case Op::JMPF: case Op::JMPT:
+                truth(i.a);
+                as.bytes({0x84, 0xC0}); //test al, al
+                jumpTo(i.op == Op::JMPF ? E : NE, i.b);
+                return true;
+            case Op::NEXT:
+                next(i);
+                return true;
+            default:
+                return false;
+        }
+    }
+    void translate(){
+        //入口：保存被调用者保存的寄存器（三个，调用运行时时栈保持 16 字节对齐），按 index 跳到对应指令
+        as.bytes({0x53, 0x41, 0x54, 0x41, 0x55}); //push rbx; push r12; push r13
+        as.movRR(RBX, RDI);
+        as.movRR(R12, RSI);
+        as.movImm(R13, Jua_Val::TAG_NULL);
+        as.movImm(RAX, reinterpret_cast<uint64_t>(code->labels.data()));
+        as.bytes({0xFF, 0x24, 0xD0}); //jmp [rax + rdx*8]
+        epilogue = as.here(); //rax 为返回值
+        as.bytes({0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3}); //pop r13; pop r12; pop rbx; ret
+        auto& code_ = proto->code;
+        for(k = 0; k < code_.size(); k++){
+            labels.push_back(as.here());
+            if(!instr(code_[k]))exit();
+        }
+        //末尾之后的下标（不会执行到）以及各处的返回
+        labels.push_back(as.here());
+        k = code_.size();
+        exit();
+        for(auto [patch, index]: exits){
+            as.bind(patch);
+            as.byte(0xB8); //mov eax, index
+            as.u32(index);
+            as.bind(as.jmp(), epilogue);
+        }
+        for(auto [patch, target]: jumps){
+            as.bind(patch, labels[target]);
+        }
+    }
+};
+
+}
+
+JitCode::~JitCode(){
+    if(memory)munmap(memory, size);
+}
+JitCode* JitCode::compile(Proto* proto){
+    auto code = new JitCode;
+    code->labels.resize(proto->code.size() + 1);
+    code->slotCaches.resize(std::count_if(proto->code.begin(), proto->code.end(), [](const Instr& i){
+        return i.op == Op::GETPROP || i.op == Op::SETPROP;
+    }));
+    Translator t{proto, code};
+    t.translate();
+    auto& buf = t.as.buf;
+    size_t page = 4096;
+    code->size = (buf.size() + page - 1) / page * page;
+    void* mem = mmap(nullptr, code->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(mem == MAP_FAILED){
+        delete code;
+        return nullptr;
+    }
+    memcpy(mem, buf.data(), buf.size());
+    if(mprotect(mem, code->size, PROT_READ | PROT_EXEC)){
+        munmap(mem, code->size);
+        delete code;
+        return nullptr;
+    }
+    auto base = static_cast<uint8_t*>(mem);
+    code->memory = mem;
+    code->entry = reinterpret_cast<Entry>(base);
+    for(size_t k = 0; k < t.labels.size(); k++){
+        code->labels[k] = base + t.labels[k];
+    }
+    return code;
+}
+
+#else
+
+const bool JitCode::supported = false;
+
+JitCode::~JitCode(){}
+JitCode* JitCode::compile(Proto*){
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,29 @@
+#include "jua-value.h"
+#include "jua-vm.h"
+
+Jua_Obj* JuaVM::makeGC(){
+    auto mod = new Jua_Obj(this);
+    mod->setProp("collect", makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
+        return Jua_Num(vm->gc.collect());
+    }));
+    mod->setProp("count", makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
+        return Jua_Num(vm->gc.count());
+    }));
+    mod->setProp("collections", makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
+        return Jua_Num(vm->gc.collections);
+    }));
+    mod->setProp("mode", makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
+        //返回当前模式；传入 "generational" 或 "incremental" 时切换模式
+        string current = vm->gc.getMode() == JuaGC::Incremental ? "incremental" : "generational";
+        if(args.size() > 0){
+            if(args[0].type() != Jua_Val::Str)
+                throw new JuaError("vm->gc.mode() requires a string argument");
+            auto name = args[0].toString();
+            if(name == "generational")vm->gc.setMode(JuaGC::Generational);
+            else if(name == "incremental")vm->gc.setMode(JuaGC::Incremental);
+            else throw new JuaError("unknown gc mode: " + name);
+        }
+        return new Jua_Str(vm, current);
+    }));
+    return mod;
+}
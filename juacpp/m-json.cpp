@@ -1,21 +1,21 @@
 #include "jua-value.h"
 #include "jua-vm.h"
-bool is_func(Jua_Val* val){
-    return val->type == Jua_Val::Func;
+bool is_func(Jua_Val val){
+    return val.type() == Jua_Val::Func;
 }
 struct InvalidJSONException: JuaError{
     InvalidJSONException(const string& msg): JuaError("Invalid JSON: " + msg) {}
 };
-string encode(Jua_Val* val){
-    switch(val->type){
+string encode(Jua_Val val){
+    switch(val.type()){
         case Jua_Val::Null:
             return "null";
         case Jua_Val::Bool:
-            return val->toBoolean() ? "true" : "false";
+            return val.toBoolean() ? "true" : "false";
         case Jua_Val::Num:
-            return val->toString();
+            return val.toString();
         case Jua_Val::Str: {
-            string str = val->toString();
+            string str = val.toString();
             string res = "\"";
             for(char c: str){
                 switch(c){
@@ -40,8 +40,8 @@ string encode(Jua_Val* val){
             return res;
         }
         case Jua_Val::Obj: {
-            if(val->isType(Jua_Array::type_id)){
-                auto arr = static_cast<Jua_Array*>(val);
+            if(val.isType(Jua_Array::type_id)){
+                auto arr = val.as<Jua_Array>();
                 string res = "[";
                 for(size_t i=0; i<arr->items.size(); i++){
                     if(is_func(arr->items[i]))continue;
@@ -51,14 +51,16 @@ string encode(Jua_Val* val){
                 res += "]";
                 return res;
             }else{
-                auto obj = static_cast<Jua_Obj*>(val);
+                auto obj = val.as<Jua_Obj>();
                 string res = "{";
                 bool first = true;
-                for(auto& [key, value]: obj->dict){
-                    if(is_func(value))continue;
+                for(size_t i = 0; i < obj->slots.size(); i++){
+                    auto& key = obj->shape->keys[i];
+                    auto value = obj->slots[i];
+                    if(!value || is_func(value))continue;
                     if(!first) res += ",";
                     first = false;
-                    res += encode(new Jua_Str(val->vm, key));
+                    res += encode(new Jua_Str(obj->vm, key.str()));
                     res += ":";
                     res += encode(value);
                 }
@@ -67,11 +69,11 @@ string encode(Jua_Val* val){
             }
         }
         default:
-            throw new JuaTypeError("cannot encode type: " + val->getTypeName());
+            throw new JuaTypeError("cannot encode type: " + val.getTypeName());
     }
 }
 
-Jua_Val* decode(JuaVM* vm, const string& str, size_t& pos);
+Jua_Val decode(JuaVM* vm, const string& str, size_t& pos);
 Jua_Str* decode_string(JuaVM* vm, const string& str, size_t& pos){
     //从'"'开始解析
     pos++;
@@ -118,13 +120,21 @@ Jua_Str* decode_string(JuaVM* vm, const string& str, size_t& pos){
                         result += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
                         result += static_cast<char>(0x80 | (codepoint & 0x3F));
                     }
+                    pos += 4;
+                    break;
                 }
+                default:
+                    throw new InvalidJSONException("Invalid escape at position " + std::to_string(pos));
             }
+            pos++;
+        }else{
+            result += c;
+            pos++;
         }
     }
     throw new InvalidJSONException("Unterminated string starting at position " + std::to_string(start-1));
 }
-Jua_Num* decode_number(JuaVM* vm, const string& str, size_t& pos){
+Jua_Val decode_number(JuaVM* vm, const string& str, size_t& pos){
     size_t start = pos;
     bool has_decimal = false;
     bool has_exponent = false;
@@ -150,7 +160,7 @@ Jua_Num* decode_number(JuaVM* vm, const string& str, size_t& pos){
     string num_str = str.substr(start, pos - start);
     try {
         double value = std::stod(num_str);
-        return new Jua_Num(vm, value);
+        return Jua_Num(value);
     } catch (...) {
         throw new InvalidJSONException("Invalid number at position " + std::to_string(start));
     }
@@ -208,7 +218,7 @@ Jua_Obj* decode_object(JuaVM* vm, const string& str, size_t& pos){
             throw new InvalidJSONException("Unexpected end of input after ':' at position " + std::to_string(pos));
         }
         auto value = decode(vm, str, pos);
-        obj->setProp(key->toString(), value);
+        obj->setProp(Atom::dynamic(vm, key->toString()), value);
         while(pos < str.size() && isspace(str[pos])) pos++;
         if(pos < str.size() && str[pos] == ','){
             pos++;
@@ -217,13 +227,13 @@ Jua_Obj* decode_object(JuaVM* vm, const string& str, size_t& pos){
     }
     throw new InvalidJSONException("Missing closing '}'");
 }
-Jua_Val* decode(JuaVM* vm, const string& str){
+Jua_Val decode(JuaVM* vm, const string& str){
     size_t pos = 0;
     auto val = decode(vm, str, pos);
     //这里可以检查 pos 是否到达末尾
     return val;
 }
-Jua_Val* decode(JuaVM* vm, const string& str, size_t& pos){
+Jua_Val decode(JuaVM* vm, const string& str, size_t& pos){
     switch(str[pos]){
         case 'n':
             if(str.compare(pos, 4, "null") == 0){
@@ -259,17 +269,17 @@ Jua_Val* decode(JuaVM* vm, const string& str, size_t& pos){
 
 Jua_Obj* JuaVM::makeJSON(){
     auto proto = new Jua_Obj(this, ObjectProto);
-    proto->setProp("encode", makeFunc([this](jualist& args){
+    proto->setProp("encode", makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 1)
             throw new JuaError("JSON.stringify() requires at least 1 argument");
-        return new Jua_Str(this, encode(args[0]));
+        return new Jua_Str(vm, encode(args[0]));
     }));
-    proto->setProp("decode", makeFunc([this](jualist& args){
+    proto->setProp("decode", makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 1)
             throw new JuaError("JSON.parse() requires at least 1 argument");
-        if(args[0]->type != Jua_Val::Str)
+        if(args[0].type() != Jua_Val::Str)
             throw new JuaTypeError("JSON.parse() requires a string argument");
-        return decode(this, args[0]->toString());
+        return decode(vm, args[0].toString());
     }));
     return proto;
 }
\ No newline at end of file
@@ -3,83 +3,83 @@
 
 Jua_Obj* JuaVM::makeMath(){
     auto math = new Jua_Obj(this);
-    math->setProp("PI", new Jua_Num(this, 3.141592653589793));
-    math->setProp("E", new Jua_Num(this, 2.718281828459045));
-    math->setProp("sin", makeFunc([](jualist& args){
+    math->setProp("PI", Jua_Num(3.141592653589793));
+    math->setProp("E", Jua_Num(2.718281828459045));
+    math->setProp("sin", makeFunc([](JuaVM*, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 1)throw new JuaError("Math.sin() requires 1 argument");
         auto val = args[0];
-        if(val->type != Jua_Val::Num)
+        if(val.type() != Jua_Val::Num)
             throw new JuaError("Math.sin() called on non-number value");
-        auto num = static_cast<Jua_Num*>(val);
-        return new Jua_Num(val->vm, sin(num->value));
+        double num = val.num();
+        return Jua_Num(sin(num));
     }));
-    math->setProp("cos", makeFunc([](jualist& args){
+    math->setProp("cos", makeFunc([](JuaVM*, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 1)throw new JuaError("Math.cos() requires 1 argument");
         auto val = args[0];
-        if(val->type != Jua_Val::Num)
+        if(val.type() != Jua_Val::Num)
             throw new JuaError("Math.cos() called on non-number value");
-        auto num = static_cast<Jua_Num*>(val);
-        return new Jua_Num(val->vm, cos(num->value));
+        double num = val.num();
+        return Jua_Num(cos(num));
     }));
-    math->setProp("tan", makeFunc([](jualist& args){
+    math->setProp("tan", makeFunc([](JuaVM*, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 1)throw new JuaError("Math.tan() requires 1 argument");
         auto val = args[0];
-        if(val->type != Jua_Val::Num)
+        if(val.type() != Jua_Val::Num)
             throw new JuaError("Math.tan() called on non-number value");
-        auto num = static_cast<Jua_Num*>(val);
-        return new Jua_Num(val->vm, tan(num->value));
+        double num = val.num();
+        return Jua_Num(tan(num));
     }));
-    math->setProp("sqrt", makeFunc([](jualist& args){
+    math->setProp("sqrt", makeFunc([](JuaVM*, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 1)throw new JuaError("Math.sqrt() requires 1 argument");
         auto val = args[0];
-        if(val->type != Jua_Val::Num)
+        if(val.type() != Jua_Val::Num)
             throw new JuaError("Math.sqrt() called on non-number value");
-        auto num = static_cast<Jua_Num*>(val);
-        if(num->value < 0)
+        double num = val.num();
+        if(num < 0)
             throw new JuaError("Math.sqrt() called on negative number");
-        return new Jua_Num(val->vm, sqrt(num->value));
+        return Jua_Num(sqrt(num));
     }));
-    math->setProp("log", makeFunc([](jualist& args){
+    math->setProp("log", makeFunc([](JuaVM*, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 1)throw new JuaError("Math.log() requires 1 argument");
         auto val = args[0];
-        if(val->type != Jua_Val::Num)
+        if(val.type() != Jua_Val::Num)
             throw new JuaError("Math.log() called on non-number value");
-        auto num = static_cast<Jua_Num*>(val);
-        if(num->value <= 0)
+        double num = val.num();
+        if(num <= 0)
             throw new JuaError("Math.log() called on non-positive number");
-        return new Jua_Num(val->vm, log(num->value));
+        return Jua_Num(log(num));
     }));
-    math->setProp("exp", makeFunc([](jualist& args){
+    math->setProp("exp", makeFunc([](JuaVM*, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 1)throw new JuaError("Math.exp() requires 1 argument");
         auto val = args[0];
-        if(val->type != Jua_Val::Num)
+        if(val.type() != Jua_Val::Num)
             throw new JuaError("Math.exp() called on non-number value");
-        auto num = static_cast<Jua_Num*>(val);
-        return new Jua_Num(val->vm, exp(num->value));
+        double num = val.num();
+        return Jua_Num(exp(num));
     }));
-    math->setProp("ceil", makeFunc([](jualist& args){
+    math->setProp("ceil", makeFunc([](JuaVM*, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 1)throw new JuaError("Math.ceil() requires 1 argument");
         auto val = args[0];
-        if(val->type != Jua_Val::Num)
+        if(val.type() != Jua_Val::Num)
             throw new JuaError("Math.ceil() called on non-number value");
-        auto num = static_cast<Jua_Num*>(val);
-        return new Jua_Num(val->vm, ceil(num->value));
+        double num = val.num();
+        return Jua_Num(ceil(num));
     }));
-    math->setProp("floor", makeFunc([](jualist& args){
+    math->setProp("floor", makeFunc([](JuaVM*, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 1)throw new JuaError("Math.floor() requires 1 argument");
         auto val = args[0];
-        if(val->type != Jua_Val::Num)
+        if(val.type() != Jua_Val::Num)
             throw new JuaError("Math.floor() called on non-number value");
-        auto num = static_cast<Jua_Num*>(val);
-        return new Jua_Num(val->vm, floor(num->value));
+        double num = val.num();
+        return Jua_Num(floor(num));
     }));
-    math->setProp("round", makeFunc([](jualist& args){
+    math->setProp("round", makeFunc([](JuaVM*, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 1)throw new JuaError("Math.round() requires 1 argument");
         auto val = args[0];
-        if(val->type != Jua_Val::Num)
+        if(val.type() != Jua_Val::Num)
             throw new JuaError("Math.round() called on non-number value");
-        auto num = static_cast<Jua_Num*>(val);
-        return new Jua_Num(val->vm, round(num->value));
+        double num = val.num();
+        return Jua_Num(round(num));
     }));
     return math;
 }
\ No newline at end of file
@@ -32,13 +32,16 @@ struct JuaRuntime: JuaVM{
         //cout<<script<<'\n';
         return script;
     }
-    void j_stdout(const jualist& vals){
+    void j_stdout(JuaArgs vals){
         size_t len = vals.size();
-        if(!len)cout << '\n';
-        std::string str(vals[0]->toString());
+        if(!len){
+            cout << '\n';
+            return;
+        }
+        std::string str(vals[0].toString());
         for(size_t i=1; i<len; i++){
             str.push_back('\t');
-            str.append(vals[i]->toString());
+            str.append(vals[i].toString());
         }
         cout << str << '\n';
     };
@@ -67,6 +70,13 @@ int main(int argc, char* argv[]){
     if(argc > 1){
         const char* main_module = argv[1];
         JuaRuntime runtime(main_module);
+        for(int i = 2; i < argc; i++){
+            string opt = argv[i];
+            if(opt == "--tree")runtime.engine = JuaVM::Tree; //使用树遍历解释器，用于对照测试
+            else if(opt == "--closure")runtime.engine = JuaVM::Closure;
+            else if(opt == "--dump-folds")runtime.dumpFolds = true; //打印常量折叠的结果
+            else if(opt == "--no-jit")runtime.jit = false;
+        }
         runtime.run();
     }else{
         cout << "Jua REPL. Add ';' to end input. Type 'exit;' to quit.\n";
@@ -76,10 +86,10 @@ int main(int argc, char* argv[]){
             if (input.empty()) continue;
             if (input == "exit;") break;
             try{
-                auto val = rt.eval(input);
-                val->gc();
+                rt.eval(input);
             }catch(JuaError* e){
                 rt.j_stderr(e);
+                delete e;
             }
         }
     }
@@ -0,0 +1,257 @@
+#include "jua-syntax.h"
+
+void optimize(FunctionBody* body, bool dump){
+    Optimizer optimizer;
+    optimizer.dump = dump;
+    optimizer.block(body);
+    if(dump)
+        d_log(std::format("optimizer: {} folded, {} branches pruned", optimizer.folded, optimizer.pruned));
+}
+
+//数字、布尔值和 null 字面量的值；字符串字面量需要 vm 才能创建值，单独处理
+static bool constant(Expr* expr, Jua_Val& val){
+    if(auto num = dynamic_cast<LiteralNum*>(expr)){
+        val = Jua_Num(num->value);
+        return true;
+    }
+    auto kw = dynamic_cast<Keyword*>(expr);
+    if(!kw || kw->type == 'l')return false;
+    val = kw->calc(nullptr);
+    return true;
+}
+static Expr* literal(Jua_Val val){
+    switch(val.type()){
+        case Jua_Val::Num: return newNode<LiteralNum>(val.toNumber());
+        case Jua_Val::Bool: return val.toBoolean() ? Keyword::t : Keyword::f;
+        case Jua_Val::Null: return Keyword::null;
+        default: return nullptr;
+    }
+}
+//字面量转为字符串，用于模板
+static bool text(Expr* expr, string& str){
+    if(auto lit = dynamic_cast<LiteralStr*>(expr)){
+        str = lit->value;
+        return true;
+    }
+    Jua_Val val = nullptr;
+    if(!constant(expr, val))return false;
+    str = val.toString();
+    return true;
+}
+
+void Optimizer::block(Block* block){
+    Stmts stmts;
+    for(auto stmt: block->statements){
+        if(auto s = stmt->optimize(*this))stmts.push_back(s);
+    }
+    block->statements.swap(stmts);
+}
+Expr* Optimizer::fold(const char* kind, Expr* to){
+    folded++;
+    if(!dump)return to;
+    string str;
+    if(text(to, str))d_log(std::format("fold {} -> {}", kind, str));
+    else d_log(std::format("fold {}", kind)); //短路或三元运算化简为其中一个非字面量的操作数
+    return to;
+}
+bool Optimizer::truth(Expr* expr, bool& result){
+    if(auto lit = dynamic_cast<LiteralStr*>(expr)){
+        result = lit->value.size();
+        return true;
+    }
+    Jua_Val val = nullptr;
+    if(!constant(expr, val))return false;
+    result = val.toBoolean();
+    return true;
+}
+
+Expr* Template::optimize(Optimizer& o){
+    //字面量部分并入相邻的字符串
+    std::vector<string> strs{strList[0]};
+    std::vector<Expr*> exprs;
+    for(size_t i = 0; i < exprList.size(); i++){
+        auto expr = exprList[i]->optimize(o);
+        string str;
+        if(text(expr, str)){
+            strs.back() += str;
+            strs.back() += strList[i+1];
+        }else{
+            exprs.push_back(expr);
+            strs.push_back(strList[i+1]);
+        }
+    }
+    strList.swap(strs);
+    exprList.swap(exprs);
+    if(!exprList.empty())return this;
+    return o.fold("Template", newNode<LiteralStr>(strList[0]));
+}
+Expr* OptionalPropRef::optimize(Optimizer& o){
+    expr = expr->optimize(o);
+    return this;
+}
+Expr* MethWrapper::optimize(Optimizer& o){
+    expr = expr->optimize(o);
+    return this;
+}
+Expr* UnitaryExpr::optimize(Optimizer& o){
+    pri = pri->optimize(o);
+    bool result;
+    if(oper == UniOper::not_ && o.truth(pri, result))
+        return o.fold("UnitaryExpr", result ? Keyword::f : Keyword::t);
+    Jua_Val val = nullptr;
+    if(oper == UniOper::unm && constant(pri, val) && val.isNum())
+        return o.fold("UnitaryExpr", newNode<LiteralNum>(-val.num()));
+    return this;
+}
+Expr* BinaryExpr::optimize(Optimizer& o){
+    left = left->optimize(o);
+    right = right->optimize(o);
+    bool truth;
+    switch(oper){
+        case BinOper::and_:
+            if(!o.truth(left, truth))return this;
+            return o.fold("BinaryExpr", truth ? right : left);
+        case BinOper::or_:
+            if(!o.truth(left, truth))return this;
+            return o.fold("BinaryExpr", truth ? left : right);
+        case BinOper::add: case BinOper::sub: case BinOper::mul: case BinOper::div:
+        case BinOper::lt: case BinOper::le: case BinOper::gt: case BinOper::ge:
+        case BinOper::eq: case BinOper::ne:
+            break;
+        default: //区间、in 等的结果是堆值或依赖运行时对象
+            return this;
+    }
+    auto ls = dynamic_cast<LiteralStr*>(left);
+    auto rs = dynamic_cast<LiteralStr*>(right);
+    if(ls && rs){
+        switch(oper){
+            case BinOper::add: return o.fold("BinaryExpr", newNode<LiteralStr>(ls->value + rs->value));
+            case BinOper::eq: return o.fold("BinaryExpr", ls->value == rs->value ? Keyword::t : Keyword::f);
+            case BinOper::ne: return o.fold("BinaryExpr", ls->value != rs->value ? Keyword::t : Keyword::f);
+            default: return this;
+        }
+    }
+    Jua_Val l = nullptr, r = nullptr;
+    if(!constant(left, l) || !constant(right, r))return this;
+    //运算出错（如类型不符）时保留原节点，错误在运行时照常抛出
+    try{
+        if(auto lit = literal(operate(nullptr, oper, l, r)))return o.fold("BinaryExpr", lit);
+    }catch(JuaError* e){
+        delete e;
+    }catch(const char*){}
+    return this;
+}
+Expr* Assignment::optimize(Optimizer& o){
+    if(auto expr = dynamic_cast<Expr*>(left))expr->optimize(o); //左值不会被替换
+    right = right->optimize(o);
+    return this;
+}
+Expr* OperAssignment::optimize(Optimizer& o){
+    left->optimize(o); //与 assignee 是同一个节点，不会被替换
+    right = right->optimize(o);
+    return this;
+}
+Expr* Subscription::optimize(Optimizer& o){
+    expr = expr->optimize(o);
+    keyExpr = keyExpr->optimize(o);
+    return this;
+}
+Expr* TernaryExpr::optimize(Optimizer& o){
+    condExpr = condExpr->optimize(o);
+    trueExpr = trueExpr->optimize(o);
+    falseExpr = falseExpr->optimize(o);
+    bool truth;
+    if(!o.truth(condExpr, truth))return this;
+    return o.fold("TernaryExpr", truth ? trueExpr : falseExpr);
+}
+void FlexibleList::optimize(Optimizer& o){
+    for(auto& expr: exprs){
+        expr = expr->optimize(o);
+    }
+}
+Expr* Call::optimize(Optimizer& o){
+    calee = calee->optimize(o); //MethodCall 的 calee 是 MethWrapper，不会被替换
+    if(args)args->optimize(o);
+    return this;
+}
+Expr* ObjExpr::optimize(Optimizer& o){
+    for(size_t i = 0; i < entries.size(); i++){
+        auto& [key, val] = entries[i];
+        key = key->optimize(o);
+        val = val->optimize(o);
+        auto lit = dynamic_cast<LiteralStr*>(key);
+        if(lit && !keys[i])keys[i] = SyntaxTree::building->intern(lit->value); //折叠得到的字符串键同样驻留
+    }
+    return this;
+}
+Expr* ArrayExpr::optimize(Optimizer& o){
+    if(list)list->optimize(o);
+    return this;
+}
+Expr* FunExpr::optimize(Optimizer& o){
+    decList->optimize(o);
+    o.block(body);
+    return this;
+}
+
+void DeclarationItem::optimize(Optimizer& o){
+    if(initval)initval = initval->optimize(o);
+}
+void DeclarationList::optimize(Optimizer& o){
+    for(auto item: decItems){
+        item->optimize(o);
+    }
+}
+
+Statement* ExprStatement::optimize(Optimizer& o){
+    expr = expr->optimize(o);
+    return this;
+}
+Statement* Declaration::optimize(Optimizer& o){
+    list->optimize(o);
+    return this;
+}
+Statement* Return::optimize(Optimizer& o){
+    if(expr)expr = expr->optimize(o);
+    return this;
+}
+Statement* IfStmt::optimize(Optimizer& o){
+    cond = cond->optimize(o);
+    o.block(body);
+    if(elseBody)o.block(elseBody);
+    bool truth;
+    if(!o.truth(cond, truth))return this;
+    //条件为常量：只保留会执行的分支，条件改为 true（IfStmt::compile 不再生成判断）
+    if(!truth){
+        o.pruned++;
+        if(o.dump)d_log("prune if(false) branch");
+        if(!elseBody)return nullptr;
+        body = elseBody;
+    }else if(elseBody){
+        o.pruned++;
+        if(o.dump)d_log("prune else branch of if(true)");
+    }
+    elseBody = nullptr;
+    cond = Keyword::t;
+    return this;
+}
+Statement* SwitchStmt::optimize(Optimizer& o){
+    expr = expr->optimize(o);
+    for(auto cb: cases){
+        cb->cond->optimize(o);
+        o.block(cb->body);
+    }
+    if(defaultBody)o.block(defaultBody);
+    buildTable(); //条件折叠为字面量后可以改用跳转表
+    return this;
+}
+Statement* WhileStmt::optimize(Optimizer& o){
+    cond = cond->optimize(o);
+    o.block(body);
+    return this;
+}
+Statement* ForStmt::optimize(Optimizer& o){
+    iterable = iterable->optimize(o);
+    o.block(body);
+    return this;
+}
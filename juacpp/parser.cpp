@@ -1,33 +1,22 @@
 #include "jua-syntax.h"
+#include "jua-scan.h"
+#include <algorithm>
+#include <array>
 #include <bitset>
-#include <unordered_set>
+#include <deque>
+#include <exception>
 using std::string;
 typedef std::bitset<128> CharSet;
-typedef std::unordered_set<string> StrSet;
 
 bool testChar(const CharSet& set, const char& c){
     if(c & 0x80)return false;
     return set.test(c);
 }
-static CharSet alphaChars = [](){
-    CharSet alphaChars;
-    for(char c='A'; c<='Z'; c++){
-        alphaChars.set(c);
-        alphaChars.set(c+'a'-'A');
-    }
-    return alphaChars;
-}();
 static CharSet numChars = [](){
     CharSet numChars;
     for(char c='0'; c<='9'; c++)numChars.set(c);
     return numChars;
 }();
-static CharSet wordChars = [](){
-    CharSet wordChars(alphaChars);
-    wordChars.set('_');
-    wordChars |= numChars;
-    return wordChars;
-}();
 static CharSet hexChars = [](){
     CharSet hexChars;
     for(char c='0'; c<='9'; c++)hexChars.set(c);
@@ -37,54 +26,66 @@ static CharSet hexChars = [](){
     }
     return hexChars;
 }();
-static CharSet whiteChars = [](){
-    const char _white[] = " \t\r\v\f\n";
-    CharSet whiteChars;
-    for(char c: _white)
-        whiteChars.set(c);
-    return whiteChars;
-}();
-static const char _sepchars[] = "()[]{}.,:;?";
-static CharSet sepchars = [](){
-    CharSet sepchars;
-    for(char c: _sepchars)
-        sepchars.set(c);
-    return sepchars;
-}();
-static StrSet assigners{"=", "+=", "-=", "*=", "/=", "&&=", "||="};
-static StrSet seprators = [](){
-    StrSet seprators(assigners);
-    for(char c: _sepchars)
-        seprators.insert(string(1, c));
-    seprators.insert("?.");
-    seprators.insert("?:");
-    return seprators;
+template<class T, size_t SIZE>
+struct PerfectHash{
+    //编译期生成的完美哈希：在编译期找一个使各个键互不冲突的 seed，查找时只需算一次哈希、比较一次字符串
+    //哈希只用到长度、首字符和末字符，与键的长度无关
+    struct Entry{
+        std::string_view key;
+        T value;
+    };
+    std::array<Entry, SIZE> slots{};
+    size_t seed = 0;
+    static constexpr size_t hash(std::string_view s, size_t seed){
+        return (s.size() * seed * seed + (unsigned char)s[0] * seed + (unsigned char)s.back()) % SIZE;
+    }
+    template<size_t N>
+    constexpr PerfectHash(const std::array<Entry, N>& entries){
+        while(!fits(entries))
+            if(++seed > 10000)throw "PerfectHash: no seed found, enlarge SIZE";
+        for(auto& e: entries)
+            slots[hash(e.key, seed)] = e;
+    }
+    constexpr const T* find(std::string_view s) const {
+        if(s.empty())return nullptr;
+        auto& e = slots[hash(s, seed)];
+        return e.key == s ? &e.value : nullptr;
+    }
+    private:
+    template<size_t N>
+    constexpr bool fits(const std::array<Entry, N>& entries){
+        std::array<bool, SIZE> used{};
+        for(auto& e: entries){
+            auto h = hash(e.key, seed);
+            if(used[h])return false;
+            used[h] = true;
+        }
+        return true;
+    }
+};
+
+enum class Kw: uint8_t{none, as, break_, continue_, case_, else_, false_, for_, fun, if_, in, is, let, local, null, return_, switch_, true_, while_};
+struct Word{
+    Kw kw;
+    bool isBinop; //in、is
+    BinOper binop;
+};
+static constexpr auto keywords = [](){
+    constexpr std::pair<std::string_view, Kw> list[]{
+        {"as", Kw::as}, {"break", Kw::break_}, {"continue", Kw::continue_}, {"case", Kw::case_}, {"else", Kw::else_},
+        {"false", Kw::false_}, {"for", Kw::for_}, {"fun", Kw::fun}, {"if", Kw::if_}, {"in", Kw::in}, {"is", Kw::is},
+        {"let", Kw::let}, {"local", Kw::local}, {"null", Kw::null}, {"return", Kw::return_}, {"switch", Kw::switch_},
+        {"true", Kw::true_}, {"while", Kw::while_},
+    };
+    std::array<PerfectHash<Word, 64>::Entry, std::size(list)> entries{};
+    for(size_t i = 0; i < entries.size(); i++){
+        entries[i] = {list[i].first, {list[i].second, false, {}}};
+        for(auto& [str, oper]: binOpers)
+            if(str == list[i].first)entries[i].value = {list[i].second, true, oper};
+    }
+    return PerfectHash<Word, 64>(entries);
 }();
-static StrSet keywords{"as", "break", "continue", "case", "else", "false", "for", "fun", "if", "in", "is", "let", "local", "null", "return", "switch", "true", "while"};
-static StrSet sym3;
-static StrSet sym2;
-static CharSet symchars;
-static void regSymStr(const string& str){
-    if(str.size()==3)
-        sym3.insert(str);
-    else if(str.size()==2)
-        sym2.insert(str);
-    for(char c: str)
-        if(c<'a'||c>'z')
-            symchars.set(c);
-}
-static bool initSym(){
-    for(string str: seprators)
-        regSymStr(str);
-    for(auto oper: uniOpers)
-        regSymStr(oper.first);
-    for(auto oper: binOpers)
-        regSymStr(oper.first);
-    return true;
-}
-namespace JuaParser{
-    static bool _ = initSym();
-}
+
 bool validWordStart(char c){
     return 'a'<=c && c<='z' || 'A'<=c && c<='Z' || c=='_';
 }
@@ -101,13 +102,13 @@ JuaSyntaxError* missing(char c){
         msg.push_back(c);
         msg.push_back('\'');
     }
-    return new JuaSyntaxError(msg, -1, -1, -1);
+    return new JuaSyntaxError(msg);
 }
 JuaSyntaxError* unexpected(string str){
     string msg = "Unexpected \"";
     msg.append(str);
     msg.push_back('"');
-    return new JuaSyntaxError(msg, -1, -1, -1);
+    return new JuaSyntaxError(msg);
 }
 JuaSyntaxError* unexpected(string une, string e){
     auto err = unexpected(une);
@@ -118,43 +119,91 @@ JuaSyntaxError* unexpected(string une, string e){
 }
 
 struct Token{
-    enum Type{SEP, UNIOP, BINOP, WORD, NUM, STR, DQ_STR, PAREN, BRACKET, BRACE};
-    Type type;
-    string str; //用于 STR 时，储存实际值
-    bool isKeyword;
+    //词法单元：按值传递，不复制源码，str 指向源码中的原文
+    //STR 的 str 为实际值：不含转义时即源码中引号之间的部分，否则指向 Lexer::decoded 中解码后的值
+    //DQ_STR 的 str 为双引号之间的原文，模板在语法分析时再拆分，见 parseTemplate
+    enum Type: uint8_t{SEP, UNIOP, BINOP, WORD, NUM, STR, DQ_STR, PAREN, BRACKET, BRACE, CLOSE};
+    Type type = SEP;
+    Kw kw = Kw::none; //关键字
+    bool isBinop = false; //二元运算符，binop 为对应的运算
+    bool isAssigner = false; //复合赋值，binop 为其中的运算
+    bool isValidVarname = false;
+    BinOper binop{};
+    UniOper uniop{}; //UNIOP 对应的运算
+    uint32_t pos = 0; //在源码中的偏移，用于报错
+    std::string_view str;
+    Atom name; //WORD 驻留后的名字
+};
+struct Symbol{
+    Token::Type type; //SEP、UNIOP 或 BINOP
     bool isBinop;
-    bool isValidVarname;
-    Token(Type t, const string& s): type(t), str(s){
-        //d_log(s);
-        isKeyword = keywords.contains(s);
-        isBinop = binOpers.contains(s);
-        isValidVarname = type==WORD && !isKeyword;
-    }
-    static Token* symbol(const string& s){
-        Type t;
-        if(uniOpers.contains(s))t = UNIOP;
-        else if(binOpers.contains(s))t = BINOP;
-        else t = SEP;
-        return new Token(t, s);
-    }
+    bool isAssigner; //复合赋值，binop 为其中的运算
+    BinOper binop;
+    UniOper uniop;
 };
-struct TokensReader{
-    virtual Token* read() = 0; //读完则报错
-    string readStr(){ //读完则报错
-        return read()->str;
+static constexpr std::string_view separators[]{".", ",", ":", ";", "?", "=", "?.", "?:"}; //括号由 Lexer::lex 直接识别
+static constexpr std::pair<std::string_view, BinOper> assigners[]{
+    {"+=", BinOper::add}, {"-=", BinOper::sub}, {"*=", BinOper::mul}, {"/=", BinOper::div},
+    {"&&=", BinOper::and_}, {"||=", BinOper::or_},
+};
+static constexpr size_t symbolCount = [](){
+    //- 既是一元也是二元运算符，只占一项
+    size_t n = std::size(separators) + std::size(assigners) + std::size(uniOpers);
+    for(auto& [str, oper]: binOpers)
+        if(str[0] < 'a' || str[0] > 'z')n++;
+    for(auto& [str, oper]: uniOpers)
+        for(auto& [bin, _]: binOpers)
+            if(bin == str)n--;
+    return n;
+}();
+static constexpr auto symbols = [](){
+    std::array<PerfectHash<Symbol, 128>::Entry, symbolCount> entries{};
+    size_t n = 0;
+    for(auto str: separators)
+        entries[n++] = {str, {Token::SEP, false, false, {}, {}}};
+    for(auto& [str, oper]: assigners)
+        entries[n++] = {str, {Token::SEP, false, true, oper, {}}};
+    for(auto& [str, oper]: uniOpers)
+        entries[n++] = {str, {Token::UNIOP, false, false, {}, oper}};
+    for(auto& [str, oper]: binOpers){
+        if(str[0] >= 'a' && str[0] <= 'z')continue; //in、is 为关键字
+        bool merged = false;
+        for(size_t i = 0; i < n; i++){
+            if(entries[i].key == str){
+                entries[i].value.isBinop = true;
+                entries[i].value.binop = oper;
+                merged = true;
+            }
+        }
+        if(!merged)entries[n++] = {str, {Token::BINOP, true, false, oper, {}}};
     }
-    virtual Token* preview() = 0; //读完则返回 nullptr
-    string previewStr(){ //读完则返回空串
+    return PerfectHash<Symbol, 128>(entries);
+}();
+static CharSet symchars = [](){
+    CharSet symchars;
+    for(auto& e: symbols.slots)
+        for(char c: e.key)
+            symchars.set(c);
+    return symchars;
+}();
+struct Lexer;
+struct TokensReader{
+    virtual const Token* preview() = 0; //读完则返回 nullptr；返回的指针在下一次读取前有效
+    virtual Token read() = 0; //读完则报错
+    virtual size_t save() = 0; //记下当前位置，restore 后从该位置重新读取
+    virtual void restore(size_t) = 0;
+    virtual Lexer& lexer() = 0; //底层的词法分析器
+    std::string_view previewStr(){ //读完则返回空串
         auto next = preview();
         if(next)return next->str;
         return "";
     }
-    void assertStr(const string& str){
+    void assertStr(std::string_view str){
         auto token = read();
-		if(token->str != str)
-			throw unexpected(token->str, str);
+		if(token.str != str)
+			throw unexpected(string(token.str), string(str));
     }
-    bool skipStr(const string& str){
+    bool skipStr(std::string_view str){
         auto token = preview();
         if(token && token->str==str){
             read();
@@ -167,315 +216,359 @@ struct TokensReader{
     }
     void assetEnd(){
         auto token = preview();
-        if(token)throw unexpected(token->str);
+        if(token)throw unexpected(string(token->str));
     }
 };
 
-struct ListReader: TokensReader{
-    std::vector<Token*> tokens;
-    size_t pos;
-    ListReader(std::vector<Token*> list): tokens(list){
-        pos = 0;
-    }
-    Token* read(){
-        if(pos >= tokens.size())throw new JuaSyntaxError("Unfinished input", -1, -1, -1);
-        return tokens[pos++];
-    }
-    Token* preview(){
-        if(pos >= tokens.size())return nullptr;
-        return tokens[pos];
-    }
-};
-struct Enclosure: Token{
-    ListReader reader;
-    Enclosure(Type t, std::vector<Token*> list): Token(t, "<Enclosure>"), reader(list){}
-};
-struct StrTmpl: Token{
-    std::vector<string> strList;
-    std::vector<Token*> tokenList;
-	StrTmpl(std::vector<string> sl, std::vector<Token*> tl):
-        Token(DQ_STR, "<StrTmpl>"), strList(sl), tokenList(tl){}
-};
+static char closerOf(char open){
+    return open=='(' ? ')' : open=='[' ? ']' : '}';
+}
 
 std::unordered_map<char, char> escape_map{
     {'a', '\a'}, {'b', '\b'}, {'f', '\f'},
     {'n', '\n'}, {'r', '\r'}, {'t', '\t'}, {'v', '\v'}
 };
 
-struct ScriptReader: TokensReader{
-    string script;
-    size_t pos = 0;
-    size_t line = 1;
-    size_t col = 0;
-    Token* cache = nullptr;
-    ScriptReader(const string& s): script(s){}
-    Token* read();
-    Token* preview();
-    private:
-    void throwError(const string& msg){
-        //d_log(msg);
-        throw JuaSyntaxError(msg, pos, line, col);
+struct Lexer: TokensReader{
+    //按需读取的词法分析器：直接在源码上扫描，不复制源码；括号不预先读成列表，嵌套由语法分析处理，见 Group
+    //只缓存一个向前看的词法单元；行号和列号只在报错时由行首偏移表算出，见 locate
+    std::string_view src; //整个脚本，源码须在解析期间保持有效
+    Lexer(std::string_view s, size_t begin = 0, size_t e = -1): src(s), pos(begin), end(std::min(e, s.size())){}
+    const Token* preview();
+    Token read();
+    size_t save(){
+        return cached ? mark : pos;
     }
-    char readChar(){
-        if(eof())throwError("Unfinished input");
-        char c = script[pos];
-        forward(c=='\n');
-        return c;
+    void restore(size_t p){
+        pos = p;
+        cached = false;
     }
-    Token* doRead();
-    void forward(bool newline=false){
+    Lexer& lexer(){
+        return *this;
+    }
+    bool readTmplStr(string&);
+    bool skipChar(char c){
+        if(eof() || src[pos]!=c)return false;
         pos++;
-        if(newline){
-            line++;
-            col = 0;
-        }else{
-            col++;
-        }
+        return true;
+    }
+    void locate(JuaSyntaxError* err, size_t at);
+    void locate(JuaSyntaxError* err){
+        //没有偏移时定位到最近读到的词法单元；只有偏移的（如循环外的 break）补上行列
+        locate(err, err->pos == JuaSyntaxError::npos ? last : err->pos);
     }
-    void forwardx(size_t len){
-        while(len--)forward();
+    JuaSyntaxError* error(const string& msg, size_t at){
+        auto err = new JuaSyntaxError(msg);
+        locate(err, at);
+        return err;
     }
+    private:
+    size_t pos;
+    size_t end; //只读取 [pos, end)，用于模板中的表达式
+    Token cache;
+    bool cached = false; //cache 有效；cached 且 cacheEnd 时表示已读完
+    bool cacheEnd = false;
+    size_t mark = 0; //读入 cache 前的位置
+    size_t last = 0;
+    std::vector<size_t> lines; //各行行首的偏移，首次报错时建立
+    std::deque<string> decoded; //含转义的字符串的实际值
     bool eof(){
-        return pos >= script.size();
+        return pos >= end;
     }
-    bool skipWhite(){
-        //若需要跳过多个空白符，则 while(skipWhite());
-        if(eof())return false;
-        char c = script[pos];
-        if(testChar(whiteChars, c)){
-            forward(c=='\n');
-            return true;
-        }
-        return false;
+    char readChar(){
+        if(eof())throw error("Unfinished input", pos);
+        return src[pos++];
+    }
+    //成段的空白符、标识符和字符串内容由 scan 中的函数一次跳过
+    const char* at(size_t i){
+        return src.data() + i;
+    }
+    size_t offset(const char* p){
+        return p - src.data();
     }
+    bool lex(Token&); //读完则返回 false
     bool skipComment();
     void skipVoid(){
-        while(skipWhite());
-        while(skipComment()){
-            while(skipWhite());
-        }
-    }
-    Token* readWord(char start){
-        string word(1, start);
-        while(!eof()){
-            char c = script[pos];
-            if(testChar(wordChars, c)){
-                forward();
-                word.push_back(c);
-            }else{
-                break;
-            }
+        while(true){
+            pos = offset(scan::white(at(pos), at(end)));
+            if(!skipComment())return;
         }
-        return new Token(Token::WORD, word);
     }
-    bool readSimpleNum(string& start){
-        //仅含0-9
-        //不保证读入
-        //读完时返回true
-        while(!eof()){
-            char next = script[pos];
-            if(!testChar(numChars, next))return false;
-            forward();
-            start.push_back(next);
-        }
-        return true;
+    void skipDigits(){
+        while(!eof() && testChar(numChars, src[pos]))pos++;
     }
-    string readNum(char start){
-        string num(1, start);
-        if(eof())return num;
-        if(start=='0' && script[pos]=='x'){
-            num.push_back('x');
-            forward();
-            while(!eof()){
-                char next = script[pos];
-                if(isHex(next)){
-                    forward();
-                    num.push_back(next);
-                }
-                else break;
-            }
-            return num;
-        }
-        if(readSimpleNum(num))return num;
-        //此时非eof
-        if(script[pos]=='.' && pos+1<script.size() && testChar(numChars, script[pos+1])){
-            num.push_back('.');
-            forward();
-            if(readSimpleNum(num))return num;
-        }
-        //此时非eof
-        if(script[pos]=='e'){
-            num.push_back('e');
-            forward();
+    void readNum(char start){
+        if(eof())return;
+        if(start=='0' && src[pos]=='x'){
+            pos++;
+            while(!eof() && isHex(src[pos]))pos++;
+            return;
+        }
+        skipDigits();
+        if(eof())return;
+        if(src[pos]=='.' && pos+1<end && testChar(numChars, src[pos+1])){
+            pos++;
+            skipDigits();
+            if(eof())return;
+        }
+        if(src[pos]=='e'){
+            pos++;
             char next = readChar();
-            if(next=='-' || testChar(numChars, next))num.push_back(next);
-            else throwError("Invalid number: expected '-' or digit after 'e'");
-            readSimpleNum(num);
+            if(next!='-' && !testChar(numChars, next))
+                throw error("Invalid number: expected '-' or digit after 'e'", pos-1);
+            skipDigits();
         }
-        return num;
     }
-    std::vector<Token*> readUntil(char end){
-        //d_log("<Enclosure start>");
-        std::vector<Token*> list;
-        while(true){
-            skipVoid();
-            if(eof())throw missing(end);
-            if(script[pos]==end){
-                forward(); //假设 end 不是 newline
-                return list;
+    void readSymbol(Token& tok){
+        //最长匹配：依次尝试 3、2、1 个字符；不在 symbols 中的单个字符作为 SEP，由语法分析报错
+        size_t begin = pos-1;
+        for(size_t len = std::min<size_t>(3, end-begin); len > 0; len--){
+            if(auto sym = symbols.find(src.substr(begin, len))){
+                pos = begin + len;
+                tok.str = src.substr(begin, len);
+                tok.type = sym->type;
+                tok.isBinop = sym->isBinop;
+                tok.isAssigner = sym->isAssigner;
+                tok.binop = sym->binop;
+                tok.uniop = sym->uniop;
+                return;
             }
-            list.push_back(doRead());
-        }
-    }
-    string substr(size_t len){
-        //超出末尾则返回剩余子串
-        return script.substr(pos, len);
-    }
-    Token* readSymbol(char start){
-        if(start=='(')return new Enclosure(Token::PAREN, readUntil(')'));
-        if(start=='[')return new Enclosure(Token::BRACKET, readUntil(']'));
-        if(start=='{')return new Enclosure(Token::BRACE, readUntil('}'));
-        string str(1, start);
-        if(sym3.contains(str.append(substr(2)))){
-            forwardx(2);
-            return Token::symbol(str);
         }
-        str.resize(1);
-        if(sym2.contains(str.append(substr(1)))){
-            forward();
-            return Token::symbol(str);
-        }
-        str.resize(1);
-        return Token::symbol(str);
+        tok.type = Token::SEP;
+        tok.str = src.substr(begin, 1);
     }
     char escape(bool allow_newline=false){
         //从 `\` 后开始读取
         char c = readChar();
         if(c=='x'){
-            auto hex = substr(2);
-            size_t len;
-            uint8_t byte = std::stoi(hex, &len, 16);
-            if(len != 2)throw unexpected(hex);
-            forwardx(2);
+            if(end-pos<2 || !isHex(src[pos]) || !isHex(src[pos+1]))
+                throw error("Invalid escape: expected 2 hex digits after '\\x'", pos);
+            uint8_t byte = std::stoi(string(src.substr(pos, 2)), nullptr, 16);
+            pos += 2;
             return byte;
-        }else if(c=='u')throw "todo: \\u";
-        else if('0'<=c && c<='9')throw "todo: \\0";
-        else if(c=='\n' && !allow_newline)throwError("cannot wrap inside SQ string");
+        }else if(c=='u' || ('0'<=c && c<='9'))throw error(string("unsupported escape '\\") + c + "'", pos-1);
+        else if(c=='\n' && !allow_newline)throw error("cannot wrap inside SQ string", pos-1);
         else if(escape_map.contains(c))return escape_map[c];
         return c;
     }
-    string readSQStr(){
-        //从单引号之后开始读取
-		//返回实际值
-        string value;
-        while(true){
-            char c = readChar();
-            if(c=='\'')return value;
-            if(c=='\\')value.push_back(escape());
-            else if(c=='\n')throwError("cannot wrap inside SQ string");
-            else value.push_back(c);
-        }
-    }
-    Token* readStrTmpl();
-    std::pair<string, Token*> readDQStr();
-    string readBQStr(){
-        //从反引号之后开始读取
-		//返回实际值
-        string value;
-        while(true){
-            char c = readChar();
-            if(c=='`')return value;
-            value.push_back(c);
-        }
+    std::string_view readSQStr();
+    std::string_view readDQStr();
+    std::string_view readBQStr(){
+        //从反引号之后开始读取，没有转义
+        size_t start = pos;
+        pos = offset(scan::find(at(pos), at(end), '`'));
+        readChar(); //读完则报错
+        return src.substr(start, pos-1-start);
     }
+    void skipGroup(char close);
 };
-Token* ScriptReader::read(){
-    if(cache){
-        auto _c = cache;
-        cache = nullptr;
-        return _c;
-    }
-    auto token = doRead();
-    if(!token)throwError("Unfinished input");
-    return token;
-}
-Token* ScriptReader::preview(){
-    if(!cache)cache = doRead();
+const Token* Lexer::preview(){
+    if(!cached){
+        mark = pos;
+        cacheEnd = !lex(cache);
+        cached = true;
+        if(!cacheEnd)last = cache.pos;
+    }
+    return cacheEnd ? nullptr : &cache;
+}
+Token Lexer::read(){
+    if(!preview())throw error("Unfinished input", pos);
+    cached = false;
     return cache;
 }
-Token* ScriptReader::doRead(){
+bool Lexer::lex(Token& tok){
     skipVoid();
-    if(eof())return nullptr;
+    if(eof())return false;
+    size_t start = pos;
     char c = readChar();
-    if(testChar(symchars, c))
-        return readSymbol(c);
-    else if(validWordStart(c))
-        return readWord(c);
-    else if('0'<=c && c<='9')
-        return new Token(Token::NUM, readNum(c));
-    else if(c=='\'')
-        return new Token(Token::STR, readSQStr());
-    else if(c=='"')return readStrTmpl();
-    else if(c=='`')return new Token(Token::STR, readBQStr());
-    else{
-        d_log(c);
-        throw "todo: doRead";
-    }
-}
-Token* ScriptReader::readStrTmpl(){
-    std::vector<string> slist;
-    std::vector<Token*> tlist;
+    tok = Token();
+    tok.pos = start;
+    if(c=='(' || c=='[' || c=='{'){
+        tok.type = c=='(' ? Token::PAREN : c=='[' ? Token::BRACKET : Token::BRACE;
+        tok.str = src.substr(start, 1);
+    }else if(c==')' || c==']' || c=='}'){
+        tok.type = Token::CLOSE;
+        tok.str = src.substr(start, 1);
+    }else if(testChar(symchars, c)){
+        readSymbol(tok);
+    }else if(validWordStart(c)){
+        pos = offset(scan::word(at(pos), at(end)));
+        tok.type = Token::WORD;
+        tok.str = src.substr(start, pos-start);
+        tok.name = SyntaxTree::building->intern(tok.str);
+        if(auto word = keywords.find(tok.str)){
+            tok.kw = word->kw;
+            tok.isBinop = word->isBinop;
+            tok.binop = word->binop;
+        }
+        tok.isValidVarname = tok.kw == Kw::none;
+    }else if('0'<=c && c<='9'){
+        readNum(c);
+        tok.type = Token::NUM;
+        tok.str = src.substr(start, pos-start);
+    }else if(c=='\''){
+        tok.type = Token::STR;
+        tok.str = readSQStr();
+    }else if(c=='"'){
+        tok.type = Token::DQ_STR;
+        tok.str = readDQStr();
+    }else if(c=='`'){
+        tok.type = Token::STR;
+        tok.str = readBQStr();
+    }else{
+        throw error("Invalid char", start);
+    }
+    return true;
+}
+std::string_view Lexer::readSQStr(){
+    //从单引号之后开始读取，返回实际值
+    //不含转义时直接返回源码中的片段，否则解码后存入 decoded
+    size_t start = pos;
+    string value;
+    bool escaped = false;
     while(true){
-        auto pair = readDQStr();
-        slist.push_back(pair.first);
-        if(pair.second)
-            tlist.push_back(pair.second);
-        else
-            return new StrTmpl(slist, tlist);
+        size_t stop = offset(scan::find(at(pos), at(end), '\'', '\\', '\n'));
+        if(escaped)value.append(src.substr(pos, stop-pos));
+        pos = stop;
+        char c = readChar();
+        if(c=='\'')break;
+        if(c=='\n')throw error("cannot wrap inside SQ string", pos-1);
+        if(!escaped){
+            value.assign(src.substr(start, pos-1-start));
+            escaped = true;
+        }
+        value.push_back(escape());
     }
+    if(!escaped)return src.substr(start, pos-1-start);
+    decoded.push_back(std::move(value));
+    return decoded.back();
 }
-std::pair<string, Token*> ScriptReader::readDQStr(){
-    string str;
+std::string_view Lexer::readDQStr(){
+    //从双引号之后开始读取，只检查格式并跳过 ${...}，返回引号之间的原文
+    size_t start = pos;
     while(true){
+        pos = offset(scan::find(at(pos), at(end), '"', '$', '\\'));
         char c = readChar();
-        if(c=='"')return {str, nullptr};
+        if(c=='"')return src.substr(start, pos-1-start);
         if(c=='$'){
             char next = readChar();
             if(next=='{'){
-                auto tl = readUntil('}');
-                return {str, new Enclosure(Token::BRACE, tl)};
-            }
-            if(validWordStart(next)){
-                return {str, readWord(next)};
+                skipGroup('}');
+            }else if(validWordStart(next)){
+                pos = offset(scan::word(at(pos), at(end)));
+            }else{
+                throw error("Invalid char", pos-1);
             }
-            throwError("Invalid char");
+        }else if(c=='\\'){
+            escape(true);
         }
-        if(c=='\\')str.push_back(escape(true));
-        else str.push_back(c);
     }
 }
-bool ScriptReader::skipComment(){
+bool Lexer::readTmplStr(string& str){
+    //从模板的原文中读取一段字符串，遇到 $ 时返回 true，读完时返回 false
+    while(true){
+        size_t stop = offset(scan::find(at(pos), at(end), '$', '\\', '$'));
+        str.append(src.substr(pos, stop-pos));
+        pos = stop;
+        if(eof())return false;
+        if(src[pos++]=='$')return true;
+        str.push_back(escape(true));
+    }
+}
+void Lexer::skipGroup(char close){
+    //跳过括号中的词法单元，直到与之匹配的闭括号（已读入开括号）
+    std::vector<char> closers{close};
+    Token tok;
+    while(!closers.empty()){
+        if(!lex(tok)){
+            auto err = missing(closers.back());
+            locate(err, pos);
+            throw err;
+        }
+        if(tok.type==Token::PAREN || tok.type==Token::BRACKET || tok.type==Token::BRACE){
+            closers.push_back(closerOf(tok.str[0]));
+        }else if(tok.type==Token::CLOSE){
+            if(tok.str[0]!=closers.back())throw error("Unexpected \"" + string(tok.str) + '"', tok.pos);
+            closers.pop_back();
+        }
+    }
+}
+bool Lexer::skipComment(){
     //跳过单行注释和多行注释
-    if(pos+1>=script.size() || script[pos]!='/')return false;
+    if(pos+1>=end || src[pos]!='/')return false;
 
-    if(script[pos+1]=='/'){
-        forwardx(2);
-        while(!eof() && script[pos]!='\n')forward();
+    if(src[pos+1]=='/'){
+        pos = offset(scan::find(at(pos+2), at(end), '\n'));
         return true;
     }
-    if(script[pos+1]=='*'){
-        forwardx(2);
+    if(src[pos+1]=='*'){
+        size_t start = pos;
+        pos += 2;
         while(true){
-            if(eof())throwError("Unfinished comment");
-            if(script[pos]=='*' && pos+1<script.size() && script[pos+1]=='/'){
-                forwardx(2);
+            pos = offset(scan::find(at(pos), at(end), '*'));
+            if(pos+1>=end)throw error("Unfinished comment", start);
+            if(src[pos+1]=='/'){
+                pos += 2;
                 return true;
             }
-            forward();
+            pos++;
         }
     }
     return false;
 }
+void Lexer::locate(JuaSyntaxError* err, size_t at){
+    if(lines.empty()){
+        lines.push_back(0);
+        for(size_t i = 0; i < src.size(); i++)
+            if(src[i]=='\n')lines.push_back(i+1);
+    }
+    size_t line = std::upper_bound(lines.begin(), lines.end(), at) - lines.begin();
+    err->pos = at;
+    err->line = line;
+    err->col = at - lines[line-1] + 1;
+}
+
+struct Group: TokensReader{
+    //括号中的词法单元：读到与开括号匹配的闭括号时视为读完（不读入闭括号）
+    //解析完括号中的内容后须调用 close 读入闭括号
+    //直接从词法分析器读取：括号中的闭括号都属于内层的 Group，不会经过外层
+    Lexer& source;
+    char closer;
+    Group(TokensReader& outer, const Token& open): source(outer.lexer()), closer(closerOf(open.str[0])){}
+    const Token* preview(){
+        auto next = source.preview();
+        if(!next)throw missing(closer);
+        if(next->type != Token::CLOSE)return next;
+        if(next->str[0] == closer)return nullptr;
+        throw unexpected(string(next->str));
+    }
+    Token read(){
+        if(!preview())throw new JuaSyntaxError("Unfinished input");
+        return source.read();
+    }
+    size_t save(){
+        return source.save();
+    }
+    void restore(size_t p){
+        source.restore(p);
+    }
+    Lexer& lexer(){
+        return source;
+    }
+    void close(){
+        assetEnd();
+        source.read();
+    }
+    void skip(){
+        //跳过括号中的内容和闭括号
+        while(!end()){
+            auto token = read();
+            if(token.type==Token::PAREN || token.type==Token::BRACKET || token.type==Token::BRACE)
+                Group(*this, token).skip();
+        }
+        source.read();
+    }
+};
 
 Expr* parsePrimaryTail(Expr*, TokensReader&);
 Expr* parseExpr(TokensReader&);
@@ -489,7 +582,7 @@ DeclarationItem* parseDecItem(TokensReader& reader){
     Declarable* declarable = parseDeclarable(reader);
 	Expr* defval = nullptr;
 	bool auto_null = false;
-	string next = reader.previewStr();
+	auto next = reader.previewStr();
 	if(next=="?"){
 		reader.read();
 		auto_null = true;
@@ -497,7 +590,7 @@ DeclarationItem* parseDecItem(TokensReader& reader){
 		reader.read();
 		defval = parseExpr(reader);
 	}
-	DeclarationItem* item = new DeclarationItem(declarable, defval); //todo: src
+	DeclarationItem* item = newNode<DeclarationItem>(declarable, defval); //todo: src
 	if(auto_null)item->addDefault();
 	return item;
 }
@@ -508,41 +601,45 @@ DeclarationList* parseDecList(TokensReader& reader){
 		if(reader.previewStr()==",")
 			reader.read();
 		else
-			return new DeclarationList(items);
+			return newNode<DeclarationList>(items);
 	}
 }
 DeclarationList* parseFlexDecList(TokensReader& reader){
     //可空，可尾随逗号，读完 reader
     std::deque<DeclarationItem*> items;
     while(true){
-        if(reader.end())return new DeclarationList(items);
+        if(reader.end())return newNode<DeclarationList>(items);
         items.push_back(parseDecItem(reader));
-        if(reader.end())return new DeclarationList(items);
+        if(reader.end())return newNode<DeclarationList>(items);
         reader.assertStr(",");
     }
 }
 Declarable* parseLeftObj(TokensReader& reader);
 Declarable* parseDeclarable(TokensReader& reader){
     auto next = reader.read();
-    if(next->isValidVarname)return new Varname(next->str);
-    if(next->type == Token::BRACKET){
-        auto cl = static_cast<Enclosure*>(next);
-        return parseFlexDecList(cl->reader);
+    if(next.isValidVarname)return newNode<Varname>(next.name);
+    if(next.type == Token::BRACKET){
+        Group group(reader, next);
+        auto list = parseFlexDecList(group);
+        group.close();
+        return list;
     }
-    if(next->type == Token::BRACE){
-        auto cl = static_cast<Enclosure*>(next);
-        return parseLeftObj(cl->reader);
+    if(next.type == Token::BRACE){
+        Group group(reader, next);
+        auto obj = parseLeftObj(group);
+        group.close();
+        return obj;
     }
-    throw unexpected(next->str, "<declarable>");
+    throw unexpected(string(next.str), "<declarable>");
 }
 
 Expr* parseCond(TokensReader& reader){
     //todo: if !(...)
     auto head = reader.read();
-    if(head->type!=Token::PAREN)throw unexpected(head->str, "(...)");
-    auto cl = static_cast<Enclosure*>(head);
-    auto cond = parseExpr(cl->reader);
-    cl->reader.assetEnd();
+    if(head.type!=Token::PAREN)throw unexpected(string(head.str), "(...)");
+    Group group(reader, head);
+    auto cond = parseExpr(group);
+    group.close();
     return cond;
 }
 FlexibleList* parseFlexExprList(TokensReader& reader){
@@ -550,89 +647,106 @@ FlexibleList* parseFlexExprList(TokensReader& reader){
     //todo: *
     std::vector<Expr*> exprs;
     while(true){
-        if(reader.end())return new FlexibleList(exprs);
+        if(reader.end())return newNode<FlexibleList>(exprs);
         exprs.push_back(parseExpr(reader));
-        if(reader.end())return new FlexibleList(exprs);
+        if(reader.end())return newNode<FlexibleList>(exprs);
         reader.assertStr(",");
     }
 }
+Expr* parseTemplate(Lexer& outer, const Token& token){
+    //词法分析时只检查了模板的格式，这里再从原文中拆出字符串和 $name、${expr}
+    Lexer lexer(outer.src, token.pos+1, token.pos+1+token.str.size());
+    std::vector<string> strList;
+    std::vector<Expr*> exprs;
+    while(true){
+        string str;
+        bool more = lexer.readTmplStr(str);
+        strList.push_back(str);
+        if(!more)return newNode<Template>(strList, exprs);
+        if(lexer.skipChar('{')){
+            Group group(lexer, Token{.str = "{"});
+            exprs.push_back(parseExpr(group));
+            group.close();
+        }else{
+            auto name = lexer.read();
+            if(!name.isValidVarname)throw unexpected(string(name.str), "<varname>");
+            exprs.push_back(newNode<Varname>(name.name));
+        }
+    }
+}
 Expr* parsePrimary(TokensReader& reader){
     auto start = reader.read();
-    switch (start->type){
+    switch (start.type){
     case Token::WORD:{
-        if(start->isValidVarname)
-            return parsePrimaryTail(new Varname(start->str), reader);
-        if(start->str=="null")
+        switch(start.kw){
+        case Kw::none:
+            return parsePrimaryTail(newNode<Varname>(start.name), reader);
+        case Kw::null:
             return parsePrimaryTail(Keyword::null, reader);
-        if(start->str=="true")
+        case Kw::true_:
             return parsePrimaryTail(Keyword::t, reader);
-        if(start->str=="false")
+        case Kw::false_:
             return parsePrimaryTail(Keyword::f, reader);
-        if(start->str=="local")
+        case Kw::local:
             return parsePrimaryTail(Keyword::local, reader);
-        if(start->str=="fun"){
+        case Kw::fun:{
             auto func = parseFunc(reader);
             return parsePrimaryTail(func, reader);
         }
-        if(start->str=="if"){
+        case Kw::if_:{
             auto cond = parseCond(reader);
             auto expr = parseExpr(reader);
             reader.assertStr("else");
             auto elseExpr = parseExpr(reader);
-            return new TernaryExpr(cond, expr, elseExpr);
+            return newNode<TernaryExpr>(cond, expr, elseExpr);
+        }
+        default:
+            throw unexpected(string(start.str), "<primary>");
         }
-        throw unexpected(start->str, "<primary>");
     }
     case Token::NUM:{
-        return parsePrimaryTail(LiteralNum::eval(start->str), reader);
+        return parsePrimaryTail(LiteralNum::eval(string(start.str)), reader);
     }
     case Token::STR:{
-        return parsePrimaryTail(new LiteralStr(start->str), reader);
+        return parsePrimaryTail(newNode<LiteralStr>(string(start.str)), reader);
     }
     case Token::DQ_STR:{
-        auto dqstr = static_cast<StrTmpl*>(start);
-        std::vector<Expr*> exprs;
-        for(auto token: dqstr->tokenList){
-            if(token->isValidVarname){
-                exprs.push_back(new Varname(token->str));
-            }else if(token->type==Token::BRACE){
-                auto cl = static_cast<Enclosure*>(token);
-                exprs.push_back(parseExpr(cl->reader));
-                cl->reader.assetEnd();
-            }
-        }
-        return new Template(dqstr->strList, exprs);
+        return parseTemplate(reader.lexer(), start);
     }
     case Token::PAREN:{
-        auto cl = static_cast<Enclosure*>(start);
-        auto expr = parseExpr(cl->reader);
-        cl->reader.assetEnd();
+        Group group(reader, start);
+        auto expr = parseExpr(group);
+        group.close();
         return parsePrimaryTail(expr, reader);
     }
     case Token::BRACE:{
-        auto cl = static_cast<Enclosure*>(start);
-        auto expr = parseObj(cl->reader);
+        Group group(reader, start);
+        auto expr = parseObj(group);
+        group.close();
         return parsePrimaryTail(expr, reader);
     }
     case Token::BRACKET:{
-        auto cl = static_cast<Enclosure*>(start);
+        Group group(reader, start);
         ArrayExpr* arr;
-        if(cl->reader.end())
-            arr = new ArrayExpr({});
-        else{
-            auto list = parseFlexExprList(cl->reader);
-            cl->reader.assetEnd();
-            arr = new ArrayExpr(list);
-        }
+        if(group.end())
+            arr = newNode<ArrayExpr>(nullptr);
+        else
+            arr = newNode<ArrayExpr>(parseFlexExprList(group));
+        group.close();
         return parsePrimaryTail(arr, reader);
     }
     case Token::UNIOP:{
-        return new UnitaryExpr(uniOpers[start->str], parsePrimary(reader));
+        return newNode<UnitaryExpr>(start.uniop, parsePrimary(reader));
     }
     default:
-        throw unexpected(start->str, "<primary>");
+        throw unexpected(string(start.str), "<primary>");
     }
 }
+static Call* newCall(Expr* calee, FlexibleList* args){
+    //obj:method 紧跟调用时融合为 MethodCall，不创建绑定函数
+    if(auto meth = dynamic_cast<MethWrapper*>(calee))return newNode<MethodCall>(meth, args);
+    return newNode<Call>(calee, args);
+}
 Expr* parsePrimaryTail(Expr* start, TokensReader& reader){
     auto next = reader.preview();
     if(!next)return start;
@@ -641,64 +755,83 @@ Expr* parsePrimaryTail(Expr* start, TokensReader& reader){
             if(next->str=="."){ //属性引用
                 reader.read();
                 auto id = reader.read();
-                if(id->type!=Token::WORD)throw unexpected(id->str, "<property name>");
-                auto expr = new PropRef(start, id->str);
+                if(id.type!=Token::WORD)throw unexpected(string(id.str), "<property name>");
+                auto expr = newNode<PropRef>(start, id.name);
                 return parsePrimaryTail(expr, reader);
             }else if(next->str=="?."){
                 reader.read();
                 auto id = reader.read();
-                if(id->type!=Token::WORD)throw unexpected(id->str, "<property name>");
-                auto expr = new OptionalPropRef(start, id->str);
+                if(id.type!=Token::WORD)throw unexpected(string(id.str), "<property name>");
+                auto expr = newNode<OptionalPropRef>(start, id.name);
                 return parsePrimaryTail(expr, reader);
             }else if(next->str==":"){ //方法包装
                 reader.read();
                 auto name = reader.read();
-                if(name->type!=Token::WORD)throw unexpected(name->str, "<method name>");
-                auto wrapper = new MethWrapper(start, name->str);
+                if(name.type!=Token::WORD)throw unexpected(string(name.str), "<method name>");
+                auto wrapper = newNode<MethWrapper>(start, name.name);
                 return parsePrimaryTail(wrapper, reader);
             }
             return start;
         case Token::PAREN:{
-            reader.read();
-            auto cl = static_cast<Enclosure*>(next);
+            auto open = reader.read();
+            auto mark = reader.save();
+            FlexibleList* args = nullptr;
+            JuaError* err = nullptr;
+            std::exception_ptr thrown;
+            try{
+                Group group(reader, open);
+                args = parseFlexExprList(group);
+                group.close();
+            }catch(JuaError* e){
+                //尾随函数的参数列表不一定是合法的表达式，如 f(x?){...}，先跳过括号看后面是否有函数体
+                //跳过会移动词法分析器，须在此之前定位语法错误
+                if(auto se = dynamic_cast<JuaSyntaxError*>(e); se && se->line == JuaSyntaxError::npos)reader.lexer().locate(se);
+                err = e;
+                thrown = std::current_exception();
+                reader.restore(mark);
+                Group(reader, open).skip();
+            }
             Call* call;
             auto funbody = reader.preview();
             if(funbody && funbody->type==Token::BRACE){
-                reader.read();
-                auto params = parseDecList(cl->reader);
-                auto cl2 = static_cast<Enclosure*>(funbody);
-                auto stmts = parseStatements(cl2->reader);
-                auto func = new FunExpr(params, stmts);
-                auto args = new FlexibleList({func});
-                call = new Call(start, args);
+                //尾随函数 f(params){body}：回到括号中按参数列表重新解析
+                delete err;
+                reader.restore(mark);
+                Group group(reader, open);
+                auto params = parseDecList(group);
+                group.close();
+                Group block(reader, reader.read());
+                auto stmts = parseStatements(block);
+                block.close();
+                auto func = newNode<FunExpr>(params, stmts);
+                auto args = newNode<FlexibleList>(initializer_list<Expr*>{func});
+                call = newCall(start, args);
             }else{
-                auto args = parseFlexExprList(cl->reader);
-                call = new Call(start, args);
+                if(thrown)std::rethrow_exception(thrown);
+                call = newCall(start, args);
             }
             return parsePrimaryTail(call, reader);
         }
         case Token::BRACKET:{
-            reader.read();
-            auto cl = static_cast<Enclosure*>(next);
-			auto key = parseExpr(cl->reader);
-			cl->reader.assetEnd();
-			auto expr = new Subscription(start, key);
+            Group group(reader, reader.read());
+			auto key = parseExpr(group);
+			group.close();
+			auto expr = newNode<Subscription>(start, key);
 			return parsePrimaryTail(expr, reader);
         }
         case Token::BRACE:{
-            reader.read();
-            auto cl = static_cast<Enclosure*>(next);
-            auto stmts = parseStatements(cl->reader);
-            auto decList = new DeclarationList({});
-            auto func = new FunExpr(decList, stmts);
-            auto args = new FlexibleList({func});
-            auto call = new Call(start, args);
+            Group block(reader, reader.read());
+            auto stmts = parseStatements(block);
+            block.close();
+            auto decList = newNode<DeclarationList>(std::deque<DeclarationItem*>{});
+            auto func = newNode<FunExpr>(decList, stmts);
+            auto args = newNode<FlexibleList>(initializer_list<Expr*>{func});
+            auto call = newCall(start, args);
             return parsePrimaryTail(call, reader);
         }
         case Token::STR:{
-            reader.read();
-            auto str = new LiteralStr(next->str);
-            auto call = new Call(start, new FlexibleList({str}));
+            auto str = newNode<LiteralStr>(string(reader.read().str));
+            auto call = newCall(start, newNode<FlexibleList>(initializer_list<Expr*>{str}));
             return parsePrimaryTail(call, reader);
         }
         case Token::DQ_STR:{
@@ -716,14 +849,13 @@ Expr* parseExpr(TokensReader& reader){
     if(next->isBinop){
         return parseBinExpr(reader, start);
     }else if(next->str == "="){
-        reader.read();
+        auto eq = reader.read();
         auto left = dynamic_cast<LeftValue*>(start);
-        if(!left)throw unexpected(next->str, "<left value>");
-        return new Assignment(left, parseExpr(reader));
-    }else if(assigners.contains(next->str)){
-        reader.read();
-        BinOper type = binOpers[next->str.substr(0, next->str.size()-1)];
-        return new OperAssignment(type, start, parseExpr(reader));
+        if(!left)throw unexpected(string(eq.str), "<left value>");
+        return newNode<Assignment>(left, parseExpr(reader));
+    }else if(next->isAssigner){
+        auto type = reader.read().binop;
+        return newNode<OperAssignment>(type, start, parseExpr(reader));
     }
     return start;
 }
@@ -736,20 +868,19 @@ Expr* parseBinExpr(TokensReader& reader, Expr* start){
     auto combineExpr = [&](int priority = 0) {
         while(!operstack.empty()) {
             BinOper oper = operstack.back();
-            if(binOperPriority[oper] < priority) return;
+            if(binOperPriority[size_t(oper)] < priority) return;
             operstack.pop_back();
             Expr* right = exprstack.back(); exprstack.pop_back();
             Expr* left = exprstack.back(); exprstack.pop_back();
-            exprstack.push_back(new BinaryExpr(oper, left, right));
+            exprstack.push_back(newNode<BinaryExpr>(oper, left, right));
         }
     };
 
     while(true){
-        Token* next = reader.preview();
+        auto next = reader.preview();
         if(!next || !next->isBinop) break;
-        reader.read();
-        auto oper = binOpers[next->str];
-        combineExpr(binOperPriority[oper]);
+        auto oper = reader.read().binop;
+        combineExpr(binOperPriority[size_t(oper)]);
         operstack.push_back(oper);
         Expr* pri = parsePrimary(reader);
         exprstack.push_back(pri);
@@ -760,34 +891,36 @@ Expr* parseBinExpr(TokensReader& reader, Expr* start){
 std::pair<Expr*, Expr*> parseProp(TokensReader& reader){
     Expr *key, *val;
 	auto start = reader.read();
-	if(start->type==Token::WORD){
-		key = new LiteralStr(start->str);
+	if(start.type==Token::WORD){
+		key = newNode<LiteralStr>(string(start.str));
 		auto next = reader.preview();
 		if(next && next->str=="="){
 			reader.read();
 			val = parseExpr(reader);
 		}else if(next && next->type==Token::PAREN){
 			val = parseFunc(reader);
-		}else if(start->isValidVarname){
-			val = new Varname(start->str);
+		}else if(start.isValidVarname){
+			val = newNode<Varname>(start.name);
 		}else{
-			throw new JuaSyntaxError("Invalid Varname", -1, -1, -1);
+			throw new JuaSyntaxError("Invalid Varname");
 		}
-	}else if(start->type==Token::BRACKET){
-        auto cl = static_cast<Enclosure*>(start);
-		key = parseExpr(cl->reader);
-		cl->reader.assetEnd();
+	}else if(start.type==Token::BRACKET){
+        Group group(reader, start);
+		key = parseExpr(group);
+		group.close();
 		auto next = reader.preview();
 		if(!next)
-			throw new JuaSyntaxError("Unfinished input", -1, -1, -1);
+			throw new JuaSyntaxError("Unfinished input");
 		if(next->str=="="){
 			reader.read();
 			val = parseExpr(reader);
 		}else if(next->type==Token::PAREN){
 			val = parseFunc(reader);
 		}else{
-			throw unexpected(next->str);
+			throw unexpected(string(next->str));
 		}
+	}else{
+		throw unexpected(string(start.str), "<property>");
 	}
 	return {key, val};
 }
@@ -797,66 +930,68 @@ Expr* parseObj(TokensReader& reader){
 	while(true){
 		//此时刚开始读取或读完上一个逗号
 		if(reader.end()){ //允许尾随逗号
-			return new ObjExpr(entries);
+			return newNode<ObjExpr>(entries);
 		}
 		entries.push_back(parseProp(reader));
 		if(reader.end())
-			return new ObjExpr(entries);
+			return newNode<ObjExpr>(entries);
 		reader.assertStr(",");
 	}
 }
 Expr* parseFunc(TokensReader& reader){
-    //从 Enclosure 开始读取
-	auto _args = reader.read();
-	if(_args->type != Token::PAREN)
+    //从参数列表的括号开始读取
+	auto open = reader.read();
+	if(open.type != Token::PAREN)
 		throw missing('(');
-    auto args = static_cast<Enclosure*>(_args);
-	auto decList = parseFlexDecList(args->reader);
+    Group args(reader, open);
+	auto decList = parseFlexDecList(args);
+	args.close();
 	Stmts stmts;
 	auto next = reader.read();
-	if(next->type == Token::BRACE){
-        auto cl = static_cast<Enclosure*>(next);
-		stmts = parseStatements(cl->reader);
-	}else if(next->str == "="){
+	if(next.type == Token::BRACE){
+        Group block(reader, next);
+		stmts = parseStatements(block);
+		block.close();
+	}else if(next.str == "="){
 		auto expr = parseExpr(reader);
-		stmts = Stmts({new Return(expr)});
+		stmts = Stmts({newNode<Return>(expr)});
 	}else{
-		throw unexpected(next->str);
+		throw unexpected(string(next.str));
 	}
-	return new FunExpr(decList, stmts);
+	return newNode<FunExpr>(decList, stmts);
 }
 std::pair<Expr*, DeclarationItem*> parseLeftProp(TokensReader& reader){
     Expr* key;
     DeclarationItem* decItem;
-	auto next = reader.read();
-	if(next->type==Token::WORD){
-		string name = next->str;
-		key = new LiteralStr(name);
-		next = reader.preview();
+	auto start = reader.read();
+	if(start.type==Token::WORD){
+		Atom name = start.name;
+		key = newNode<LiteralStr>(name.str());
+		auto next = reader.preview();
 		if(next){
 			if(next->str=="?"){
 				reader.read();
-				decItem = new DeclarationItem(new Varname(name), Keyword::null);
+				decItem = newNode<DeclarationItem>(newNode<Varname>(name), Keyword::null);
 			}else if(next->str=="="){
 				reader.read();
-				decItem = new DeclarationItem(new Varname(name), parseExpr(reader));
+				decItem = newNode<DeclarationItem>(newNode<Varname>(name), parseExpr(reader));
 			}else if(next->str=="as"){
 				reader.read();
 				decItem = parseDecItem(reader);
 			}else{
-				decItem = new DeclarationItem(new Varname(name));
+				decItem = newNode<DeclarationItem>(newNode<Varname>(name));
 			}
 		}else{
-			decItem = new DeclarationItem(new Varname(name));
+			decItem = newNode<DeclarationItem>(newNode<Varname>(name));
 		}
-	}else if(next->type==Token::BRACKET){
-        auto cl = static_cast<Enclosure*>(next);
-		key = parseExpr(cl->reader);
-		cl->reader.assetEnd();
+	}else if(start.type==Token::BRACKET){
+        Group group(reader, start);
+		key = parseExpr(group);
+		group.close();
 		reader.assertStr("as");
 		decItem = parseDecItem(reader);
 	}else{
-		throw unexpected(next->str);
+		throw unexpected(string(start.str));
 	}
 	return {key, decItem};
 }
@@ -868,11 +1003,11 @@ Declarable* parseLeftObj(TokensReader& reader){
 		if(reader.end()){
 			if(!entries.size())
 				throw new JuaError("LeftObj cannot be empty");
-			return new LeftObj(entries);
+			return newNode<LeftObj>(entries);
 		}
 		entries.push_back(parseLeftProp(reader));
 		if(reader.end())
-			return new LeftObj(entries);
+			return newNode<LeftObj>(entries);
 		reader.assertStr(",");
 	}
 }
@@ -885,55 +1020,46 @@ Statement* parseStatement(TokensReader& reader){
         reader.read();
         return nullptr; //空语句
     }
-    if(start->isKeyword){
-        if(start->str=="return"){
-            reader.read();
-            if(reader.skipStr(";"))return new Return;
+    if(start->kw != Kw::none){
+        auto keyword = reader.read();
+        switch(keyword.kw){
+        case Kw::return_:{
+            if(reader.skipStr(";"))return newNode<Return>();
             auto expr = parseExpr(reader);
             reader.skipStr(";");
-            return new Return(expr);
+            return newNode<Return>(expr);
         }
-        if(start->str=="break"){
-            reader.read();
+        case Kw::break_:{
             reader.skipStr(";");
-            return new Break;
+            return newNode<Break>(keyword.pos);
         }
-        if(start->str=="continue"){
-            reader.read();
+        case Kw::continue_:{
             reader.skipStr(";");
-            return new Continue;
+            return newNode<Continue>(keyword.pos);
         }
-        if(start->str=="let"){
-            reader.read();
+        case Kw::let:{
             auto list = parseDecList(reader);
             reader.skipStr(";");
-            return new Declaration(list);
+            return newNode<Declaration>(list);
         }
-        if(start->str=="fun"){
-            reader.read();
+        case Kw::fun:{
             auto name = reader.read();
-            if(!name->isValidVarname)throw "Invalid function name";
+            if(!name.isValidVarname)throw reader.lexer().error("Invalid function name", name.pos);
             auto func = parseFunc(reader);
-            auto assignment = new DeclarationItem(new Varname(name->str), func);
-            return new Declaration(new DeclarationList({assignment}));
+            auto assignment = newNode<DeclarationItem>(newNode<Varname>(name.name), func);
+            return newNode<Declaration>(newNode<DeclarationList>(std::deque<DeclarationItem*>{assignment}));
         }
-        if(start->str=="if"){
-            reader.read();
+        case Kw::if_:{
             auto cond = parseCond(reader);
             auto block = parseBlockOrStatement(reader);
             if(reader.skipStr("else")){
                 auto elseBlock = parseBlockOrStatement(reader);
-                return new IfStmt(cond, block, elseBlock);
+                return newNode<IfStmt>(cond, block, elseBlock);
             }
-            return new IfStmt(cond, block, nullptr);
+            return newNode<IfStmt>(cond, block, nullptr);
         }
-        if(start->str=="switch"){
-            reader.read();
-            auto next = reader.read();
-            if(next->type!=Token::PAREN)throw unexpected(next->str, "(...)");
-            auto cl = static_cast<Enclosure*>(next);
-            auto expr = parseExpr(cl->reader);
-            cl->reader.assetEnd();
+        case Kw::switch_:{
+            auto expr = parseCond(reader);
             std::vector<CaseBlock*> cases;
             Block* defaultBlock = nullptr;
             while(true){
@@ -941,12 +1067,13 @@ Statement* parseStatement(TokensReader& reader){
                 if(nextStr=="case"){
                     reader.read();
                     auto next = reader.read();
-                    if(next->type!=Token::PAREN)throw unexpected(next->str, "(...)");
-                    auto cl = static_cast<Enclosure*>(next);
-                    auto cond = parseFlexExprList(cl->reader);
-                    if(cond->exprs.empty())throw new JuaSyntaxError("Empty case condition", -1, -1, -1);
+                    if(next.type!=Token::PAREN)throw unexpected(string(next.str), "(...)");
+                    Group group(reader, next);
+                    auto cond = parseFlexExprList(group);
+                    group.close();
+                    if(cond->exprs.empty())throw new JuaSyntaxError("Empty case condition");
                     auto block = parseBlockOrStatement(reader);
-                    cases.push_back(new CaseBlock(cond, block));
+                    cases.push_back(newNode<CaseBlock>(cond, block));
                 }else if(nextStr=="else"){
                     reader.read();
                     defaultBlock = parseBlockOrStatement(reader);
@@ -956,31 +1083,37 @@ Statement* parseStatement(TokensReader& reader){
                 }
             }
             if(cases.empty())
-                throw new JuaSyntaxError("Switch statement must have at least one case", -1, -1, -1);
-            return new SwitchStmt(expr, cases, defaultBlock);
+                throw new JuaSyntaxError("Switch statement must have at least one case");
+            return newNode<SwitchStmt>(expr, cases, defaultBlock);
         }
-        if(start->str=="while"){
-            reader.read();
+        case Kw::while_:{
             auto cond = parseCond(reader);
             auto block = parseBlockOrStatement(reader);
-            return new WhileStmt(cond, block);
+            return newNode<WhileStmt>(cond, block);
         }
-        if(start->str=="for"){
-            reader.read();
+        case Kw::for_:{
             auto next = reader.read();
-            if(next->type!=Token::PAREN)throw unexpected(next->str, "(...)");
-            auto cl = static_cast<Enclosure*>(next);
-            auto declarable = parseDeclarable(cl->reader);
-            cl->reader.assertStr("in");
-            auto iterable = parseExpr(cl->reader);
-            cl->reader.assetEnd();
+            if(next.type!=Token::PAREN)throw unexpected(string(next.str), "(...)");
+            Group group(reader, next);
+            auto declarable = parseDeclarable(group);
+            group.assertStr("in");
+            auto iterable = parseExpr(group);
+            group.close();
             auto body = parseBlockOrStatement(reader);
-            return new ForStmt(declarable, iterable, body);
+            return newNode<ForStmt>(declarable, iterable, body);
+        }
+        default:
+            throw unexpected(string(keyword.str), "<statement>");
         }
-        throw unexpected(start->str, "<statement>");
     }
     auto expr =  parseExpr(reader);
-    return new ExprStatement(expr);
+    return newNode<ExprStatement>(expr);
+}
+FunctionBody::FunctionBody(Stmts stmts): Block(stmts){
+    if(pending_continue)
+        throw new JuaSyntaxError("continue outside a loop", static_cast<Continue*>(pending_continue)->pos, JuaSyntaxError::npos, JuaSyntaxError::npos);
+    if(pending_break)
+        throw new JuaSyntaxError("break outside a loop", static_cast<Break*>(pending_break)->pos, JuaSyntaxError::npos, JuaSyntaxError::npos);
 }
 Stmts parseStatements(TokensReader& reader){
     Stmts stmts;
@@ -992,22 +1125,78 @@ Stmts parseStatements(TokensReader& reader){
 }
 Block* parseBlockOrStatement(TokensReader& reader){
     auto next = reader.preview();
-    if(!next)throw new JuaSyntaxError("Unfinished input", -1, -1, -1);
+    if(!next)throw new JuaSyntaxError("Unfinished input");
     if(next->type==Token::BRACE){
-        auto cl = static_cast<Enclosure*>(reader.read());
-        auto stmts = parseStatements(cl->reader);
-        return new Block(stmts);
+        Group block(reader, reader.read());
+        auto stmts = parseStatements(block);
+        block.close();
+        return newNode<Block>(stmts);
     }else{
         auto stmt = parseStatement(reader);
-        if(!stmt)return new Block({}); //空语句
-        return new Block({stmt});
+        if(!stmt)return newNode<Block>(Stmts{}); //空语句
+        return newNode<Block>(Stmts{stmt});
+    }
+}
+
+Atom SyntaxTree::intern(std::string_view str){
+    auto it = names.find(str);
+    if(it != names.end())return it->second;
+    auto atom = Atom::hold(str);
+    names.emplace(atom.str(), atom);
+    return atom;
+}
+SyntaxTree::~SyntaxTree(){
+    for(auto& [str, atom]: names){
+        Atom::drop(atom);
     }
+    live--;
 }
 
-FunctionBody* parse(const string& script){
+size_t tokenize(const string& script){
+    //词法单元中的名字同解析时一样驻留，由临时的语法树持有
+    SyntaxTree tree;
+    auto outer = SyntaxTree::building;
+    SyntaxTree::building = &tree;
+    size_t count = 0;
+    try{
+        Lexer lexer(script);
+        while(lexer.preview()){
+            lexer.read();
+            count++;
+        }
+    }catch(...){
+        SyntaxTree::building = outer;
+        throw;
+    }
+    SyntaxTree::building = outer;
+    return count;
+}
+FunctionBody* parse(const string& script, bool dump){
     //d_log("Parsing script:");
     //d_log(script);
-    ScriptReader reader(script);
-    auto stmts = parseStatements(reader);
-    return new FunctionBody(stmts);
-}
\ No newline at end of file
+    auto tree = new SyntaxTree;
+    auto outer = SyntaxTree::building;
+    SyntaxTree::building = tree;
+    FunctionBody* body;
+    try{
+        {
+            //词法单元在解析时按需从 script 中读出，不复制源码，也不留到解析之后
+            Lexer lexer(script);
+            try{
+                body = newNode<FunctionBody>(parseStatements(lexer));
+            }catch(JuaSyntaxError* err){
+                if(err->line == JuaSyntaxError::npos)lexer.locate(err);
+                throw;
+            }
+        }
+        optimize(body, dump);
+        resolve(body);
+    }catch(...){
+        //释放整棵语法树：抛出的只能是堆上的 JuaError 等，不能是树中节点的指针
+        SyntaxTree::building = outer;
+        delete tree;
+        throw;
+    }
+    SyntaxTree::building = outer;
+    return body;
+}
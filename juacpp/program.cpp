@@ -1,26 +1,37 @@
 #include "jua-syntax.h"
 #include "jua-vm.h"
 
-Jua_Val* LiteralStr::calc(Scope* env){
-    return new Jua_Str(env->vm, value);
+Jua_Str* LiteralStr::get(JuaVM* vm){
+    if(cacheVM != vm){
+        cached = new Jua_Str(vm, value);
+        vm->literals.push_back(cached);
+        cacheVM = vm;
+    }
+    return cached;
+}
+LiteralStr::~LiteralStr(){
+    if(cacheVM)std::erase(cacheVM->literals, cached);
+}
+Jua_Val LiteralStr::calc(Scope* env){
+    return get(env->vm);
 }
-Jua_Val* Template::calc(Scope* env){
+Jua_Val Template::calc(Scope* env){
     string str = strList[0];
     for(size_t i=0; i<exprList.size(); i++){
         auto val = exprList[i]->calc(env);
-        str += val->toString();
+        str += val.toString();
         str += strList[i+1];
     }
     return new Jua_Str(env->vm, str);
 }
 LiteralNum* LiteralNum::eval(const string& str){
-    return new LiteralNum(std::stod(str));
+    return newNode<LiteralNum>(std::stod(str));
 }
-Jua_Val* LiteralNum::calc(Scope* env){
-    return new Jua_Num(env->vm, value);
+Jua_Val LiteralNum::calc(Scope* env){
+    return Jua_Num(value);
 }
 
-Jua_Val* Keyword::calc(Scope* env){
+Jua_Val Keyword::calc(Scope* env){
     switch (type){
         case 'n': return Jua_Null::getInst();
         case 't': return Jua_Bool::getInst(true);
@@ -34,20 +45,52 @@ Keyword* Keyword::t = new Keyword('t');
 Keyword* Keyword::f = new Keyword('f');
 Keyword* Keyword::local = new Keyword('l');
 
-Jua_Val* Varname::calc(Scope* env){
-    auto val = env->getProp(str);
+Scope* Varname::target(Scope* env){
+    //按 depth 找到变量所在的作用域；途中的作用域被动态修改过（如通过 local）时返回 nullptr，需按名称查找
+    if(depth < 0)return nullptr;
+    auto scope = env;
+    for(int i = 0; i < depth; i++){
+        if(scope->shape != scope->layout || !scope->parent)return nullptr;
+        scope = scope->parent;
+    }
+    return scope;
+}
+Jua_Val Varname::calc(Scope* env){
+    Jua_Val val;
+    auto scope = target(env);
+    if(!scope){
+        val = env->getProp(name);
+    }else if(slot < 0){
+        val = scope->getProp(name);
+    }else if(scope->shape == scope->layout){
+        val = scope->slots[slot];
+        if(!val && scope->parent)val = scope->parent->getProp(name); //尚未声明
+    }else{
+        val = env->getProp(name);
+    }
     if(!val){
         string msg = "Var not declared: ";
-        msg.append(str);
+        msg.append(name.str());
         throw new JuaErrorWithVal(msg, env);
     }
     return val;
 }
-void Varname::assign(Scope* env, Jua_Val* val){
-    env->assign(str, val);
+void Varname::assign(Scope* env, Jua_Val val){
+    auto scope = target(env);
+    if(scope && slot >= 0 && scope->shape == scope->layout && scope->slots[slot]){
+        env->vm->gc.barrier(scope, val);
+        scope->slots[slot] = val;
+        return;
+    }
+    env->assign(name, val);
 }
-void Varname::declare(Scope* env, Jua_Val* val){
-    env->setProp(str, val);
+void Varname::declare(Scope* env, Jua_Val val){
+    if(depth == 0 && slot >= 0 && env->shape == env->layout){
+        env->vm->gc.barrier(env, val);
+        env->slots[slot] = val;
+        return;
+    }
+    env->setProp(name, val);
 }
 
 void FlexibleList::appendTo(Scope* env, jualist& list){
@@ -65,17 +108,19 @@ void DeclarationItem::addDefault(){
     if(!initval)initval = Keyword::null;
     body->addDefault();
 }
-void DeclarationItem::assign(Scope* env, Jua_Val* val){
-    if(!val)val = initval->calc(env);
+void DeclarationItem::assign(Scope* env, Jua_Val val){
+    RootGuard guard(env->vm->gc);
+    if(!val)guard.push(val = initval->calc(env));
     body->assign(env, val);
 }
-void DeclarationItem::declare(Scope* env, Jua_Val* val){
-    if(!val)val = initval->calc(env);
+void DeclarationItem::declare(Scope* env, Jua_Val val){
+    RootGuard guard(env->vm->gc);
+    if(!val)guard.push(val = initval->calc(env));
     body->declare(env, val);
 }
 
-void DeclarationList::assign(Scope *env, Jua_Val *val){
-    auto it = val->getIterator();
+void DeclarationList::assign(Scope *env, Jua_Val val){
+    std::unique_ptr<JuaIterator> it(val.getIterator());
     for(auto item: decItems){
         auto v = it->next();
         if(v || item->initval)
@@ -83,10 +128,9 @@ void DeclarationList::assign(Scope *env, Jua_Val *val){
         else
             throw new JuaError("Missing argument");
     }
-    delete it;
 }
-void DeclarationList::declare(Scope *env, Jua_Val *val){
-    auto it = val->getIterator();
+void DeclarationList::declare(Scope *env, Jua_Val val){
+    std::unique_ptr<JuaIterator> it(val.getIterator());
     for(auto item: decItems){
         auto v = it->next();
         if(v || item->initval)
@@ -94,9 +138,8 @@ void DeclarationList::declare(Scope *env, Jua_Val *val){
         else
             throw new JuaError("Missing argument");
     }
-    delete it;
 }
-void DeclarationList::rawDeclare(Scope* env, const jualist& vals){
+void DeclarationList::rawDeclare(Scope* env, JuaArgs vals){
     for(size_t i=0; i<decItems.size(); i++){
         auto item = decItems[i];
         if(i < vals.size())
@@ -108,98 +151,160 @@ void DeclarationList::rawDeclare(Scope* env, const jualist& vals){
     }
 }
 
-Jua_Val* OptionalPropRef::_calc(Scope* env){
-    return expr->calc(env)->getProp(prop);
+Jua_Val OptionalPropRef::_calc(Scope* env){
+    return cache.get(env->vm, expr->calc(env));
 }
-Jua_Val* OptionalPropRef::calc(Scope* env){
+Jua_Val OptionalPropRef::calc(Scope* env){
     auto val = _calc(env);
     if(val)return val;
     return Jua_Null::getInst();
 }
-Jua_Val* PropRef::calc(Scope* env){
+Jua_Val PropRef::calc(Scope* env){
     auto val = _calc(env);
     if(val)return val;
-    throw new JuaError(std::format("no property: {}", prop));
+    throw new JuaError(std::format("no property: {}", prop.str()));
 }
-void PropRef::assign(Scope* env, Jua_Val* val){
+void PropRef::assign(Scope* env, Jua_Val val){
     auto tar = expr->calc(env);
-    if(tar->type != Jua_Val::Obj)throw "not an object";
-    auto obj = static_cast<Jua_Obj*>(tar);
+    if(tar.type() != Jua_Val::Obj)throw new JuaError("not an object");
+    auto obj = tar.as<Jua_Obj>();
     obj->setProp(prop, val);
 }
-Jua_Val* MethWrapper::calc(Scope* env){
-    auto obj = expr->calc(env);
-    auto meth = obj->getProp(key);
-    if(!meth)throw new JuaError(std::format("no method: {}", key));
-    return new Jua_NativeFunc(env->vm, [obj, meth](jualist& args){
-        args.push_front(obj);
-        return meth->call(args);
+Jua_Val MethWrapper::calc(Scope* env){
+    return wrap(env->vm, expr->calc(env));
+}
+Jua_Val MethWrapper::lookup(JuaVM* vm, Jua_Val obj){
+    auto meth = cache.get(vm, obj);
+    if(!meth)throw new JuaError(std::format("no method: {}", key.str()));
+    return meth;
+}
+Jua_Val MethWrapper::wrap(JuaVM* vm, Jua_Val obj){
+    auto meth = lookup(vm, obj);
+    auto fn = new Jua_NativeFunc(vm, [](JuaVM*, JuaArgs args, void* data){
+        auto& bound = static_cast<Jua_NativeFunc*>(data)->bound;
+        return bound[1].invoke(bound[0], args);
     });
+    fn->data = fn;
+    fn->bound = {obj, meth};
+    return fn;
 }
-Jua_Val* Subscription::calc(Scope* env){
+Jua_Val Subscription::calc(Scope* env){
+    RootGuard guard(env->vm->gc);
     auto obj = expr->calc(env);
+    guard.push(obj);
     auto key = keyExpr->calc(env);
-    return obj->getItem(key);
+    return obj.getItem(key);
 }
-void Subscription::assign(Scope* env, Jua_Val* val){
+void Subscription::assign(Scope* env, Jua_Val val){
+    RootGuard guard(env->vm->gc);
     auto obj = expr->calc(env);
+    guard.push(obj);
     auto key = keyExpr->calc(env);
-    obj->setItem(key, val);
+    guard.push(key);
+    obj.setItem(key, val);
 }
 
-Jua_Val* Call::calc(Scope* env){
+Jua_Val Call::invoke(Scope* env, Controller* tail){
     //d_log("Call");
+    RootGuard guard(env->vm->gc);
     auto fn = calee->calc(env);
-    auto list = args->calc(env);
-    return fn->call(list);
+    guard.push(fn);
+    //参数直接求值到值栈上
+    auto& exprs = args->exprs;
+    ArgFrame frame(env->vm->gc, exprs.size());
+    for(size_t i = 0; i < exprs.size(); i++){
+        frame.args[i] = exprs[i]->calc(env);
+    }
+    return tail ? tail->call(fn, frame.args) : fn.call(frame.args);
+}
+Jua_Val MethodCall::invoke(Scope* env, Controller* tail){
+    RootGuard guard(env->vm->gc);
+    auto obj = meth->expr->calc(env);
+    guard.push(obj);
+    auto fn = meth->lookup(env->vm, obj);
+    guard.push(fn);
+    auto& exprs = args->exprs;
+    ArgFrame frame(env->vm->gc, exprs.size() + 1);
+    frame.args[0] = obj;
+    for(size_t i = 0; i < exprs.size(); i++){
+        frame.args[i + 1] = exprs[i]->calc(env);
+    }
+    return tail ? tail->call(fn, frame.args) : fn.call(frame.args);
 }
 
-Jua_Val* ArrayExpr::calc(Scope* env){
+Jua_Val ArrayExpr::calc(Scope* env){
+    RootGuard guard(env->vm->gc);
     auto arr = new Jua_Array(env->vm, {});
-    list->appendTo(env, arr->items); //避免复制
+    guard.push(arr);
+    if(list)list->appendTo(env, arr->items); //避免复制；[] 的 list 为 nullptr
+    env->vm->gc.barrier(arr); //求值过程中可能已晋升
     return arr;
 }
-Jua_Val* ObjExpr::calc(Scope* env){
+ObjExpr::ObjExpr(Props p): entries(p){
+    for(auto [key, val]: entries){
+        auto lit = dynamic_cast<LiteralStr*>(key);
+        keys.push_back(lit ? Atom(lit->value) : Atom());
+    }
+}
+Jua_Val ObjExpr::calc(Scope* env){
+    RootGuard guard(env->vm->gc);
     auto obj = new Jua_Obj(env->vm);
-    for(auto kv: entries){
-        auto key = kv.first->calc(env), val = kv.second->calc(env);
-        if(key->type != Jua_Val::Str)
-            throw "non-string key";
-        obj->setProp(key->toString(), val);
+    guard.push(obj);
+    for(size_t i = 0; i < entries.size(); i++){
+        auto& kv = entries[i];
+        if(keys[i]){
+            obj->setProp(keys[i], kv.second->calc(env));
+            continue;
+        }
+        auto key = kv.first->calc(env);
+        guard.push(key);
+        auto val = kv.second->calc(env);
+        if(key.type() != Jua_Val::Str)
+            throw new JuaError("non-string key");
+        obj->setProp(Atom::dynamic(env->vm, key.toString()), val);
     }
     return obj;
 }
 
-Jua_Val* UnitaryExpr::calc(Scope* env){
+Jua_Val UnitaryExpr::calc(Scope* env){
     auto val = pri->calc(env);
     return operate(oper, val);
 }
-Jua_Val* BinaryExpr::calc(Scope* env){
+Jua_Val BinaryExpr::calc(Scope* env){
     auto leftVal = left->calc(env);
     switch(oper){
         case BinOper::and_:
-            return leftVal->toBoolean() ? right->calc(env) : leftVal;
+            return leftVal.toBoolean() ? right->calc(env) : leftVal;
         case BinOper::or_:
-            return leftVal->toBoolean() ? leftVal : right->calc(env);
-        default:
-            return operate(oper, leftVal, right->calc(env));
+            return leftVal.toBoolean() ? leftVal : right->calc(env);
+        default:{
+            if(leftVal.isNum())return quickOperate(env->vm, quick, oper, leftVal, right->calc(env)); //数字不需要保护
+            RootGuard guard(env->vm->gc);
+            guard.push(leftVal);
+            return quickOperate(env->vm, quick, oper, leftVal, right->calc(env));
+        }
     }
 }
-Jua_Val* Assignment::calc(Scope* env){
+Jua_Val Assignment::calc(Scope* env){
+    RootGuard guard(env->vm->gc);
     auto val = right->calc(env);
+    guard.push(val);
     left->assign(env, val);
     return val;
 }
-Jua_Val* OperAssignment::calc(Scope* env){
+Jua_Val OperAssignment::calc(Scope* env){
+    RootGuard guard(env->vm->gc);
     auto leftVal = left->calc(env);
+    guard.push(leftVal);
     auto rightVal = right->calc(env);
-    Jua_Val* result = operate(type, leftVal, rightVal);
+    Jua_Val result = quickOperate(env->vm, quick, type, leftVal, rightVal);
+    guard.push(result);
     assignee->assign(env, result);
     return result;
 }
-Jua_Val* TernaryExpr::calc(Scope* env){
+Jua_Val TernaryExpr::calc(Scope* env){
     auto cond = condExpr->calc(env);
-    if(cond->toBoolean())
+    if(cond.toBoolean())
         return trueExpr->calc(env);
     else
         return falseExpr->calc(env);
@@ -212,28 +317,54 @@ void LeftObj::addDefault(){
     }
     auto_nulled = true;
 }
-void LeftObj::assign(Scope* env, Jua_Val* val){
-    forEach(env, val, DeclarationItem::assign); //& ?
+void LeftObj::assign(Scope* env, Jua_Val val){
+    forEach(env, val, &DeclarationItem::assign);
 }
-void LeftObj::declare(Scope* env, Jua_Val* val){
-    forEach(env, val, DeclarationItem::declare);
+void LeftObj::declare(Scope* env, Jua_Val val){
+    forEach(env, val, &DeclarationItem::declare);
 }
-void LeftObj::forEach(Scope *env, Jua_Val *obj, Callback cb){
+void LeftObj::forEach(Scope *env, Jua_Val obj, Callback cb){
+    RootGuard guard(env->vm->gc);
+    guard.push(obj);
     for(auto [keyExpr, decItem]: entries){
         auto key = keyExpr->calc(env);
-        if(key->type != Jua_Val::Str)
+        if(key.type() != Jua_Val::Str)
             throw new JuaError("non-string key");
-        auto val = obj->getProp(key->toString());
+        auto atom = Atom::find(env->vm, key.toString());
+        auto val = atom ? obj.getProp(env->vm, atom) : nullptr;
         if(val || decItem->initval)
             (decItem->*cb)(env, val);
         else
-            throw new JuaError(std::format("cannot read property: {}", key->toString()));
+            throw new JuaError(std::format("cannot read property: {}", key.toString()));
     }
 }
 
 
 void Return::exec(Scope* env, Controller* ctrl){
-    ctrl->retval = expr ? expr->calc(env) : Jua_Null::getInst();
+    if(tail)ctrl->retval = static_cast<Call*>(expr)->invoke(env, ctrl); //尾调用时为空值
+    else ctrl->retval = expr ? expr->calc(env) : Jua_Null::getInst();
+}
+Jua_Val Controller::call(Jua_Val fn, JuaArgs args){
+    auto r = fn.ref();
+    if(!r || !isScriptFunc(r))return fn.call(args);
+    tailFn = static_cast<Jua_PFunc*>(r);
+    tailArgs.assign(args.begin(), args.end());
+    return nullptr;
+}
+Scope* Controller::tailScope(JuaVM* vm, size_t depth){
+    //之前的函数体已经结束，它的帧作用域不会再被访问
+    auto fn = tailFn;
+    tailFn = nullptr;
+    RootGuard guard(vm->gc);
+    guard.push(fn);
+    ArgFrame frame(vm->gc, tailArgs.size());
+    std::copy(tailArgs.begin(), tailArgs.end(), frame.args.begin());
+    tailArgs.clear();
+    vm->popFrameScopes(depth);
+    auto env = fn->body->callScope(fn->upenv);
+    guard.push(env); //参数的默认值可能执行脚本
+    fn->decList->rawDeclare(env, frame.args);
+    return env;
 }
 
 IfStmt::IfStmt(Expr* c, Block* b, Block* e): cond(c), body(b), elseBody(e){
@@ -243,10 +374,10 @@ IfStmt::IfStmt(Expr* c, Block* b, Block* e): cond(c), body(b), elseBody(e){
                      : elseBody ? elseBody->pending_break : nullptr;
 }
 void IfStmt::exec(Scope* env, Controller* controller){
-    if(cond->calc(env)->toBoolean())
-        body->exec(new Scope(env), controller);
+    if(cond->calc(env).toBoolean())
+        body->exec(body->enter(env), controller);
     else if(elseBody)
-        elseBody->exec(new Scope(env), controller);
+        elseBody->exec(elseBody->enter(env), controller);
 }
 SwitchStmt::SwitchStmt(Expr* e, std::vector<CaseBlock*>& cs, Block* d):
     expr(e), cases(cs), defaultBody(d){
@@ -258,21 +389,78 @@ SwitchStmt::SwitchStmt(Expr* e, std::vector<CaseBlock*>& cs, Block* d):
         if(!pending_break)
             pending_break = cb->body->pending_break;
     }
+    buildTable();
+}
+void SwitchStmt::buildTable(){
+    numCases.clear();
+    strCases.clear();
+    dense.clear();
+    jumpTable = false;
+    for(uint32_t i = 0; i < cases.size(); i++){
+        for(auto cond: cases[i]->cond->exprs){
+            if(auto num = dynamic_cast<LiteralNum*>(cond))numCases.emplace(num->value, i);
+            else if(auto str = dynamic_cast<LiteralStr*>(cond))strCases.emplace(str->value, i);
+            else return;
+        }
+    }
+    jumpTable = true;
+    if(numCases.empty() || !strCases.empty())return;
+    //整数条件的取值范围不超过条件数的 4 倍时改用数组
+    double lo = INFINITY, hi = -INFINITY;
+    for(auto& [num, i]: numCases){
+        if(num != std::floor(num) || std::abs(num) > 1 << 30)return;
+        lo = std::min(lo, num);
+        hi = std::max(hi, num);
+    }
+    if(hi - lo >= numCases.size() * 4 + 8)return;
+    denseBase = lo;
+    dense.assign(size_t(hi - lo) + 1, -1);
+    for(auto& [num, i]: numCases){
+        dense[size_t(num - lo)] = i;
+    }
+    numCases.clear();
+}
+int SwitchStmt::lookup(Jua_Val val){
+    //与 Jua_Val::equals 一致：数字按值比较，字符串按内容比较，其他类型不等于任何字面量
+    if(val.isNum()){
+        double num = val.num();
+        if(!dense.empty()){
+            double index = num - denseBase; //NaN 不满足以下任何比较
+            if(index >= 0 && index < dense.size() && index == std::floor(index))return dense[size_t(index)];
+            return -1;
+        }
+        auto it = numCases.find(num);
+        return it == numCases.end() ? -1 : it->second;
+    }
+    if(val.type() != Jua_Val::Str)return -1;
+    auto it = strCases.find(val.as<Jua_Str>()->value);
+    return it == strCases.end() ? -1 : it->second;
+}
+int SwitchStmt::match(Scope* env, Jua_Val val){
+    if(jumpTable)return lookup(val);
+    for(size_t i = 0; i < cases.size(); i++){
+        if(cases[i]->cond->contains(env, val))return i;
+    }
+    return -1;
 }
 void SwitchStmt::exec(Scope* env, Controller* controller){
+    RootGuard guard(env->vm->gc);
     auto exprVal = expr->calc(env);
-    for(auto cb: cases){
-        if(cb->cond->contains(env, exprVal)){
-            cb->body->exec(new Scope(env), controller);
-            return;
-        }
-    }
-    if(defaultBody)
-        defaultBody->exec(new Scope(env), controller);
+    guard.push(exprVal);
+    int i = match(env, exprVal);
+    auto body = i < 0 ? defaultBody : cases[i]->body;
+    if(body)
+        body->exec(body->enter(env), controller);
 }
 void WhileStmt::exec(Scope* env, Controller* controller){
-    while(cond->calc(env)->toBoolean()){
-        body->exec(new Scope(env), controller);
+    auto& gc = env->vm->gc;
+    RootGuard guard(gc);
+    size_t root = gc.stack.size();
+    guard.push(nullptr); //上一次迭代的作用域，见 Block::enter
+    Scope* scope = nullptr;
+    while(cond->calc(env).toBoolean()){
+        gc.stack[root] = scope = body->enter(env, scope);
+        body->exec(scope, controller);
         controller->continuing = false;
         if(controller->isPending()){
             controller->breaking = false;
@@ -282,18 +470,34 @@ void WhileStmt::exec(Scope* env, Controller* controller){
 }
 void ForStmt::exec(Scope* env, Controller* controller){
     auto target = iterable->calc(env);
-    auto it = target->getIterator(env->vm->obj_next);
-    Jua_Val *value;
-    while(value = it->next()){
+    auto& gc = env->vm->gc;
+    RootGuard guard(gc);
+    size_t root = gc.stack.size();
+    guard.push(nullptr); //上一次迭代的作用域，见 Block::enter
+    Scope* scope = nullptr;
+    auto iterate = [&](Jua_Val value){
+        //执行一次循环体，返回是否继续
         declarable->declare(env, value);
-        body->exec(new Scope(env), controller);
+        gc.stack[root] = scope = body->enter(env, scope);
+        body->exec(scope, controller);
         controller->continuing = false;
         if(controller->isPending()){
             controller->breaking = false;
-            break;
+            return false;
         }
+        return true;
+    };
+    if(target.isType(Jua_Range::type_id)){
+        //计数循环：不创建迭代器，与 RangeIterator 相同，开始时记下区间的参数
+        auto range = target.as<Jua_Range>();
+        double start = range->start, step = range->step;
+        size_t length = range->length();
+        for(size_t i = 0; i < length && iterate(Jua_Num(start + i * step)); i++);
+        return;
     }
-    delete it;
+    std::unique_ptr<JuaIterator> it(target.getIterator(env->vm->obj_next)); //迭代器持有 target
+    Jua_Val value;
+    while((value = it->next()) && iterate(value));
 }
 
 Block::Block(Stmts stmts): statements(stmts){
@@ -304,23 +508,80 @@ Block::Block(Stmts stmts): statements(stmts){
             pending_break = stmt->pending_break;
     }
 }
+Block::~Block(){
+    if(layoutVM)layout->pins--;
+}
+Shape* Block::getLayout(JuaVM* vm){
+    if(layoutVM != vm){
+        if(layoutVM)layout->pins--;
+        layout = &vm->rootShape;
+        for(auto& name: names){
+            layout = layout->transition(vm->atoms, name, false);
+        }
+        layout->pins++; //layout 缓存在语法树中，不能随回收释放
+        layoutVM = vm;
+    }
+    return layout;
+}
+Scope* Block::newScope(Scope* parent){
+    return new Scope(parent, getLayout(parent->vm));
+}
+Scope* FunctionBody::callScope(Scope* upenv){
+    if(captured)return newScope(upenv);
+    return upenv->vm->pushFrameScope(getLayout(upenv->vm), upenv);
+}
+Scope* Block::enter(Scope* parent, Scope* prev){
+    if(!hasScope)return parent;
+    //没有被闭包或 local 捕获的作用域在本次迭代结束后不会再被访问，清空槽位即相当于新的作用域
+    if(prev && !captured && prev->parent == parent && prev->shape == prev->layout){
+        std::fill(prev->slots.begin(), prev->slots.end(), Jua_Val());
+        return prev;
+    }
+    return newScope(parent);
+}
 void Block::exec(Scope* env, Controller* controller){ //env是新产生的作用域
     //d_log("Block::exec");
+    auto& gc = env->vm->gc;
+    RootGuard guard(gc);
+    guard.push(env);
     for(auto stmt: statements)
         if(controller->isPending())break;
-        else stmt->exec(env, controller);
-    env->gc();
+        else{
+            gc.check(); //安全点
+            stmt->exec(env, controller);
+        }
 }
-Jua_Val* FunctionBody::exec(Scope* env){
-    auto controller = new Controller;
-    Block::exec(env, controller);
-    auto retval = controller->retval;
+Jua_Val FunctionBody::exec(Scope* env){
+    auto vm = env->vm;
+    size_t depth = vm->frameDepth;
+    Controller controller;
+    Block::exec(env, &controller);
+    auto& gc = vm->gc;
+    RootGuard guard(gc);
+    size_t root = gc.stack.size();
+    guard.push(nullptr); //尾调用的被调函数，可能已不被其他值引用，须保持存活（见 SyntaxTree）
+    while(auto fn = controller.tailFn){
+        gc.stack[root] = fn;
+        env = controller.tailScope(vm, depth);
+        fn->body->Block::exec(env, &controller);
+    }
+    auto retval = controller.retval;
     if(retval)
-        controller->retval = nullptr;
+        controller.retval = nullptr;
     else
         retval = Jua_Null::getInst();
-    if(controller->isPending())
+    if(controller.isPending())
         throw "isPending";
-    delete controller;
     return retval;
+}
+Jua_Val Jua_PFunc::call(JuaArgs args){
+    if(vm->engine == JuaVM::Bytecode)return vm->interp.call(this, args);
+    RootGuard guard(vm->gc);
+    guard.push(this); //调用者可能没有持有函数值（如原生函数调用的方法），见 SyntaxTree
+    FrameScopeGuard frame(vm);
+    auto env = body->callScope(upenv);
+    guard.push(env); //参数的默认值可能执行脚本
+    decList->rawDeclare(env, args);
+    if(vm->engine == JuaVM::Closure)return body->run(env);
+    return body->exec(env);
 }
\ No newline at end of file
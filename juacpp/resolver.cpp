@@ -0,0 +1,189 @@
+#include "jua-syntax.h"
+#include <algorithm>
+
+void resolve(FunctionBody* body, DeclarationList* params){
+    Resolver resolver;
+    resolver.block(body, params, true);
+}
+
+void Resolver::block(Block* block, DeclarationList* params, bool function){
+    //先收集该作用域中声明的所有变量，因此可以引用之后才声明的变量（如相互调用的函数）
+    auto& names = block->names;
+    names.clear();
+    if(block->layoutVM)block->layout->pins--; //names 改变，layout 重新计算
+    block->layoutVM = nullptr;
+    if(params)params->collect(names);
+    for(auto stmt: block->statements){
+        stmt->collect(names);
+    }
+    //去除重复声明，保留首次出现的位置
+    Names unique;
+    for(auto& name: names){
+        if(std::find(unique.begin(), unique.end(), name) == unique.end())
+            unique.push_back(name);
+    }
+    names.swap(unique);
+    //函数体总有作用域（调用时创建）；其他 Block 在不声明变量时省略作用域
+    block->hasScope = function || !names.empty();
+    block->captured = false;
+    blocks.push_back({block, false});
+    for(int pass = 0; pass < 2; pass++){
+        if(params)params->resolve(*this);
+        for(auto stmt: block->statements){
+            stmt->resolve(*this);
+        }
+        //local 需要 Block 自己的作用域，此时内层变量的 depth 改变，需重新解析
+        if(block->hasScope || !blocks.back().usesLocal)break;
+        block->hasScope = true;
+    }
+    blocks.pop_back();
+}
+void Resolver::name(Varname* var){
+    int depth = 0;
+    for(size_t i = blocks.size(); i > 0; i--){
+        auto block = blocks[i-1].block;
+        if(!block->hasScope)continue;
+        auto& names = block->names;
+        auto it = std::find(names.begin(), names.end(), var->name);
+        if(it != names.end()){
+            var->depth = depth;
+            var->slot = it - names.begin();
+            return;
+        }
+        depth++;
+    }
+    //最外层函数体的作用域之外，运行时为 _G
+    var->depth = depth;
+    var->slot = -1;
+}
+void Resolver::capture(){
+    for(auto& entry: blocks){
+        entry.block->captured = true;
+    }
+}
+void Resolver::local(){
+    blocks.back().usesLocal = true;
+    capture();
+}
+
+void Varname::resolve(Resolver& r){
+    r.name(this);
+}
+void Keyword::resolve(Resolver& r){
+    if(type == 'l')r.local();
+}
+void Template::resolve(Resolver& r){
+    for(auto expr: exprList){
+        expr->resolve(r);
+    }
+}
+void OptionalPropRef::resolve(Resolver& r){
+    expr->resolve(r);
+}
+void MethWrapper::resolve(Resolver& r){
+    expr->resolve(r);
+}
+void UnitaryExpr::resolve(Resolver& r){
+    pri->resolve(r);
+}
+void BinaryExpr::resolve(Resolver& r){
+    left->resolve(r);
+    right->resolve(r);
+}
+void Assignment::resolve(Resolver& r){
+    left->resolve(r);
+    right->resolve(r);
+}
+void OperAssignment::resolve(Resolver& r){
+    left->resolve(r); //与 assignee 是同一个节点
+    right->resolve(r);
+}
+void Subscription::resolve(Resolver& r){
+    expr->resolve(r);
+    keyExpr->resolve(r);
+}
+void TernaryExpr::resolve(Resolver& r){
+    condExpr->resolve(r);
+    trueExpr->resolve(r);
+    falseExpr->resolve(r);
+}
+void FlexibleList::resolve(Resolver& r){
+    for(auto expr: exprs){
+        expr->resolve(r);
+    }
+}
+void Call::resolve(Resolver& r){
+    calee->resolve(r);
+    args->resolve(r);
+}
+void ObjExpr::resolve(Resolver& r){
+    for(auto [key, val]: entries){
+        key->resolve(r);
+        val->resolve(r);
+    }
+}
+void ArrayExpr::resolve(Resolver& r){
+    if(list)list->resolve(r);
+}
+void FunExpr::resolve(Resolver& r){
+    r.capture();
+    r.block(body, decList, true);
+}
+
+void DeclarationItem::resolve(Resolver& r){
+    body->resolve(r);
+    if(initval)initval->resolve(r);
+}
+void DeclarationList::resolve(Resolver& r){
+    for(auto item: decItems){
+        item->resolve(r);
+    }
+}
+void DeclarationList::collect(Names& names){
+    for(auto item: decItems){
+        item->body->collect(names);
+    }
+}
+void LeftObj::resolve(Resolver& r){
+    for(auto [key, item]: entries){
+        key->resolve(r);
+        item->resolve(r);
+    }
+}
+void LeftObj::collect(Names& names){
+    for(auto [key, item]: entries){
+        item->body->collect(names);
+    }
+}
+
+void ExprStatement::resolve(Resolver& r){
+    expr->resolve(r);
+}
+void Declaration::resolve(Resolver& r){
+    list->resolve(r);
+}
+void Return::resolve(Resolver& r){
+    if(expr)expr->resolve(r);
+}
+void IfStmt::resolve(Resolver& r){
+    cond->resolve(r);
+    r.block(body);
+    if(elseBody)r.block(elseBody);
+}
+void SwitchStmt::resolve(Resolver& r){
+    expr->resolve(r);
+    for(auto cb: cases){
+        cb->cond->resolve(r);
+        r.block(cb->body);
+    }
+    if(defaultBody)r.block(defaultBody);
+}
+void WhileStmt::resolve(Resolver& r){
+    cond->resolve(r);
+    r.block(body);
+}
+void ForStmt::resolve(Resolver& r){
+    declarable->resolve(r);
+    iterable->resolve(r);
+    r.block(body);
+}
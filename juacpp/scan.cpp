@@ -0,0 +1,141 @@
+#include "jua-scan.h"
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define JUA_SCAN_X86 1
+#endif
+
+namespace scan{
+
+static const char* whiteScalar(const char* p, const char* end){
+    while(p < end && isWhite(*p))p++;
+    return p;
+}
+static const char* wordScalar(const char* p, const char* end){
+    while(p < end && isWord(*p))p++;
+    return p;
+}
+static const char* findScalar(const char* p, const char* end, char a, char b, char c){
+    while(p < end && *p!=a && *p!=b && *p!=c)p++;
+    return p;
+}
+
+#ifdef JUA_SCAN_X86
+//x <= n（无符号）的字节为 0xFF：min(x, n) == x
+static inline __m128i le(__m128i x, char n){
+    return _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(n)), x);
+}
+static inline __m128i whiteMask(__m128i v){
+    auto ctrl = le(_mm_sub_epi8(v, _mm_set1_epi8('\t')), 4); //\t \n \v \f \r
+    auto space = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+    auto nul = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+    return _mm_or_si128(_mm_or_si128(ctrl, space), nul);
+}
+static inline __m128i wordMask(__m128i v){
+    auto alpha = le(_mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a')), 25);
+    auto digit = le(_mm_sub_epi8(v, _mm_set1_epi8('0')), 9);
+    auto under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+    return _mm_or_si128(_mm_or_si128(alpha, digit), under);
+}
+static const char* whiteSSE2(const char* p, const char* end){
+    for(; end - p >= 16; p += 16){
+        unsigned miss = ~_mm_movemask_epi8(whiteMask(_mm_loadu_si128((const __m128i*)p))) & 0xFFFF;
+        if(miss)return p + __builtin_ctz(miss);
+    }
+    return whiteScalar(p, end);
+}
+static const char* wordSSE2(const char* p, const char* end){
+    for(; end - p >= 16; p += 16){
+        unsigned miss = ~_mm_movemask_epi8(wordMask(_mm_loadu_si128((const __m128i*)p))) & 0xFFFF;
+        if(miss)return p + __builtin_ctz(miss);
+    }
+    return wordScalar(p, end);
+}
+static const char* findSSE2(const char* p, const char* end, char a, char b, char c){
+    auto va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b), vc = _mm_set1_epi8(c);
+    for(; end - p >= 16; p += 16){
+        auto v = _mm_loadu_si128((const __m128i*)p);
+        auto m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)), _mm_cmpeq_epi8(v, vc));
+        unsigned hit = _mm_movemask_epi8(m);
+        if(hit)return p + __builtin_ctz(hit);
+    }
+    return findScalar(p, end, a, b, c);
+}
+
+#define AVX2 __attribute__((target("avx2")))
+AVX2 static inline __m256i le(__m256i x, char n){
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(x, _mm256_set1_epi8(n)), x);
+}
+AVX2 static const char* whiteAVX2(const char* p, const char* end){
+    for(; end - p >= 32; p += 32){
+        auto v = _mm256_loadu_si256((const __m256i*)p);
+        auto ctrl = le(_mm256_sub_epi8(v, _mm256_set1_epi8('\t')), 4);
+        auto space = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+        auto nul = _mm256_cmpeq_epi8(v, _mm256_setzero_si256());
+        unsigned miss = ~_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(ctrl, space), nul));
+        if(miss)return p + __builtin_ctz(miss);
+    }
+    return whiteSSE2(p, end);
+}
+AVX2 static const char* wordAVX2(const char* p, const char* end){
+    for(; end - p >= 32; p += 32){
+        auto v = _mm256_loadu_si256((const __m256i*)p);
+        auto alpha = le(_mm256_sub_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a')), 25);
+        auto digit = le(_mm256_sub_epi8(v, _mm256_set1_epi8('0')), 9);
+        auto under = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+        unsigned miss = ~_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(alpha, digit), under));
+        if(miss)return p + __builtin_ctz(miss);
+    }
+    return wordSSE2(p, end);
+}
+AVX2 static const char* findAVX2(const char* p, const char* end, char a, char b, char c){
+    auto va = _mm256_set1_epi8(a), vb = _mm256_set1_epi8(b), vc = _mm256_set1_epi8(c);
+    for(; end - p >= 32; p += 32){
+        auto v = _mm256_loadu_si256((const __m256i*)p);
+        auto m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)), _mm256_cmpeq_epi8(v, vc));
+        unsigned hit = _mm256_movemask_epi8(m);
+        if(hit)return p + __builtin_ctz(hit);
+    }
+    return findSSE2(p, end, a, b, c);
+}
+#undef AVX2
+#endif
+
+//按实测的速度排列：生成的配置模块（bench 的 lex）中 AVX2 并不比 SSE2 快，长的一段太少，
+//且每段开头不足 32 字节的部分仍要逐字节或按 16 字节处理；AVX2 保留给 use 做对比
+static const Kernels kernels[] = {
+#ifdef JUA_SCAN_X86
+    {"sse2", whiteSSE2, wordSSE2, findSSE2},
+    {"avx2", whiteAVX2, wordAVX2, findAVX2},
+#endif
+    {"scalar", whiteScalar, wordScalar, findScalar},
+};
+static bool supported(const Kernels& k){
+#ifdef JUA_SCAN_X86
+    if(!strcmp(k.name, "avx2"))return __builtin_cpu_supports("avx2");
+#endif
+    return true;
+}
+static Kernels detect(){
+    //取 kernels 中第一个 CPU 支持的
+#ifdef JUA_SCAN_X86
+    __builtin_cpu_init(); //在静态初始化中调用 __builtin_cpu_supports 前须先初始化
+#endif
+    for(auto& k: kernels)
+        if(supported(k))return k;
+    return kernels[0];
+}
+Kernels active = detect();
+
+bool use(const char* name){
+    for(auto& k: kernels){
+        if(!strcmp(k.name, name) && supported(k)){
+            active = k;
+            return true;
+        }
+    }
+    return false;
+}
+
+}
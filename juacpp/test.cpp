@@ -20,10 +20,10 @@ struct JuaRuntime: JuaVM{
     JuaRuntime(const char* name, fs::path _cwd=fs::current_path()): main(name), cwd(_cwd){
         auto api = new Jua_Obj(this);
         api->setProp("version", new Jua_Str(this, "JuaRuntime 0.1"));
-        api->setProp("alert", makeFunc([this](jualist& args){
+        api->setProp("alert", makeFunc([](JuaVM*, JuaArgs args, void*) -> Jua_Val {
             if(args.size() < 1) throw new JuaError("api.alert() requires at least 1 argument");
             auto msg = args[0];
-            cout << "Runtime.alert: " << msg->toString() << '\n';
+            cout << "Runtime.alert: " << msg.toString() << '\n';
             return Jua_Null::getInst();
         }));
         _G->setProp("Runtime", api);
@@ -44,14 +44,17 @@ struct JuaRuntime: JuaVM{
         //cout<<script<<'\n';
         return script;
     }
-    void j_stdout(const jualist& vals){
+    void j_stdout(JuaArgs vals){
         cout << "j_stdout: ";
         size_t len = vals.size();
-        if(!len)cout << '\n';
-        std::string str(vals[0]->toString());
+        if(!len){
+            cout << '\n';
+            return;
+        }
+        std::string str(vals[0].toString());
         for(size_t i=1; i<len; i++){
             str.push_back('\t');
-            str.append(vals[i]->toString());
+            str.append(vals[i].toString());
         }
         cout << str << '\n';
     };
@@ -1,154 +1,406 @@
 #include "jua-value.h"
 #include <charconv>
 #include <format>
+#include <mutex>
+#include <shared_mutex>
 #include "jua-vm.h"
 
 struct ListIterator: JuaIterator{
+    Jua_Array* arr;
     jualist& list;
     size_t index = 0;
-    ListIterator(jualist& l): list(l) {}
-    ListIterator(Jua_Array* arr): list(arr->items) {}
-    Jua_Val* next(){
+    ListIterator(Jua_Array* a): JuaIterator(&a->vm->gc), arr(a), list(a->items) {}
+    Jua_Val next(){
         if(index >= list.size())return nullptr;
         return list[index++];
     }
+    void trace(JuaGC& gc){
+        gc.mark(arr);
+    }
+};
+struct RangeIterator: JuaIterator{
+    //创建时记下区间的参数，之后修改区间不影响本次迭代
+    double start, step;
+    size_t length;
+    size_t index = 0;
+    RangeIterator(Jua_Range* r): JuaIterator(&r->vm->gc), start(r->start), step(r->step), length(r->length()){}
+    Jua_Val next(){
+        if(index >= length)return nullptr;
+        return Jua_Num(start + index++ * step);
+    }
 };
 struct CustomIterator: JuaIterator{
-    Jua_Val* obj;
+    Jua_Val obj;
     Jua_Func* nextFn;
-    Jua_Val* key = Jua_Null::getInst();
-    CustomIterator(Jua_Val* o, Jua_Func* fn): obj(o), nextFn(fn){}
-    CustomIterator(Jua_Val* o): obj(o){
-        nextFn = obj->getMetaMethod("next");
+    Jua_Val key = Jua_Null::getInst();
+    Jua_Val value; //最近一次返回的值，可能只被迭代器持有
+    CustomIterator(Jua_Val o, Jua_Func* fn): JuaIterator(&fn->vm->gc), obj(o), nextFn(fn){}
+    CustomIterator(Jua_Ref* o): JuaIterator(&o->vm->gc), obj(o){
+        nextFn = o->getMetaMethod(atoms::next);
         if(!nextFn)
             throw new JuaTypeError("Object is not iterable");
     }
-    Jua_Val* next(){
+    Jua_Val next(){
         auto res = nextFn->call({obj, key});
-        if(res->type != Jua_Val::Obj)
+        if(res.type() != Jua_Val::Obj)
             throw new JuaTypeError("iterator.next() must return an object");
-        auto done = res->getProp("done");
-        if(!done || done->type != Jua_Val::Bool)
+        auto resObj = res.ref();
+        auto done = resObj->getProp(atoms::done);
+        if(!done || done.type() != Jua_Val::Bool)
             throw new JuaTypeError("iterator.next() must return an object with a boolean 'done' property");
-        if(done->toBoolean()){
+        if(done.toBoolean()){
             return nullptr;
         }
-        auto value = res->getProp("value");
+        value = resObj->getProp(atoms::value);
         if(!value)
             throw new JuaTypeError("iterator.next() must return an object with a 'value' property when done is false");
-        key = res->getProp("key");
+        key = resObj->getProp(atoms::key);
         if(!key)
             throw new JuaTypeError("iterator.next() must return an object with a 'key' property when done is false");
         return value;
     }
+    void trace(JuaGC& gc){
+        gc.mark(obj);
+        gc.mark(nextFn);
+        gc.mark(key);
+        gc.mark(value);
+    }
 };
 
-void Jua_Val::release(){
-    ref--;
-    gc();
+bool Jua_Val::isType(int type_id) const {
+    auto r = ref();
+    return r && r->isType(type_id);
+}
+Jua_Obj* Jua_Val::getProto(JuaVM* vm) const {
+    if(auto r = ref())return r->proto;
+    if(isNum())return vm->NumberProto;
+    return nullptr;
+}
+struct AtomTable{
+    //原子表以条目中字符串的视图为键，条目的地址在表扩容时不变；所有访问都持有 lock，见 Atom
+    std::shared_mutex lock;
+    std::unordered_map<std::string_view, Atom::Entry*> entries;
+};
+static AtomTable& atomTable(){
+    static AtomTable table;
+    return table;
+}
+static Atom::Entry* intern(AtomTable& table, std::string_view str){
+    //须持有 table.lock
+    auto it = table.entries.find(str);
+    if(it != table.entries.end())return it->second;
+    auto e = new Atom::Entry{string(str), std::hash<std::string_view>{}(str)};
+    table.entries.emplace(e->str, e);
+    return e;
+}
+Atom::Atom(std::string_view str){
+    auto& table = atomTable();
+    {
+        //已是永久条目时只需共享锁
+        std::shared_lock read(table.lock);
+        auto it = table.entries.find(str);
+        if(it != table.entries.end() && it->second->permanent){
+            entry = it->second;
+            return;
+        }
+    }
+    std::unique_lock write(table.lock);
+    entry = intern(table, str);
+    entry->permanent = true;
+}
+Atom Atom::hold(std::string_view str){
+    auto& table = atomTable();
+    std::unique_lock write(table.lock);
+    auto e = intern(table, str);
+    e->holders++;
+    return Atom(e);
+}
+void Atom::retain(Atom atom){
+    std::unique_lock write(atomTable().lock);
+    atom.entry->holders++;
+}
+void Atom::drop(Atom atom){
+    auto& table = atomTable();
+    std::unique_lock write(table.lock);
+    auto e = atom.entry;
+    if(--e->holders || e->permanent)return;
+    table.entries.erase(e->str);
+    delete e;
+}
+Atom Atom::find(JuaVM* vm, std::string_view str){
+    if(auto atom = vm->atoms.get(str))return atom;
+    //不在 vm 的表中：只有永久的条目可能是属性名（见 DynamicAtoms），其他的可能正被别的线程释放
+    auto& table = atomTable();
+    std::shared_lock read(table.lock);
+    auto it = table.entries.find(str);
+    if(it == table.entries.end() || !it->second->permanent)return Atom();
+    return Atom(it->second);
+}
+Atom Atom::dynamic(JuaVM* vm, std::string_view str){
+    auto atom = vm->atoms.get(str);
+    if(!atom){
+        atom = hold(str);
+        vm->atoms.entries.emplace(atom.str(), DynamicAtoms::Item{atom});
+    }
+    vm->gc.atomBarrier(atom);
+    return atom;
+}
+void DynamicAtoms::hold(Atom atom){
+    if(entries.contains(atom.str()))return;
+    Atom::retain(atom);
+    entries.emplace(atom.str(), Item{atom});
+}
+DynamicAtoms::~DynamicAtoms(){
+    for(auto& [str, item]: entries){
+        Atom::drop(item.atom);
+    }
+}
+size_t DynamicAtoms::sweep(){
+    std::vector<Atom> unused;
+    for(auto it = entries.begin(); it != entries.end();){
+        if(it->second.marked){
+            it->second.marked = false;
+            ++it;
+            continue;
+        }
+        unused.push_back(it->second.atom);
+        it = entries.erase(it); //键是条目中字符串的视图，先移除再释放条目
+    }
+    for(auto atom: unused){
+        Atom::drop(atom);
+    }
+    return unused.size();
+}
+Jua_Val Jua_Val::getOwn(Atom key) const {
+    if(auto r = ref())return r->getOwn(key);
+    return nullptr;
+}
+Jua_Val Jua_Val::getProp(JuaVM* vm, Atom key) const {
+    if(auto r = ref())return r->getProp(key);
+    auto proto = getProto(vm);
+    if(proto)return proto->getProp(key);
+    return nullptr;
+}
+Jua_Bool Jua_Val::hasItem(Jua_Val key) const {
+    if(auto r = ref())return r->hasItem(key);
+    throw new JuaTypeError("Object is not subscriptable");
+}
+Jua_Val Jua_Val::getItem(Jua_Val key) const {
+    if(auto r = ref())return r->getItem(key);
+    throw new JuaTypeError("Object is not subscriptable");
+}
+void Jua_Val::setItem(Jua_Val key, Jua_Val val) const {
+    if(auto r = ref())return r->setItem(key, val);
+    throw new JuaTypeError("Object is not subscriptable");
+}
+Jua_Val Jua_Val::call(JuaArgs args) const {
+    if(auto r = ref())return r->call(args);
+    throw new JuaTypeError("Object is not callable");
+}
+Jua_Val Jua_Val::call(initializer_list<Jua_Val> args) const {
+    if(auto r = ref())return r->call(args);
+    throw new JuaTypeError("Object is not callable");
+}
+Jua_Val Jua_Val::invoke(Jua_Val self, JuaArgs args) const {
+    if(auto r = ref())return r->invoke(self, args);
+    throw new JuaTypeError("Object is not callable");
+}
+Jua_Val Jua_Val::unm() const {
+    if(isNum())return Jua_Num(-num());
+    if(auto r = ref())return r->unm();
+    throw new JuaTypeError("Object is not unary negatable");
+}
+Jua_Val Jua_Val::binarySlow(RefOper oper, const char* numErr, const char* err, Jua_Val val) const {
+    if(isNum())throw new JuaTypeError(numErr);
+    if(auto r = ref())return (r->*oper)(val);
+    throw new JuaTypeError(err);
+}
+Jua_Bool Jua_Val::eq(Jua_Val val) const {
+    return Jua_Bool::getInst(equals(val));
+}
+Jua_Bool Jua_Val::lt(Jua_Val val) const {
+    if(isNum()){
+        if(!val.isNum())throw new JuaTypeError("try to compare non-number");
+        return Jua_Bool::getInst(num() < val.num());
+    }
+    if(auto r = ref())return r->lt(val);
+    throw new JuaTypeError("Object is not comparable");
+}
+Jua_Bool Jua_Val::le(Jua_Val val) const {
+    if(isNum()){
+        if(!val.isNum())throw new JuaTypeError("try to compare non-number");
+        return Jua_Bool::getInst(num() <= val.num());
+    }
+    if(auto r = ref())return r->le(val);
+    throw new JuaTypeError("Object is not comparable");
+}
+Jua_Val Jua_Val::range(JuaVM* vm, Jua_Val val) const {
+    if(isNum()){
+        if(!val.isNum())throw new JuaTypeError("try to create range with non-number");
+        return new Jua_Range(vm, num(), val.num());
+    }
+    if(auto r = ref())return r->range(val);
+    throw new JuaTypeError("Object is not rangeable");
+}
+JuaIterator* Jua_Val::getIterator(Jua_Func* next) const {
+    if(auto r = ref())return r->getIterator(next);
+    if(!next)
+        throw new JuaTypeError("Object is not iterable");
+    return new CustomIterator(*this, next);
+}
+void Jua_Val::collectItems(jualist& list) const {
+    if(auto r = ref())return r->collectItems(list);
+    std::unique_ptr<JuaIterator> it(getIterator());
+    Jua_Val val;
+    while((val = it->next()) != nullptr){
+        list.push_back(val);
+    }
+}
+bool Jua_Val::equals(Jua_Val val) const {
+    if(isNum())return val.isNum() && num() == val.num();
+    if(auto r = ref())return *r == val;
+    return same(val);
+}
+string Jua_Val::toString() const {
+    if(isNum()){
+        char s[32];
+        auto res = std::to_chars(s, s+32, num());
+        return {s, res.ptr};
+    }
+    if(auto r = ref())return r->toString();
+    switch(bits & TAG_MASK){
+        case TAG_NULL: return "null";
+        case TAG_BOOL: return toBoolean() ? "true" : "false";
+    }
+    throw "Jua_Val::toString() called on an empty value";
+}
+string Jua_Val::safeToString() const {
+    if(auto r = ref())return r->safeToString();
+    return toString();
+}
+Jua_Bool Jua_Val::toJuaBool() const {
+    return Jua_Bool::getInst(toBoolean());
+}
+int64_t Jua_Val::toInt() const {
+    if(isNum())return std::round(num());
+    throw new JuaTypeError("toInt() called on a non-number value");
 }
-Jua_Val* Jua_Val::inheritProp(const string& key){
+double Jua_Val::toNumber() const {
+    if(isNum())return num();
+    throw new JuaTypeError("toNumber() called on a non-number value");
+}
+string Jua_Val::getTypeName() const {
+    switch(type()){
+        case Num: return "number";
+        case Bool: return "boolean";
+        case Null: return "null";
+        default: return ref()->getTypeName();
+    }
+}
+Jua_Val Jua_Ref::inheritProp(Atom key){
     if(!proto)return nullptr;
-    if(proto->isPropTrue("__class")){
-        Jua_Val* super = getOwn("super");
+    if(proto->isPropTrue(atoms::_class)){
+        Jua_Val super = getOwn(atoms::super);
         if(!super)return nullptr;
-        return super->getProp(key);
+        return super.getProp(vm, key);
     }
     return proto->getProp(key);
 }
-Jua_Val* Jua_Val::getProp(const string& key){
+Jua_Val Jua_Ref::getProp(Atom key){
     auto own = getOwn(key);
     if(own)return own;
     return inheritProp(key);
 }
-Jua_Func* Jua_Val::getMetaMethod(const string& key){
+Jua_Func* Jua_Ref::getMetaMethod(Atom key){
     if(!proto)return nullptr;
     auto meth = proto->getProp(key);
-    if(meth && meth->type==Func)
-        return (Jua_Func*)meth;
+    if(meth && meth.type()==Jua_Val::Func)
+        return meth.as<Jua_Func>();
     return nullptr;
 }
-Jua_Bool* Jua_Val::hasItem(Jua_Val* key){
-    auto fn = getMetaMethod("hasItem");
-    if(fn)return fn->call({this, key})->toJuaBool();
+Jua_Bool Jua_Ref::hasItem(Jua_Val key){
+    auto fn = getMetaMethod(atoms::hasItem);
+    if(fn)return fn->call({this, key}).toJuaBool();
     throw new JuaTypeError("Object is not subscriptable");
 }
-Jua_Val* Jua_Val::getItem(Jua_Val* key){
-    auto fn = getMetaMethod("getItem");
+Jua_Val Jua_Ref::getItem(Jua_Val key){
+    auto fn = getMetaMethod(atoms::getItem);
     if(fn)return fn->call({this, key});
     throw new JuaTypeError("Object is not subscriptable");
 }
-void Jua_Val::setItem(Jua_Val* key, Jua_Val* val){
-    auto fn = getMetaMethod("setItem");
+void Jua_Ref::setItem(Jua_Val key, Jua_Val val){
+    auto fn = getMetaMethod(atoms::setItem);
     if(!fn)throw new JuaTypeError("Object is not subscriptable");
     fn->call({this, key, val});
 }
-Jua_Val* Jua_Val::call(jualist& args){
-    auto fn = getMetaMethod("__call");
+Jua_Val Jua_Ref::call(JuaArgs args){
+    auto fn = getMetaMethod(atoms::_call);
     if(!fn)throw new JuaTypeError("Object is not callable");
-    args.push_front(this);
-    return fn->call(args);
-    
+    return fn->invoke(this, args);
+}
+Jua_Val Jua_Ref::call(initializer_list<Jua_Val> args){
+    ArgFrame frame(vm->gc, args.size());
+    std::copy(args.begin(), args.end(), frame.args.begin());
+    return call(frame.args);
 }
-Jua_Val* Jua_Val::unm(){
-    Jua_Func* fn = getMetaMethod("__unm");
+Jua_Val Jua_Ref::invoke(Jua_Val self, JuaArgs args){
+    if(args.spare){
+        args.push_front(self);
+        return call(args);
+    }
+    //没有备用槽位（如参数本身是 push_front 的结果），复制一份
+    ArgFrame frame(vm->gc, args.size() + 1);
+    frame.args[0] = self;
+    std::copy(args.begin(), args.end(), frame.args.begin() + 1);
+    return call(frame.args);
+}
+Jua_Val Jua_Ref::unm(){
+    Jua_Func* fn = getMetaMethod(atoms::_unm);
     if(fn)return fn->call({this});
     throw new JuaTypeError("Object is not unary negatable");
 }
-Jua_Val* Jua_Val::add(Jua_Val* val){
-    Jua_Func* fn = getMetaMethod("__add");
+Jua_Val Jua_Ref::add(Jua_Val val){
+    Jua_Func* fn = getMetaMethod(atoms::_add);
     if(fn)return fn->call({this, val});
     throw new JuaTypeError("Object is not addable");
 }
-Jua_Val* Jua_Val::sub(Jua_Val* val){
-    Jua_Func* fn = getMetaMethod("__sub");
+Jua_Val Jua_Ref::sub(Jua_Val val){
+    Jua_Func* fn = getMetaMethod(atoms::_sub);
     if(fn)return fn->call({this, val});
     throw new JuaTypeError("Object is not subtractable");
 }
-Jua_Val* Jua_Val::mul(Jua_Val* val){
-    Jua_Func* fn = getMetaMethod("__mul");
+Jua_Val Jua_Ref::mul(Jua_Val val){
+    Jua_Func* fn = getMetaMethod(atoms::_mul);
     if(fn)return fn->call({this, val});
     throw new JuaTypeError("Object is not multiplicable");
 }
-Jua_Val* Jua_Val::div(Jua_Val* val){
-    Jua_Func* fn = getMetaMethod("__div");
+Jua_Val Jua_Ref::div(Jua_Val val){
+    Jua_Func* fn = getMetaMethod(atoms::_div);
     if(fn)return fn->call({this, val});
     throw new JuaTypeError("Object is not dividable");
 }
-Jua_Bool* Jua_Val::eq(Jua_Val* val){
-    return Jua_Bool::getInst(*this == val);
-}
-Jua_Bool* Jua_Val::lt(Jua_Val* val){
-    Jua_Func* fn = getMetaMethod("__lt");
-    if(fn)return fn->call({this, val})->toJuaBool();
+Jua_Bool Jua_Ref::lt(Jua_Val val){
+    Jua_Func* fn = getMetaMethod(atoms::_lt);
+    if(fn)return fn->call({this, val}).toJuaBool();
     throw new JuaTypeError("Object is not comparable");
 }
-Jua_Bool* Jua_Val::le(Jua_Val* val){
-    Jua_Func* fn = getMetaMethod("__le");
-    if(fn)return fn->call({this, val})->toJuaBool();
+Jua_Bool Jua_Ref::le(Jua_Val val){
+    Jua_Func* fn = getMetaMethod(atoms::_le);
+    if(fn)return fn->call({this, val}).toJuaBool();
     throw new JuaTypeError("Object is not comparable");
 }
-Jua_Val* Jua_Val::range(Jua_Val* val){
-    Jua_Func* fn = getMetaMethod("range");
+Jua_Val Jua_Ref::range(Jua_Val val){
+    Jua_Func* fn = getMetaMethod(atoms::range);
     if(fn)return fn->call({this, val});
     throw new JuaTypeError("Object is not rangeable");
 }
-bool Jua_Val::operator==(Jua_Val* val){
-    Jua_Func* fn = getMetaMethod("__eq");
-    if(fn)return fn->call({this, val})->toBoolean();
-    return this == val;
-}
-Jua_Bool* Jua_Val::toJuaBool(){
-    return Jua_Bool::getInst(toBoolean());
-}
-int64_t Jua_Val::toInt(){
-    throw new JuaTypeError("toInt() called on a non-number value");
+bool Jua_Ref::operator==(Jua_Val val){
+    Jua_Func* fn = getMetaMethod(atoms::_eq);
+    if(fn)return fn->call({this, val}).toBoolean();
+    return this == val.ref();
 }
-double Jua_Val::toNumber(){
-    throw new JuaTypeError("toNumber() called on a non-number value");
-}
-JuaIterator* Jua_Val::getIterator(Jua_Func* next){
-    auto nextFn = getMetaMethod("next");
+JuaIterator* Jua_Ref::getIterator(Jua_Func* next){
+    auto nextFn = getMetaMethod(atoms::next);
     if(!nextFn){
         if(!next)
             throw new JuaTypeError("Object is not iterable");
@@ -156,201 +408,266 @@ JuaIterator* Jua_Val::getIterator(Jua_Func* next){
     }
     return new CustomIterator(this, nextFn);
 }
-void Jua_Val::collectItems(jualist& list){
-    auto it = getIterator();
-    Jua_Val* val;
+void Jua_Ref::collectItems(jualist& list){
+    std::unique_ptr<JuaIterator> it(getIterator());
+    Jua_Val val;
     while((val = it->next()) != nullptr){
         list.push_back(val);
     }
-    delete it;
 }
 
-void Jua_Val::gc(){
-    //todo
-    if(!ref){
-        //d_log("gc()");
-        //delete this;
+Shape* Shape::transition(DynamicAtoms& atoms, Atom key, bool capped){
+    auto it = transitions.find(key);
+    if(it != transitions.end())return it->second.get();
+    if(capped && transitions.size() >= MAX_TRANSITIONS)return nullptr;
+    auto child = new Shape;
+    child->keys.reserve(keys.size() + 1);
+    child->keys = keys;
+    child->index = index;
+    child->addKey(key);
+    atoms.hold(key);
+    transitions.emplace(key, child);
+    return child;
+}
+size_t Shape::sweep(DynamicAtoms& atoms){
+    size_t freed = 0;
+    for(auto it = transitions.begin(); it != transitions.end();){
+        auto child = it->second.get();
+        freed += child->sweep(atoms);
+        if(!child->marked && !child->pins && child->transitions.empty()){
+            it = transitions.erase(it);
+            freed++;
+        }else{
+            child->marked = false;
+            atoms.mark(it->first); //子节点的键即父节点的键加上转移的键，逐条标记转移的键即可覆盖整棵树
+            ++it;
+        }
     }
-}
-
-Jua_Obj::Jua_Obj(JuaVM* vm_, Jua_Obj* p): Jua_Val(vm_, Obj, p){ if(p)p->addRef(); }
-Jua_Obj::~Jua_Obj(){ if(proto)proto->release(); }
-bool Jua_Obj::hasOwn(Jua_Val* key){
-    if(key->type != Str)throw new JuaError("non-string key");
-    return dict.contains(key->toString());
-}
-void Jua_Obj::setProp(const string& key, Jua_Val* val){
-    if(dict.contains(key)){
-        dict[key]->release();
+    return freed;
+}
+Shape* Shape::toDictionary() const {
+    auto dict = new Shape;
+    dict->dictionary = true;
+    dict->keys = keys;
+    dict->index = index;
+    return dict;
+}
+void Shape::append(DynamicAtoms& atoms, Atom key){
+    addKey(key);
+    atoms.hold(key);
+}
+void Shape::remove(size_t slot){
+    keys.erase(keys.begin() + slot);
+    index.clear();
+    if(keys.size() > LINEAR_MAX){
+        for(size_t i = 0; i < keys.size(); i++){
+            index[keys[i]] = i;
+        }
     }
-    dict[key] = val;
-    val->addRef();
 }
-void Jua_Obj::delProp(const string& key){
-    if(dict.contains(key)){
-        dict[key]->release();
-        dict.erase(key);
+size_t Shape::bytes() const {
+    //键是驻留的 Atom，字符串由原子表持有；index 每个节点包含键值对和链表指针，另有桶数组
+    return keys.capacity() * sizeof(Atom)
+         + index.size() * (sizeof(std::pair<const Atom, uint32_t>) + sizeof(void*))
+         + index.bucket_count() * sizeof(void*);
+}
+void Shape::addKey(Atom key){
+    keys.push_back(key);
+    if(keys.size() == LINEAR_MAX + 1){
+        for(size_t i = 0; i < keys.size(); i++){
+            index[keys[i]] = i;
+        }
+    }else if(keys.size() > LINEAR_MAX){
+        index[key] = keys.size() - 1;
     }
 }
-Jua_Bool* Jua_Obj::hasItem(Jua_Val* key){
-    auto fn = getMetaMethod("hasItem");
-    if(fn)return fn->call({this, key})->toJuaBool();
-    if(key->type!=Str)
+
+Jua_Obj::Jua_Obj(JuaVM* vm_, Jua_Obj* p): Jua_Ref(vm_, Jua_Val::Obj, p), shape(&vm_->rootShape){}
+Jua_Obj::~Jua_Obj(){
+    if(shape->dictionary)delete shape;
+    if(watched)vm->cacheEpoch++; //缓存中可能有指向该对象的指针
+}
+bool Jua_Obj::hasOwn(Jua_Val key){
+    if(key.type() != Jua_Val::Str)throw new JuaError("non-string key");
+    auto atom = Atom::find(vm, key.toString());
+    return atom && getOwn(atom);
+}
+void Jua_Obj::setProp(Atom key, Jua_Val val){
+    vm->gc.barrier(this, val);
+    if(key == atoms::super || key == atoms::_class)vm->cacheEpoch++; //影响继承，见 Jua_Ref::inheritProp
+    int i = shape->find(key);
+    if(i >= 0){
+        slots[i] = val;
+        return;
+    }
+    if(watched)vm->cacheEpoch++;
+    if(shape->dictionary){
+        shape->append(vm->atoms, key);
+    }else if(auto next = shape->keys.size() < Shape::MAX_SHARED ? shape->transition(vm->atoms, key) : nullptr){
+        shape = next;
+        vm->gc.shapeBarrier(shape);
+    }else{
+        shape = shape->toDictionary();
+        shape->append(vm->atoms, key);
+    }
+    slots.push_back(val);
+}
+void Jua_Obj::delProp(Atom key){
+    int i = shape->find(key);
+    if(i < 0)return;
+    if(watched || key == atoms::super || key == atoms::_class)vm->cacheEpoch++;
+    if(!shape->dictionary)shape = shape->toDictionary();
+    shape->remove(i);
+    slots.erase(slots.begin() + i);
+}
+Jua_Bool Jua_Obj::hasItem(Jua_Val key){
+    auto fn = getMetaMethod(atoms::hasItem);
+    if(fn)return fn->call({this, key}).toJuaBool();
+    if(key.type()!=Jua_Val::Str)
         throw new JuaTypeError("Object.hasItem: key must be a string");
-    return Jua_Bool::getInst(getProp(key->toString()));
+    auto atom = Atom::find(vm, key.toString()); //不在原子表中的字符串不是任何属性的名字
+    return Jua_Bool::getInst(atom && getProp(atom));
 }
-Jua_Val* Jua_Obj::getItem(Jua_Val* key){
-    auto fn = getMetaMethod("getItem");
+Jua_Val Jua_Obj::getItem(Jua_Val key){
+    auto fn = getMetaMethod(atoms::getItem);
     if(fn)return fn->call({this, key});
-    if(key->type!=Str)
+    if(key.type()!=Jua_Val::Str)
         throw new JuaTypeError("Object.getItem: key must be a string");
-    Jua_Val* val = getProp(key->toString());
+    auto atom = Atom::find(vm, key.toString());
+    Jua_Val val = atom ? getProp(atom) : nullptr;
     return val ? val : Jua_Null::getInst();
 }
-void Jua_Obj::setItem(Jua_Val* key, Jua_Val* val){
-    auto fn = getMetaMethod("setItem");
+void Jua_Obj::setItem(Jua_Val key, Jua_Val val){
+    auto fn = getMetaMethod(atoms::setItem);
     if(fn){
         fn->call({this, key, val});
         return;
     }
-    if(key->type!=Str)
+    if(key.type()!=Jua_Val::Str)
         throw new JuaTypeError("Object.setItem: key must be a string");
-    setProp(key->toString(), val);
+    setProp(Atom::dynamic(vm, key.toString()), val);
 }
 void Jua_Obj::assignProps(Jua_Obj* obj){
-    for(auto& pair : obj->dict){
-        dict[pair.first] = pair.second;
+    for(size_t i = 0; i < obj->slots.size(); i++){
+        if(obj->slots[i])setProp(obj->shape->keys[i], obj->slots[i]);
     }
 }
 string Jua_Obj::toString(){
-    auto fn = getMetaMethod("toString");
-    if(fn)return fn->call({this})->toString();
+    auto fn = getMetaMethod(atoms::toString);
+    if(fn)return fn->call({this}).toString();
     return safeToString();
 }
 string Jua_Obj::safeToString(){
-    if(dict.empty())return "{}";
     string str("{");
-    auto it = dict.begin();
-    str.append(it->first);
-    for(it++; it!=dict.end(); it++){
-        str.append(", ");
-        str.append(it->first);
+    for(size_t i = 0; i < slots.size(); i++){
+        if(!slots[i])continue;
+        if(str.size() > 1)str.append(", ");
+        str.append(shape->keys[i].str());
     }
     str.append("}");
     return str;
 }
-bool Jua_Obj::isPropTrue(const char* key){
-    return getProp(key) == Jua_Bool::getInst(true);
+bool Jua_Obj::isPropTrue(Atom key){
+    return getProp(key).same(Jua_Bool::getInst(true));
 }
 
-Jua_Num::Jua_Num(JuaVM* vm, double v): Jua_Val(vm, Num, vm->NumberProto), value(v){}
-Jua_Val* Jua_Num::unm(){
-    return new Jua_Num(vm, -value);
-}
-Jua_Val* Jua_Num::add(Jua_Val* val){
-    if(val->type!=Num)throw new JuaTypeError("try to add non-number");
-    auto num = static_cast<Jua_Num*>(val);
-    return new Jua_Num(vm, value + num->value);
-}
-Jua_Val* Jua_Num::sub(Jua_Val* val){
-    if(val->type!=Num)throw new JuaTypeError("try to sub non-number");
-    auto num = static_cast<Jua_Num*>(val);
-    return new Jua_Num(vm, value - num->value);
-}
-Jua_Val* Jua_Num::mul(Jua_Val* val){
-    if(val->type!=Num)throw new JuaTypeError("try to mul non-number");
-    auto num = static_cast<Jua_Num*>(val);
-    return new Jua_Num(vm, value * num->value);
-}
-Jua_Val* Jua_Num::div(Jua_Val* val){
-    if(val->type!=Num)throw new JuaTypeError("try to div non-number");
-    auto num = static_cast<Jua_Num*>(val);
-    return new Jua_Num(vm, value / num->value);
-}
-Jua_Bool* Jua_Num::lt(Jua_Val* val){
-    if(val->type!=Num)throw new JuaTypeError("try to compare non-number");
-    auto num = static_cast<Jua_Num*>(val);
-    return Jua_Bool::getInst(value < num->value);
-}
-Jua_Bool* Jua_Num::le(Jua_Val* val){
-    if(val->type!=Num)throw new JuaTypeError("try to compare non-number");
-    auto num = static_cast<Jua_Num*>(val);
-    return Jua_Bool::getInst(value <= num->value);
-}
-Jua_Val* Jua_Num::range(Jua_Val* val){
-    if(val->type!=Num)throw new JuaTypeError("try to create range with non-number");
-    auto num = static_cast<Jua_Num*>(val);
-    auto range = new Jua_Obj(vm, vm->RangeProto);
-    range->setProp("start", new Jua_Num(vm, value));
-    range->setProp("step", new Jua_Num(vm, 1));
-    range->setProp("end", new Jua_Num(vm, num->value));
-    return range;
-}
-bool Jua_Num::operator==(Jua_Val* val){
-    if(!val || val->type!=Num)
-        return false;
-    return value == static_cast<Jua_Num*>(val)->value;
-}
-string Jua_Num::toString(){
-    char s[32];
-    auto res = std::to_chars(s, s+32, value);
-    return {s, res.ptr};
+size_t correctIndex(Jua_Val num, size_t len){
+    return num.toInt() % len;
 }
 
-size_t correctIndex(Jua_Val* num, size_t len){
-    return num->toInt() % len;
+Jua_Str::Jua_Str(JuaVM* vm, const string& v): Jua_Ref(vm, Jua_Val::Str, vm->StringProto), value(v){}
+Jua_Bool Jua_Str::hasItem(Jua_Val val){
+    if(val.type()!=Jua_Val::Str)return Jua_Bool::getInst(false);
+    return Jua_Bool::getInst(value.find(val.toString()) != string::npos);
 }
-
-Jua_Str::Jua_Str(JuaVM* vm, const string& v): Jua_Val(vm, Str, vm->StringProto), value(v){}
-Jua_Bool* Jua_Str::hasItem(Jua_Val* val){
-    if(val->type!=Str)return Jua_Bool::getInst(false);
-    return Jua_Bool::getInst(value.find(val->toString()) != string::npos);
-}
-Jua_Val* Jua_Str::getItem(Jua_Val* key){
+Jua_Val Jua_Str::getItem(Jua_Val key){
     size_t i = correctIndex(key, value.length());
     return new Jua_Str(vm, {value[i]});
 }
-Jua_Val* Jua_Str::add(Jua_Val* val){
-    if(val->type!=Str)throw new JuaTypeError("try to add non-string");
-    auto str = static_cast<Jua_Str*>(val);
+Jua_Val Jua_Str::add(Jua_Val val){
+    if(val.type()!=Jua_Val::Str)throw new JuaTypeError("try to add non-string");
+    auto str = val.as<Jua_Str>();
     return new Jua_Str(vm, value + str->value);
 }
-bool Jua_Str::operator==(Jua_Val* val){
-    if(!val || val->type!=Str)
+bool Jua_Str::operator==(Jua_Val val){
+    if(!val || val.type()!=Jua_Val::Str)
         return false;
-    return value == static_cast<Jua_Str*>(val)->value;
+    return value == val.as<Jua_Str>()->value;
 }
 
-Jua_Val* Scope::inheritProp(const string& key){
-    if(parent)return parent->getProp(key); //指针可能已经失效？？？
+Jua_Val Scope::inheritProp(Atom key){
+    if(parent)return parent->getProp(key);
     return nullptr;
 }
+void Scope::assign(Atom key, Jua_Val val){
+    for(auto scope = this; scope; scope = scope->parent){
+        if(scope->getOwn(key)){
+            scope->setProp(key, val);
+            return;
+        }
+    }
+    throw string("Variable not found: ") + key.str();
+}
+
+Jua_Val Jua_NativeFunc::call(JuaArgs args){
+    auto res = native(vm, args, data);
+    if(res)return res;
+    return Jua_Null::getInst();
+}
 
 Jua_Array::Jua_Array(JuaVM* vm, const jualist& list): Jua_Obj(vm, vm->ArrayProto), items(list){}
-Jua_Val* Jua_Array::getItem(Jua_Val* key){
+Jua_Val Jua_Array::getItem(Jua_Val key){
     size_t i = correctIndex(key, items.size());
     return items[i];
 }
-void Jua_Array::setItem(Jua_Val* key, Jua_Val* val){
+void Jua_Array::setItem(Jua_Val key, Jua_Val val){
     size_t i = correctIndex(key, items.size());
+    vm->gc.barrier(this, val);
     items[i] = val;
 }
 JuaIterator* Jua_Array::getIterator(Jua_Func* next){
-    return new ListIterator(items);
+    return new ListIterator(this);
+}
+
+Jua_Range::Jua_Range(JuaVM* vm, double s, double e, double st): Jua_Obj(vm, vm->RangeProto), start(s), end(e), step(st){}
+void Jua_Range::init(double s, double e, double st){
+    if(st == 0 || st != st)throw new JuaError("Range step must be a non-zero number");
+    start = s;
+    end = e;
+    step = st;
+}
+size_t Jua_Range::length() const {
+    double n = std::ceil((end - start) / step);
+    if(!(n > 0))return 0;
+    return n < 0x1p53 ? size_t(n) : size_t(0x1p53); //无穷区间
+}
+Jua_Bool Jua_Range::hasItem(Jua_Val val){
+    //与迭代得到的元素比较，小数步长的误差与迭代时一致
+    if(!val.isNum())return Jua_Bool::getInst(false);
+    double i = std::round((val.num() - start) / step);
+    return Jua_Bool::getInst(i >= 0 && i < length() && at(size_t(i)) == val.num());
+}
+JuaIterator* Jua_Range::getIterator(Jua_Func* next){
+    return new RangeIterator(this);
+}
+string Jua_Range::safeToString(){
+    string str = Jua_Num(start).toString() + ".." + Jua_Num(end).toString();
+    if(step != 1)str += " step " + Jua_Num(step).toString();
+    return str;
 }
 
 Jua_Buffer::Jua_Buffer(JuaVM* vm, size_t len):Jua_Obj(vm, vm->BufferProto), length(len){
     bytes = new uint8_t[len];
 }
-Jua_Val* Jua_Buffer::getItem(Jua_Val* key){
+Jua_Val Jua_Buffer::getItem(Jua_Val key){
     size_t i = correctIndex(key, length);
-    return new Jua_Num(vm, bytes[i]);
+    return Jua_Num(bytes[i]);
 }
-void Jua_Buffer::setItem(Jua_Val* key, Jua_Val* val){
+void Jua_Buffer::setItem(Jua_Val key, Jua_Val val){
     size_t i = correctIndex(key, length);
-    bytes[i] = val->toInt();
+    bytes[i] = val.toInt();
 }
-Jua_Val* Jua_Buffer::read(Jua_Val* _start, Jua_Val* _end){
+Jua_Val Jua_Buffer::read(Jua_Val _start, Jua_Val _end){
     size_t start = correctIndex(_start, length);
     size_t end = correctIndex(_end, length);
     if(!end)end = length;
@@ -361,10 +678,10 @@ Jua_Val* Jua_Buffer::read(Jua_Val* _start, Jua_Val* _end){
     memcpy(&str->value[0], bytes+start, len);
     return str;
 }
-void Jua_Buffer::write(Jua_Val* _str, Jua_Val* _pos){
-    if(!_str || _str->type!=Str)
+void Jua_Buffer::write(Jua_Val _str, Jua_Val _pos){
+    if(!_str || _str.type()!=Jua_Val::Str)
         throw new JuaTypeError("value must be a string");
-    std::string& str = static_cast<Jua_Str*>(_str)->value;
+    std::string& str = _str.as<Jua_Str>()->value;
     size_t pos = _pos ? correctIndex(_pos, length) : 0;
     size_t len = str.size();
     if(pos+len > length)
@@ -373,7 +690,7 @@ void Jua_Buffer::write(Jua_Val* _str, Jua_Val* _pos){
 }
 
 string JuaError::toDebugString(){
-    if(!message.size())return "JuaError";
-    return std::format("JuaError: {}", message);
+    auto msg = detail();
+    if(!msg.size())return name();
+    return std::format("{}: {}", name(), msg);
 }
-
@@ -6,42 +6,49 @@ JuaVM::JuaVM(){
     initBuiltins();
     makeGlobal();
     modules["math"] = makeMath();
-    modules["math"]->addRef();
     modules["json"] = makeJSON();
-    modules["json"]->addRef();
+    modules["gc"] = makeGC();
 }
 
 void JuaVM::run(const string& script){
     try{
-        auto val = eval(script);
-        val->gc();
+        eval(script);
     }catch(JuaError* e){
         j_stderr(e);
+        delete e;
     }
 }
 
-Jua_Val* JuaVM::eval(const string& script){
-    //返回非空指针，可能需要垃圾回收
+Jua_Val JuaVM::eval(const string& script){
+    //返回非空值，可能需要垃圾回收
     //d_log("eval");
     //d_log(script);
-    auto body = parse(script);
-    return body->exec(new Scope(_G));
+    auto body = parse(script, dumpFolds);
+    TreeGuard tree(body->tree); //执行期间创建的函数值另外持有语法树
+    switch(engine){
+        case Bytecode: return interp.run(body, body->newScope(_G));
+        case Closure: return body->run(body->newScope(_G));
+        default: return body->exec(body->newScope(_G));
+    }
+}
+bool quickens(JuaVM* vm){
+    return vm->quicken;
 }
 void JuaVM::initBuiltins(){
-    obj_new = makeFunc([this](jualist& args){
-        Jua_Val* proto = nullptr;
+    obj_new = makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
+        Jua_Val proto = nullptr;
         if(args.size() > 0){
             proto = args[0];
-            if(proto->type == Jua_Val::Null){
+            if(proto.type() == Jua_Val::Null){
                 proto = nullptr;
-            }else if(proto->type != Jua_Val::Obj){
+            }else if(proto.type() != Jua_Val::Obj){
                 throw new JuaError("Object.new() requires an object prototype");
             }
             args.pop_front();
         }
-        auto obj = new Jua_Obj(this, static_cast<Jua_Obj*>(proto));
+        auto obj = new Jua_Obj(vm, proto.as<Jua_Obj>());
         if(proto){
-            auto init = obj->getMetaMethod("init");
+            auto init = obj->getMetaMethod(atoms::init);
             if(init){
                 args.push_front(obj);
                 init->call(args);
@@ -49,27 +56,27 @@ void JuaVM::initBuiltins(){
         }
         return obj;
     });
-    obj_next = makeFunc([](jualist& args){
+    obj_next = makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 2) throw "Range.next() requires 2 arguments";
         auto self = args[0];
-        if(self->type != Jua_Val::Obj){
+        if(self.type() != Jua_Val::Obj){
             throw new JuaError("Range.next() called on a non-object");
         }
-        auto obj = static_cast<Jua_Obj*>(self);
+        auto obj = self.as<Jua_Obj>();
         auto key = args[1];
-        std::unordered_map<string, Jua_Val*>::iterator it;
-        if(key->type == Jua_Val::Str){
-            string str_key = key->toString();
-            it = obj->dict.find(str_key);
-            it++;
-        }else{
-            it = obj->dict.begin();
-        }
-        auto res = new Jua_Obj(self->vm);
-        if(it == obj->dict.end()){
+        //按属性的添加顺序迭代；当前的键被删除时结束迭代
+        size_t i = 0;
+        if(key.type() == Jua_Val::Str){
+            auto atom = Atom::find(vm, key.toString());
+            int slot = atom ? obj->shape->find(atom) : -1;
+            i = slot < 0 ? obj->slots.size() : slot + 1;
+        }
+        while(i < obj->slots.size() && !obj->slots[i])i++;
+        auto res = new Jua_Obj(vm);
+        if(i >= obj->slots.size()){
             res->setProp("done", Jua_Bool::getInst(true));
         }else{
-            auto value = new Jua_Str(self->vm, it->first);
+            auto value = new Jua_Str(vm, obj->shape->keys[i].str());
             res->setProp("done", Jua_Bool::getInst(false));
             res->setProp("key", value);
             res->setProp("value", value);
@@ -103,64 +110,103 @@ void JuaVM::makeGlobal(){
     _G->setProp("Buffer", BufferProto);
     _G->setProp("Range", RangeProto);
     _G->setProp("Error", ErrorProto);
-    _G->addRef();
     _G->setProp("_G", _G);
-    _G->setProp("print", makeFunc([this](jualist& args){
-        j_stdout(args);
+    _G->setProp("print", makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
+        vm->j_stdout(args);
         return Jua_Null::getInst();
     }));
-    _G->setProp("class", makeFunc([this](jualist& args){
+    _G->setProp("class", makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 1) throw "class() requires at least one argument";
-        Jua_Val* proto = args[0];
-        if(proto->type != Jua_Val::Obj){
+        Jua_Val proto = args[0];
+        if(proto.type() != Jua_Val::Obj){
             throw new JuaError("class() requires an object prototype");
         }
-        proto->proto = classProto; //todo: 如果采用引用计数，需要设置一个统一的入口来修改 proto
+        vm->gc.barrier(proto.ref(), vm->classProto);
+        proto.ref()->proto = vm->classProto;
+        vm->cacheEpoch++;
         return proto;
     }));
-    _G->setProp("require", makeFunc([this](jualist& args){
+    _G->setProp("require", makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 1) throw "require() requires at least one argument";
-        if(args[0]->type != Jua_Val::Str){
+        if(args[0].type() != Jua_Val::Str){
             throw new JuaError("require() requires a string argument");
         }
-        return require(args[0]->toString());
-    }));
-    _G->setProp("throw", makeFunc([this](jualist& args){
-        if(args.size() < 1) throw "throw() requires at least one argument";
-        Jua_Val* val = args[0];
-        //todo: 允许抛出对象
-        if(val->type != Jua_Val::Str){
-            throw new JuaError("throw() requires a string argument");
-        }
-        throw new JuaError(val->toString());
-        return Jua_Null::getInst(); // unreachable, but required for function signature
+        return vm->require(args[0].toString());
     }));
-    _G->setProp("try", makeFunc([this](jualist& args){
-        auto res = new Jua_Obj(this, TryResProto);
+    //字节码解释器直接处理对脚本函数的 try 和 throw 调用，见 Interpreter::catchError
+    fn_throw = makeFunc([](JuaVM*, JuaArgs args, void*) -> Jua_Val {
+        throw scriptError(args);
+    });
+    _G->setProp("throw", fn_throw);
+    fn_try = makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
         try{
             if(args.size() < 1) throw "try() requires at least one argument";
-            Jua_Val* fn = args[0];
-            if(fn->type != Jua_Val::Func){
+            Jua_Val fn = args[0];
+            if(fn.type() != Jua_Val::Func){
                 throw new JuaError("try() requires a function argument");
             }
             args.pop_front();
-            res->setProp("value", fn->call(args));
-            res->setProp("status", Jua_Bool::getInst(true));
-            return res;
+            auto value = fn.call(args);
+            return vm->tryResult(value); //在调用之后创建，调用期间可能发生垃圾回收
         } catch (JuaError* e) {
-            res->setProp("error", new Jua_Str(this, e->toDebugString()));
-            res->setProp("status", Jua_Bool::getInst(false));
-            return res;
+            return vm->tryError(e);
         }
-    }));
-    _G->setProp("type", makeFunc([this](jualist& args){
+    });
+    _G->setProp("try", fn_try);
+    _G->setProp("type", makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 1) throw "type() requires at least one argument";
-        Jua_Val* val = args[0];
-        auto typeName = val->getTypeName();
-        return new Jua_Str(this, typeName);
+        Jua_Val val = args[0];
+        auto typeName = val.getTypeName();
+        return new Jua_Str(vm, typeName);
     }));
 }
-Jua_Val* JuaVM::require(const string& name){
+Scope* JuaVM::pushFrameScope(Shape* layout, Scope* parent){
+    if(frameDepth == frameScopes.size())frameScopes.push_back(new Scope(this));
+    auto scope = frameScopes[frameDepth++];
+    scope->parent = parent;
+    scope->proto = parent;
+    gc.barrier(scope, parent);
+    scope->layout = scope->shape = layout;
+    scope->slots.resize(layout->keys.size()); //弹出时已清空，保留容量
+    return scope;
+}
+void JuaVM::popFrameScopes(size_t depth){
+    while(frameDepth > depth){
+        auto scope = frameScopes[--frameDepth];
+        if(scope->shape->dictionary)delete scope->shape;
+        scope->layout = scope->shape = &rootShape; //layout 在语法树释放后可能被回收，弹出的作用域不再引用它
+        scope->slots.clear();
+        scope->parent = nullptr;
+        scope->proto = nullptr;
+    }
+}
+JuaError* JuaVM::scriptError(JuaArgs args){
+    if(args.size() < 1) throw "throw() requires at least one argument";
+    Jua_Val val = args[0];
+    //todo: 允许抛出对象
+    if(val.type() != Jua_Val::Str){
+        throw new JuaError("throw() requires a string argument");
+    }
+    return new JuaError(val.toString());
+}
+Jua_Obj* JuaVM::tryResult(Jua_Val value){
+    auto res = new Jua_Obj(this, TryResProto);
+    res->setProp("value", value);
+    res->setProp("status", Jua_Bool::getInst(true));
+    return res;
+}
+Jua_Obj* JuaVM::tryError(JuaError* e){
+    //转为 Error 对象：只保存名称和消息，toString 时才拼接
+    std::unique_ptr<JuaError> owner(e);
+    auto err = new Jua_Obj(this, ErrorProto);
+    err->setProp("name", new Jua_Str(this, e->name()));
+    err->setProp("message", new Jua_Str(this, e->detail()));
+    auto res = new Jua_Obj(this, TryResProto);
+    res->setProp("error", err);
+    res->setProp("status", Jua_Bool::getInst(false));
+    return res;
+}
+Jua_Val JuaVM::require(const string& name){
     if(modules.contains(name))return modules[name];
     //todo: 检查循环导入
     const string& script = findModule(name);
@@ -172,108 +218,102 @@ Jua_Obj* JuaVM::buildClass(Jua_NativeFunc::Native constructor){
     //constructor 接收初始化参数（不包括类自身），返回类实例
     auto clsProto = new Jua_Obj(this);
     clsProto->setProp("__class", Jua_Bool::getInst(true));
-    clsProto->setProp("__call", makeFunc([this, constructor](jualist& args){
+    clsProto->setProp("__call", makeFunc([](JuaVM* vm, JuaArgs args, void* data) -> Jua_Val {
         args.pop_front(); // 移除类本身
-        return constructor(args);
-    }));
+        return reinterpret_cast<Jua_NativeFunc::Native>(data)(vm, args, nullptr);
+    }, reinterpret_cast<void*>(constructor)));
     auto cls = new Jua_Obj(this, clsProto);
     return cls;
 }
 
+static Jua_Range* rangeSelf(JuaArgs args, const char* name){
+    if(args.size() < 1 || !args[0].isType(Jua_Range::type_id))
+        throw new JuaError(string(name) + " called on a non-range object");
+    return args[0].as<Jua_Range>();
+}
+static double rangeArg(JuaArgs args, size_t i, double def){
+    if(i >= args.size())return def;
+    if(args[i].type() != Jua_Val::Num)throw new JuaTypeError("Range arguments must be numbers");
+    return args[i].num();
+}
 Jua_Obj* JuaVM::makeRangeProto(){
-    auto proto = new Jua_Obj(this, classProto);
-    proto->setProp("init", makeFunc([](jualist& args){
+    //实例为原生的 Jua_Range，for 循环对其直接计数，见 ForStmt
+    auto proto = buildClass([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
+        if(args.size() < 2) throw new JuaError("Range() requires at least 2 arguments");
+        auto range = new Jua_Range(vm, 0, 0);
+        range->init(rangeArg(args, 0, 0), rangeArg(args, 1, 0), rangeArg(args, 2, 1)); //Jua_Range 的构造函数不检查参数，由 init 检查，步长为 0 时抛出的错误交给调用者
+        return range;
+    });
+    proto->setProp("init", makeFunc([](JuaVM*, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 3) throw "range() requires 3 arguments";
-        auto self = args[0];
-        if(self->type != Jua_Val::Obj)
-            throw new JuaError("range() called on non-object value");
-        auto obj = static_cast<Jua_Obj*>(self);
-        double start = args[1]->toNumber();
-        double end = args[2]->toNumber();
-        double step = 1;
-        if(args.size() >= 4){
-            step = args[4]->toNumber();
-        }
-        obj->setProp("start", new Jua_Num(self->vm, start));
-        obj->setProp("end", new Jua_Num(self->vm, end));
-        obj->setProp("step", new Jua_Num(self->vm, step));
+        auto range = rangeSelf(args, "Range.init()");
+        range->init(rangeArg(args, 1, 0), rangeArg(args, 2, 0), rangeArg(args, 3, 1));
         return Jua_Null::getInst();
     }));
-    proto->setProp("next", makeFunc([](jualist& args){
-        //todo: 支持浮点数
+    proto->setProp("next", makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
+        //迭代协议，键与值相同；for 循环不经过这里
         if(args.size() < 2) throw "Range.next() requires 2 arguments";
-        auto self = args[0];
-        if(self->type != Jua_Val::Obj){
-            throw new JuaError("Range.next() called on a non-object");
-        }
+        auto range = rangeSelf(args, "Range.next()");
         auto key = args[1];
-        size_t index;
-        if(key->type == Jua_Val::Num){
-            auto step = self->getProp("step");
-            if(!step || step->type != Jua_Val::Num)
-                throw new JuaError("Range.next() called on a non-range object");
-            index = key->toInt() + step->toInt();
-        }else{
-            auto start = self->getProp("start");
-            if(!start || start->type != Jua_Val::Num)
-                throw new JuaError("Range.next() called on a non-range object");
-            index = start->toInt();
-        }
-        
-        auto end = self->getProp("end");
-        if(!end || end->type != Jua_Val::Num)
-            throw new JuaError("Range.next() called on a non-range object");
-        auto res = new Jua_Obj(self->vm);
-        bool done = index >= end->toInt();
-        res->setProp("done", Jua_Bool::getInst(done));
+        size_t index = 0;
+        if(key.type() == Jua_Val::Num){
+            double i = std::round((key.num() - range->start) / range->step) + 1;
+            if(i > 0)index = i;
+        }
+        auto res = new Jua_Obj(vm);
+        bool done = index >= range->length();
+        res->setProp(atoms::done, Jua_Bool::getInst(done));
         if(!done){
-            auto value = new Jua_Num(self->vm, index);
-            res->setProp("value", value);
-            res->setProp("key", value);
+            auto value = Jua_Num(range->at(index));
+            res->setProp(atoms::value, value);
+            res->setProp(atoms::key, value);
         }
         return res;
     }));
+    proto->setProp("len", makeFunc([](JuaVM*, JuaArgs args, void*) -> Jua_Val {
+        return Jua_Num(rangeSelf(args, "Range.len()")->length());
+    }));
     return proto;
 }
 Jua_Obj* JuaVM::makeNumberProto(){
-    auto proto = buildClass([this](jualist& args){
+    auto proto = buildClass([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
         double value = 0.0;
         if(args.size() > 0){
-            Jua_Val* arg = args[0];
-            if(arg->type == Jua_Val::Num){
-                value = static_cast<Jua_Num*>(arg)->value;
-            }else if(arg->type == Jua_Val::Str){
+            Jua_Val arg = args[0];
+            if(arg.type() == Jua_Val::Num){
+                value = arg.num();
+            }else if(arg.type() == Jua_Val::Str){
                 try {
-                    value = std::stod(arg->toString());
+                    value = std::stod(arg.toString());
                 } catch (const std::invalid_argument&) {
-                    throw new JuaError("Invalid number string: " + arg->toString());
+                    throw new JuaError("Invalid number string: " + arg.toString());
                 } catch (const std::out_of_range&) {
-                    throw new JuaError("Number out of range: " + arg->toString());
+                    throw new JuaError("Number out of range: " + arg.toString());
                 }
             } else {
                 throw new JuaError("Number constructor requires a number or string argument");
             }
         }
-        return new Jua_Num(this, value);
+        return Jua_Num(value);
     });
     proto->setProp("LITTLE_ENDIAN", Jua_Bool::getInst(isLittleEndian()));
     proto->setProp("range", RangeProto);
-    proto->setProp("__range", makeFunc([this](jualist& args){
+    proto->setProp("__range", makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 2)throw new JuaError("requires at least 2 arguments");
-        return RangeProto->call(args);
+        return vm->RangeProto->call(args);
     }));
-    proto->setProp("toString", makeFunc([](jualist& args){
+    proto->setProp("toString", makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 1) throw new JuaError("Number.toString() requires 1 argument");
         auto self = args[0];
-        if(self->type != Jua_Val::Num){
+        if(self.type() != Jua_Val::Num){
             throw new JuaError("Number.toString() called on a non-number");
         }
-        return new Jua_Str(self->vm, self->toString());
+        return new Jua_Str(vm, self.toString());
     }));
-    proto->setProp("isInt", makeFunc([](jualist& args){
+    proto->setProp("isInt", makeFunc([](JuaVM*, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 1) throw new JuaError("Number.isInt() requires 1 argument");
         auto val = args[0];
-        if(val->type != Jua_Val::Num)return Jua_Bool::getInst(false);
+        if(val.type() != Jua_Val::Num)return Jua_Bool::getInst(false);
         throw "todo";
     }));
     proto->setProp("encodeUint8", makeEncodeFunc(encode<uint8_t>));
@@ -295,49 +335,49 @@ Jua_Obj* JuaVM::makeNumberProto(){
     return proto;
 }
 Jua_Obj* JuaVM::makeStringProto(){
-    auto proto = buildClass([this](jualist& args){
+    auto proto = buildClass([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
         string value;
         if(args.size() > 0){
-            value = args[0]->toString();
+            value = args[0].toString();
         }
-        return new Jua_Str(this, value);
+        return new Jua_Str(vm, value);
     });
-    proto->setProp("byte", makeFunc([](jualist& args){
+    proto->setProp("byte", makeFunc([](JuaVM*, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 1)throw new JuaError("missing argument");
         auto val = args[0];
-        if(val->type != Jua_Val::Str)
+        if(val.type() != Jua_Val::Str)
             throw new JuaError("String.byte() called on non-string value");
-        auto self = static_cast<Jua_Str*>(val);
+        auto self = val.as<Jua_Str>();
         size_t index = 0;
         if(args.size() >= 2){
-            index = args[1]->toInt() % self->value.length();
+            index = args[1].toInt() % self->value.length();
         }
         uint8_t byte = self->value[index];
-        return new Jua_Num(self->vm, byte);
+        return Jua_Num(byte);
     }));
-    proto->setProp("fromByte", makeFunc([this](jualist& args){
+    proto->setProp("fromByte", makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
         string str;
         str.reserve(args.size());
         for(auto v: args){
-            str.push_back(v->toInt());
+            str.push_back(v.toInt());
         }
-        return new Jua_Str(this, str);
+        return new Jua_Str(vm, str);
     }));
-    proto->setProp("len", makeFunc([](jualist& args){
+    proto->setProp("len", makeFunc([](JuaVM*, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 1)throw new JuaError("missing argument");
         auto val = args[0];
-        if(val->type != Jua_Val::Str)
+        if(val.type() != Jua_Val::Str)
             throw new JuaError("String.len() called on non-string value");
-        auto str = static_cast<Jua_Str*>(val);
-        return new Jua_Num(val->vm, str->value.size());
+        auto str = val.as<Jua_Str>();
+        return Jua_Num(str->value.size());
     }));
-    proto->setProp("toHex", makeFunc([](jualist& args){
+    proto->setProp("toHex", makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
         static const char hexDigits[] = "0123456789abcdef";
 
         if(!args.size())throw new JuaError("String.toHex() requires at least 1 argument");
         auto self = args[0];
-        if(self->type != Jua_Val::Str)throw new JuaError("String.toHex() called on non-string value");
-        auto str = self->toString();
+        if(self.type() != Jua_Val::Str)throw new JuaError("String.toHex() called on non-string value");
+        auto str = self.toString();
         string hexStr;
         hexStr.reserve(str.size() * 3);
         for (uint8_t byte: str) {
@@ -346,228 +386,242 @@ Jua_Obj* JuaVM::makeStringProto(){
             hexStr.push_back(' ');
         }
         hexStr.pop_back();
-        return new Jua_Str(self->vm, hexStr);
+        return new Jua_Str(vm, hexStr);
     }));
     return proto;
 }
 Jua_Obj* JuaVM::makeFunctionProto(){
-    auto proto = buildClass([this](jualist& args){
+    auto proto = buildClass([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 1) throw new JuaError("Function constructor requires at least one argument");
-        std::deque<DeclarationItem*> params;
         for(size_t i=0; i<args.size()-1; i++){
-            if(args[i]->type != Jua_Val::Str){
+            if(args[i].type() != Jua_Val::Str){
                 throw new JuaError("Function constructor requires string arguments");
             }
-            auto varname = new Varname(args[i]->toString()); //todo: 检查合法性
-            auto decItem = new DeclarationItem(varname, nullptr);
-            params.push_back(decItem);
         }
         auto script = args.back();
-        auto body = parse(script->toString());
-        auto declist = new DeclarationList(params);
-        return new Jua_PFunc(_G, declist, body);
+        auto body = parse(script.toString(), vm->dumpFolds);
+        TreeGuard tree(body->tree);
+        //参数与函数体属于同一棵语法树
+        auto& nodes = body->tree->nodes;
+        std::deque<DeclarationItem*> params;
+        for(size_t i=0; i<args.size()-1; i++){
+            auto varname = nodes.make<Varname>(body->tree->intern(args[i].toString())); //todo: 检查合法性
+            params.push_back(nodes.make<DeclarationItem>(varname, nullptr));
+        }
+        auto declist = nodes.make<DeclarationList>(params);
+        resolve(body, declist);
+        return new Jua_PFunc(vm->_G, declist, body);
     });
     return proto;
 }
 Jua_Obj* JuaVM::makeObjectProto(){
     auto proto = new Jua_Obj(this, classProto);
     proto->setProp("new", obj_new);
-    proto->setProp("get", makeFunc([](jualist& args){
+    proto->setProp("get", makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 2) throw "Object.get() requires 2 arguments";
         auto self = args[0];
-        if(self->type != Jua_Val::Obj){
+        if(self.type() != Jua_Val::Obj){
             throw new JuaError("Object.get() called on a non-object");
         }
-        auto obj = static_cast<Jua_Obj*>(self);
+        auto obj = self.as<Jua_Obj>();
         auto key = args[1];
-        if(key->type != Jua_Val::Str){
+        if(key.type() != Jua_Val::Str){
             throw new JuaError("Object.get() requires a string key");
         }
-        return obj->getOwn(key->toString());
+        auto atom = Atom::find(vm, key.toString());
+        return atom ? obj->getOwn(atom) : nullptr;
     }));
-    proto->setProp("hasOwn", makeFunc([this](jualist& args){
+    proto->setProp("hasOwn", makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 2) throw "Object.hasOwn() requires 2 arguments";
         auto self = args[0];
-        if(self->type != Jua_Val::Obj){
+        if(self.type() != Jua_Val::Obj){
             throw new JuaError("Object.hasOwn() called on a non-object");
         }
-        auto obj = static_cast<Jua_Obj*>(self);
+        auto obj = self.as<Jua_Obj>();
         auto key = args[1];
-        if(key->type != Jua_Val::Str){
+        if(key.type() != Jua_Val::Str){
             throw new JuaError("Object.hasOwn() requires a string key");
         }
         return Jua_Bool::getInst(obj->hasOwn(key));
     }));
-    proto->setProp("set", makeFunc([](jualist& args){
+    proto->setProp("set", makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 3) throw "Object.set() requires 3 arguments";
         auto self = args[0];
-        if(self->type != Jua_Val::Obj){
+        if(self.type() != Jua_Val::Obj){
             throw new JuaError("Object.set() called on a non-object");
         }
-        auto obj = static_cast<Jua_Obj*>(self);
+        auto obj = self.as<Jua_Obj>();
         auto key = args[1];
-        if(key->type != Jua_Val::Str){
+        if(key.type() != Jua_Val::Str){
             throw new JuaError("Object.set() requires a string key");
         }
         auto value = args[2];
-        obj->setProp(key->toString(), value);
+        obj->setProp(Atom::dynamic(vm, key.toString()), value);
         return Jua_Null::getInst();
     }));
-    proto->setProp("del", makeFunc([](jualist& args){
+    proto->setProp("del", makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 2) throw "Object.del() requires 2 arguments";
         auto self = args[0];
-        if(self->type != Jua_Val::Obj){
+        if(self.type() != Jua_Val::Obj){
             throw new JuaError("Object.del() called on a non-object");
         }
-        auto obj = static_cast<Jua_Obj*>(self);
+        auto obj = self.as<Jua_Obj>();
         auto key = args[1];
-        if(key->type != Jua_Val::Str){
+        if(key.type() != Jua_Val::Str){
             throw new JuaError("Object.del() requires a string key");
         }
-        obj->delProp(key->toString());
+        if(auto atom = Atom::find(vm, key.toString()))obj->delProp(atom);
         return Jua_Null::getInst();
     }));
-    proto->setProp("getProto", makeFunc([](jualist& args){
+    proto->setProp("getProto", makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 1) throw new JuaError("Object.getProto() requires 1 argument");
-        return args[0]->proto; // nullptr 会自动转换为 Jua_Null
+        return args[0].getProto(vm); // nullptr 会自动转换为 Jua_Null
     }));
-    proto->setProp("setProto", makeFunc([](jualist& args){
+    proto->setProp("setProto", makeFunc([](JuaVM*, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 2) throw new JuaError("Object.setProto() requires 2 arguments");
         auto self = args[0];
-        if(self->type != Jua_Val::Obj){
+        if(self.type() != Jua_Val::Obj){
             throw new JuaError("Object.setProto() called on a non-object");
         }
-        auto obj = static_cast<Jua_Obj*>(self);
+        auto obj = self.as<Jua_Obj>();
         auto proto = args[1];
-        if(proto->type != Jua_Val::Obj && proto->type != Jua_Val::Null){
+        if(proto.type() != Jua_Val::Obj && proto.type() != Jua_Val::Null){
             throw new JuaError("Object.setProto() requires an object or null prototype");
         }
-        obj->proto = static_cast<Jua_Obj*>(proto);
+        obj->vm->gc.barrier(obj, proto);
+        obj->proto = proto.as<Jua_Obj>();
+        obj->vm->cacheEpoch++;
         return Jua_Null::getInst();
     }));
     proto->setProp("next", obj_next);
-    proto->setProp("toString", makeFunc([](jualist& args){
+    proto->setProp("toString", makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 1) throw "Object.toString() requires 1 argument";
         auto self = args[0];
-        if(self->type != Jua_Val::Obj){
+        if(self.type() != Jua_Val::Obj){
             throw new JuaError("Object.toString() called on a non-object");
         }
-        return new Jua_Str(self->vm, self->safeToString());
+        return new Jua_Str(vm, self.safeToString());
     }));
-    proto->setProp("id", makeFunc([this](jualist& args){
+    proto->setProp("id", makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 1) throw "Object.id() requires 1 argument";
         auto self = args[0];
-        if(self->type != Jua_Val::Obj && self->type != Jua_Val::Func){
+        if(self.type() != Jua_Val::Obj && self.type() != Jua_Val::Func){
             throw new JuaError("Object.id() expected an object or function");
         }
-        if(self->id == -1){
-            self->id = ++idcounter; // 分配一个唯一的 ID
+        auto ref = self.ref();
+        if(ref->id == -1){
+            ref->id = ++vm->idcounter; // 分配一个唯一的 ID
         }
-        return new Jua_Num(self->vm, self->id);
+        return Jua_Num(ref->id);
     }));
     return proto;
 }
 Jua_NativeFunc* JuaVM::makeEncodeFunc(Encoder encode){
-    return makeFunc([this, encode](jualist& args){
-        auto str = new Jua_Str(this, "");
+    return makeFunc([](JuaVM* vm, JuaArgs args, void* data) -> Jua_Val {
+        auto encode = reinterpret_cast<Encoder*>(data);
+        auto str = new Jua_Str(vm, "");
         for(auto v: args) {
-            if(v->type != Jua_Val::Num){
+            if(v.type() != Jua_Val::Num){
                 throw new JuaError("encode() requires number arguments");
             }
-            str->value += encode(v->toNumber());
+            str->value += encode(v.toNumber());
         }
         return str;
-    });
+    }, reinterpret_cast<void*>(encode));
 }
 Jua_NativeFunc* JuaVM::makeDecodeFunc(Decoder decode){
-    return makeFunc([this, decode](jualist& args){
+    return makeFunc([](JuaVM*, JuaArgs args, void* data) -> Jua_Val {
+        auto decode = reinterpret_cast<Decoder*>(data);
         if(args.size() < 1) throw "decode() requires at least one argument";
-        Jua_Val* val = args[0];
-        if(val->type != Jua_Val::Str){
+        Jua_Val val = args[0];
+        if(val.type() != Jua_Val::Str){
             throw new JuaError("decode() requires a string argument");
         }
         double result;
         try{
-            result = decode(val->toString());
+            result = decode(val.toString());
         } catch (size_t size) {
             throw new JuaError(std::format("decode() requires a string of at least %zu bytes", size));
         }
-        return new Jua_Num(this, result);
-    });
+        return Jua_Num(result);
+    }, reinterpret_cast<void*>(decode));
 }
 
 Jua_Obj* JuaVM::makeArrayProto(){
-    auto proto = buildClass([this](jualist& args){
+    auto proto = buildClass([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
         if(!args.size())throw new JuaError("Missing argument");
         auto val = args[0];
-        auto arr = new Jua_Array(this, {});
-        val->collectItems(arr->items);
+        auto arr = new Jua_Array(vm, {});
+        RootGuard guard(vm->gc);
+        guard.push(arr);
+        val.collectItems(arr->items);
+        vm->gc.barrier(arr); //收集过程中可能已晋升
         return arr;
     });
-    proto->setProp("hasItem", makeFunc([](jualist& args){
+    proto->setProp("hasItem", makeFunc([](JuaVM*, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 2) throw new JuaError("Array.hasItem() requires 2 arguments");
         auto self = args[0];
-        if(!self->isType(Jua_Array::type_id)){
+        if(!self.isType(Jua_Array::type_id)){
             throw new JuaError("Array.hasItem() called on a non-array object");
         }
-        auto arr = static_cast<Jua_Array*>(self);
+        auto arr = self.as<Jua_Array>();
         auto item = args[1];
         for(auto v: arr->items){
-            if(*v == item){
+            if(v.equals(item)){
                 return Jua_Bool::getInst(true);
             }
         }
         return Jua_Bool::getInst(false);
     }));
-    proto->setProp("of", makeFunc([this](jualist& args){
-        return new Jua_Array(this, args);
+    proto->setProp("of", makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
+        return new Jua_Array(vm, jualist(args.begin(), args.end()));
     }));
-    proto->setProp("len", makeFunc([](jualist& args){
+    proto->setProp("len", makeFunc([](JuaVM*, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 1) throw new JuaError("Array.len() requires 1 argument");
         auto self = args[0];
-        if(!self->isType(Jua_Array::type_id)){
+        if(!self.isType(Jua_Array::type_id)){
             throw new JuaError("Array.len() called on a non-array object");
         }
-        auto arr = static_cast<Jua_Array*>(self);
-        return new Jua_Num(self->vm, arr->items.size());
+        auto arr = self.as<Jua_Array>();
+        return Jua_Num(arr->items.size());
     }));
-    proto->setProp("join", makeFunc([](jualist& args){
+    proto->setProp("join", makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 1) throw new JuaError("Array.join() requires at least 1 argument");
         auto self = args[0];
         string sep = "";
         if(args.size() >= 2){
-            sep = args[1]->toString();
+            sep = args[1].toString();
         }
         string result;
-        auto iter = self->getIterator();
+        std::unique_ptr<JuaIterator> iter(self.getIterator());
         bool first = true;
         while(auto value = iter->next()){
             if(first) first = false;
             else result += sep;
-            result += value->toString();
+            result += value.toString();
         }
-        delete iter;
-        return new Jua_Str(self->vm, result);
+        return new Jua_Str(vm, result);
     }));
-    proto->setProp("push", makeFunc([](jualist& args){
+    proto->setProp("push", makeFunc([](JuaVM*, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 2) throw new JuaError("Array.push() requires at least 1 argument");
         auto self = args[0];
-        if(!self->isType(Jua_Array::type_id)){
+        if(!self.isType(Jua_Array::type_id)){
             throw new JuaError("Array.push() called on a non-array object");
         }
-        auto arr = static_cast<Jua_Array*>(self);
+        auto arr = self.as<Jua_Array>();
         for(size_t i=1; i<args.size(); i++){
+            arr->vm->gc.barrier(arr, args[i]);
             arr->items.push_back(args[i]);
         }
         return Jua_Null::getInst();
     }));
-    proto->setProp("pop", makeFunc([](jualist& args) -> Jua_Val* {
+    proto->setProp("pop", makeFunc([](JuaVM*, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 1) throw new JuaError("Array.pop() requires 1 argument");
         auto self = args[0];
-        if(!self->isType(Jua_Array::type_id)){
+        if(!self.isType(Jua_Array::type_id)){
             throw new JuaError("Array.pop() called on a non-array object");
         }
-        auto arr = static_cast<Jua_Array*>(self);
+        auto arr = self.as<Jua_Array>();
         if(arr->items.empty()){
             return Jua_Null::getInst();
         }
@@ -575,45 +629,45 @@ Jua_Obj* JuaVM::makeArrayProto(){
         arr->items.pop_back();
         return val;
     }));
-    proto->setProp("toString", makeFunc([](jualist& args){
+    proto->setProp("toString", makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 1) throw new JuaError("Array.toString() requires 1 argument");
         auto self = args[0];
         //仅要求可迭代
-        auto iter = self->getIterator();
+        std::unique_ptr<JuaIterator> iter(self.getIterator());
         string result = "[";
         while(auto value = iter->next()){
             if(result.size() > 1) result += ", ";
-            result += value->toString();
+            result += value.toString();
         }
         result += "]";
-        return new Jua_Str(self->vm, result);
+        return new Jua_Str(vm, result);
     }));
     return proto;
 }
 Jua_Obj* JuaVM::makeBufferProto(){
-    auto proto = buildClass([this](jualist& args){
+    auto proto = buildClass([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
         if(!args.size())
             throw new JuaError("Missing argument");
         auto val = args[0];
-        auto buf = new Jua_Buffer(this, val->toInt());
+        auto buf = new Jua_Buffer(vm, val.toInt());
         return buf;
     });
-    proto->setProp("read", makeFunc([](jualist& args){
+    proto->setProp("read", makeFunc([](JuaVM*, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 3) throw new JuaError("Buffer.read() requires 3 argument");
         auto self = args[0], start = args[1], end = args[2];
-        if(!self->isType(Jua_Buffer::type_id)){
+        if(!self.isType(Jua_Buffer::type_id)){
             throw new JuaError("Buffer.read() called on a improper value");
         }
-        auto buf = static_cast<Jua_Buffer*>(self);
+        auto buf = self.as<Jua_Buffer>();
         return buf->read(start, end);
     }));
-    proto->setProp("write", makeFunc([](jualist& args){
+    proto->setProp("write", makeFunc([](JuaVM*, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 2) throw new JuaError("Buffer.write() requires at least 2 arguments");
         auto self = args[0], data = args[1], pos = args.size() > 2 ? args[2] : nullptr;
-        if(!self->isType(Jua_Buffer::type_id)){
+        if(!self.isType(Jua_Buffer::type_id)){
             throw new JuaError("Buffer.write() called on a improper value");
         }
-        auto buf = static_cast<Jua_Buffer*>(self);
+        auto buf = self.as<Jua_Buffer>();
         buf->write(data, pos);
         return Jua_Null::getInst();
     }));
@@ -621,53 +675,53 @@ Jua_Obj* JuaVM::makeBufferProto(){
 }
 Jua_Obj* JuaVM::makeErrorProto(){
     auto proto = new Jua_Obj(this, classProto);
-    proto->setProp("init", makeFunc([this](jualist& args){
+    proto->setProp("init", makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
         auto self = args[0];
-        if(self->type != Jua_Val::Obj)
+        if(self.type() != Jua_Val::Obj)
             throw new JuaError("Error.init() called on a non-object");
         string message;
         if(args.size() > 1){
-            message = args[1]->toString();
+            message = args[1].toString();
         }
-        auto err = static_cast<Jua_Obj*>(self);
-        err->setProp("message", new Jua_Str(this, message));
+        auto err = self.as<Jua_Obj>();
+        err->setProp("message", new Jua_Str(vm, message));
         return Jua_Null::getInst();
     }));
     proto->setProp("name", new Jua_Str(this, "Error"));
-    proto->setProp("toString", makeFunc([](jualist& args){
+    proto->setProp("toString", makeFunc([](JuaVM* vm, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 1) throw new JuaError("Error.toString() requires 1 argument");
         auto self = args[0];
-        if(self->type != Jua_Val::Obj)
+        if(self.type() != Jua_Val::Obj)
             throw new JuaError("Error.toString() called on a non-object");
-        auto err = static_cast<Jua_Obj*>(self);
+        auto err = self.as<Jua_Obj>();
         auto name = err->getProp("name");
-        string prefix = name ? name->toString() : "Error";
+        string prefix = name ? name.toString() : "Error";
         auto msg = err->getProp("message");
-        string message = msg ? msg->toString() : "unknown";
-        return new Jua_Str(self->vm, prefix + ": " + message);
+        string message = msg ? msg.toString() : "unknown";
+        return new Jua_Str(vm, prefix + ": " + message);
     }));
     return proto;
 }
 Jua_Obj* JuaVM::makeTryResProto(){
     auto proto = new Jua_Obj(this);
-    proto->setProp("catch", makeFunc([this](jualist& args) -> Jua_Val* {
+    proto->setProp("catch", makeFunc([](JuaVM*, JuaArgs args, void*) -> Jua_Val {
         if(args.size() < 2) throw new JuaError("TryRes.catch() requires 2 arguments");
         auto self = args[0], fn = args[1]; //todo: catch(self, ErrorType, fn)
-        if(self->type != Jua_Val::Obj)
+        if(self.type() != Jua_Val::Obj)
             throw new JuaError("TryRes.catch() called on a non-object");
-        auto res = static_cast<Jua_Obj*>(self);
+        auto res = self.as<Jua_Obj>();
         auto status = res->getProp("status");
-        if(!status || status->type != Jua_Val::Bool)
+        if(!status || status.type() != Jua_Val::Bool)
             throw new JuaError("TryRes.catch() called on an invalid object");
-        if(status->toBoolean()){
+        if(status.toBoolean()){
             return res;
         }
-        if(fn->type != Jua_Val::Func)
+        if(fn.type() != Jua_Val::Func)
             throw new JuaError("TryRes.catch() requires a function argument");
         auto error = res->getProp("error");
         if(!error)
             throw new JuaError("TryRes.catch() called on an invalid object");
-        return fn->call({error});
+        return fn.call({error});
     }));
     return proto;
 }
@@ -0,0 +1,301 @@
+#pragma once
+
+//基准测试（bench.cpp）的负载，check.cpp 也用各执行方式运行它们并比较结果
+struct Workload{
+    const char* name;
+    const char* script;
+};
+const Workload workloads[] = {
+    {"temporaries", R"(
+        let i = 0
+        while(i < 300000){
+            let p = {x = i, y = i + 1}
+            let s = 'a' + 'b'
+            i += 1
+        }
+    )"},
+    {"range", R"(
+        let sum = 0
+        for(i in 0..300000) sum += i
+    )"},
+    {"template", R"(
+        let i = 0
+        while(i < 200000){
+            let s = "item ${i}: ${i + 1}"
+            i += 1
+        }
+    )"},
+    {"retained", R"(
+        let keep = Array.of()
+        let i = 0
+        while(i < 200000){
+            let p = {x = i}
+            if(i < 50000) keep:push(p)
+            i += 1
+        }
+    )"},
+    {"large-heap", R"(
+        let keep = Array.of()
+        let i = 0
+        while(i < 200000){
+            keep:push({x = i, tag = "n${i}"})
+            i += 1
+        }
+        let j = 0
+        while(j < 300000){
+            let tmp = {y = j}
+            j += 1
+        }
+    )"},
+    {"records", R"(
+        let keep = Array.of()
+        let i = 0
+        while(i < 100000){
+            keep:push({id = i, x = i, y = i, z = i})
+            i += 1
+        }
+    )"},
+    {"locals", R"(
+        fun work(n){
+            let a = 0
+            let b = 1
+            let i = 0
+            while(i < n){
+                if(i < n){ a += b + i }
+                b += 1
+                i += 1
+            }
+            return a
+        }
+        work(300000)
+    )"},
+    {"arith", R"(
+        let sum = 0
+        let x = 0.5
+        let i = 0
+        while(i < 500000){
+            if(i >= 10 && i * 2 > x) sum = sum + i / 2 - x
+            if(sum != i) x = x * 0.5 + 1
+            i += 1
+        }
+        let s = ''
+        let j = 0
+        while(j < 2000){
+            s = s + 'x'
+            j += 1
+        }
+    )"},
+    {"calls", R"(
+        fun fib(n){ if(n < 2) return n; return fib(n - 1) + fib(n - 2) }
+        fun add(a, b){ return a + b }
+        let s = fib(25)
+        let i = 0
+        while(i < 300000){
+            s = add(s, i)
+            i += 1
+        }
+    )"},
+    {"tailcalls", R"(
+        fun loop(n, acc){
+            if(n == 0) return acc
+            return loop(n - 1, acc + 1)
+        }
+        fun isEven(n){ if(n == 0) return true; return isOdd(n - 1) }
+        fun isOdd(n){ if(n == 0) return false; return isEven(n - 1) }
+        if(loop(1000000, 0) != 1000000 || !isEven(200000)) throw('tail calls')
+    )"},
+    {"switch", R"(
+        let ops = Array.of('get', 'set', 'del', 'add', 'sub', 'mul', 'div', 'inc', 'dec', 'push', 'pop', 'peek', 'open', 'close', 'read', 'write', 'seek', 'tell', 'ping', 'pong', 'auth', 'quit', 'list', 'stat')
+        let sum = 0
+        let j = 0
+        while(j < 10000){
+            for(op in ops){
+                switch(op)
+                    case('get') sum += 1
+                    case('set') sum += 2
+                    case('del') sum += 3
+                    case('add') sum += 4
+                    case('sub') sum += 5
+                    case('mul') sum += 6
+                    case('div') sum += 7
+                    case('inc') sum += 8
+                    case('dec') sum += 9
+                    case('push') sum += 10
+                    case('pop') sum += 11
+                    case('peek') sum += 12
+                    case('open') sum += 13
+                    case('close') sum += 14
+                    case('read') sum += 15
+                    case('write') sum += 16
+                    case('seek') sum += 17
+                    case('tell') sum += 18
+                    case('ping') sum += 19
+                    case('pong') sum += 20
+                    case('auth') sum += 21
+                    case('quit') sum += 22
+                    case('list') sum += 23
+                    case('stat') sum += 24
+                    else sum = 0
+            }
+            for(k in 0..24){
+                switch(k)
+                    case(0) sum -= 0
+                    case(1) sum -= 1
+                    case(2) sum -= 2
+                    case(3) sum -= 3
+                    case(4) sum -= 4
+                    case(5) sum -= 5
+                    case(6) sum -= 6
+                    case(7) sum -= 7
+                    case(8) sum -= 8
+                    case(9) sum -= 9
+                    case(10) sum -= 10
+                    case(11) sum -= 11
+                    case(12) sum -= 12
+                    case(13) sum -= 13
+                    case(14) sum -= 14
+                    case(15) sum -= 15
+                    case(16) sum -= 16
+                    case(17) sum -= 17
+                    case(18) sum -= 18
+                    case(19) sum -= 19
+                    case(20) sum -= 20
+                    case(21) sum -= 21
+                    case(22) sum -= 22
+                    case(23) sum -= 23
+                    else sum = 0
+            }
+            j += 1
+        }
+    )"},
+    {"methods", R"(
+        let Point = class({
+            init(self, x, y){ self.x = x; self.y = y },
+            len2(self){ return self.x * self.x + self.y * self.y }
+        })
+        let Point3 = class({
+            super = Point,
+            init(self, x, y){ self.x = x; self.y = y; self.z = 0 }
+        })
+        let sum = 0
+        let i = 0
+        while(i < 100000){
+            let p = Point(i, 1)
+            let q = Point3(1, i)
+            sum += p:len2() + q:len2() + p.x + q.y
+            i += 1
+        }
+        let shapes = Array.of({x = 1}, {a = 1, x = 2}, {b = 1, x = 3}, {c = 1, x = 4}, {d = 1, x = 5})
+        let j = 0
+        while(j < 20000){
+            for(o in shapes) sum += o.x
+            j += 1
+        }
+        let A = class({ f(self){ return 'A' } })
+        let B = class({ f(self){ return 'B' } })
+        let CA = class({ super = A, g = 1 })
+        let CB = class({ super = B, g = 1 })
+        fun get(c){ return c.f }
+        let k = 0
+        while(k < 20000){
+            if(get(CA)(null) != 'A' || get(CB)(null) != 'B') throw('wrong super')
+            k += 1
+        }
+    )"},
+    {"dictionary", R"(
+        let o = {a = 1, b = 2, c = 3, d = 4, e = 5, f = 6, g = 7, h = 8, i = 9, j = 10, k = 11, l = 12}
+        let sum = 0
+        let n = 0
+        while(n < 10000){
+            for(key in o) sum += o[key]
+            n += 1
+        }
+    )"},
+    {"errors", R"(
+        let json = require('json')
+        let failed = 0
+        let i = 0
+        while(i < 50000){
+            if(!try(fun(){ throw('bad') }).status) failed += 1
+            if(!try(json.decode, '{x').status) failed += 1
+            i += 1
+        }
+    )"},
+};
+
+//机器码（JitCode）对比：同一负载分别关闭和开启 jit
+const Workload jitWorkloads[] = {
+    {"fib", R"(
+        fun fib(n){ if(n < 2) return n; return fib(n - 1) + fib(n - 2) }
+        fib(27)
+    )"},
+    {"loops", R"(
+        fun loops(n){
+            let sum = 0
+            let i = 0
+            while(i < n){
+                let j = 0
+                while(j < 10){
+                    sum = sum + i * j - j / 2
+                    j += 1
+                }
+                i += 1
+            }
+            for(k in 0..n) sum -= k
+            return sum
+        }
+        loops(300000)
+    )"},
+    {"nbody", R"(
+        let sqrt = require('math').sqrt
+        let PI = 3.141592653589793
+        let SOLAR_MASS = 4 * PI * PI
+        let DAYS = 365.24
+        fun body(x, y, z, vx, vy, vz, mass){
+            return {x = x, y = y, z = z, vx = vx * DAYS, vy = vy * DAYS, vz = vz * DAYS, mass = mass * SOLAR_MASS}
+        }
+        let bodies = Array.of(
+            body(0, 0, 0, 0, 0, 0, 1),
+            body(4.841431442464721, -1.1603200440274284, -0.10362204447112311, 0.001660076642744037, 0.007699011184197404, -0.0000690460016972063, 0.0009547919384243266),
+            body(8.34336671824458, 4.124798564124305, -0.4035234171143214, -0.002767425107268624, 0.004998528012349172, 0.00002304172975737639, 0.0002858859806661308),
+            body(12.894369562139131, -15.111151401698631, -0.22330757889265573, 0.002964601375647616, 0.0023784717395948095, -0.000029658956854023756, 0.00004366244043351563),
+            body(15.379697114850917, -25.919314609987964, 0.17925877295037118, 0.0026806777249038932, 0.001628241700382423, -0.00009515922545197159, 0.00005151389020466115)
+        )
+        fun advance(bodies, n, dt){
+            let i = 0
+            while(i < n){
+                let b = bodies[i]
+                let j = i + 1
+                while(j < n){
+                    let b2 = bodies[j]
+                    let dx = b.x - b2.x
+                    let dy = b.y - b2.y
+                    let dz = b.z - b2.z
+                    let d2 = dx * dx + dy * dy + dz * dz
+                    let mag = dt / (d2 * sqrt(d2))
+                    b.vx = b.vx - dx * b2.mass * mag
+                    b.vy = b.vy - dy * b2.mass * mag
+                    b.vz = b.vz - dz * b2.mass * mag
+                    b2.vx = b2.vx + dx * b.mass * mag
+                    b2.vy = b2.vy + dy * b.mass * mag
+                    b2.vz = b2.vz + dz * b.mass * mag
+                    j += 1
+                }
+                i += 1
+            }
+            i = 0
+            while(i < n){
+                let b = bodies[i]
+                b.x = b.x + dt * b.vx
+                b.y = b.y + dt * b.vy
+                b.z = b.z + dt * b.vz
+                i += 1
+            }
+        }
+        let k = 0
+        while(k < 50000){
+            advance(bodies, 5, 0.01)
+            k += 1
+        }
+    )"},
+};